@@ -0,0 +1,204 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Kinds of addresses kept in the address and spent indexes */
+enum AddressIndexType {
+    ADDRESS_TYPE_NONE = 0,
+    ADDRESS_TYPE_PUBKEYHASH = 1,
+    ADDRESS_TYPE_SCRIPTHASH = 2,
+};
+
+//! Heights and positions are stored big endian, so LevelDB iterates an address in chain order
+template <typename Stream>
+inline void WriteBE32ToStream(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline uint32_t ReadBE32FromStream(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ReadBE32(buf);
+}
+
+/** One output received or spent by an address: 'a' + type + hash + height + position + txid + index + spending */
+struct CAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() { SetNull(); }
+
+    CAddressIndexKey(unsigned int addressType, const uint160& addressHash, int height, unsigned int blockindex,
+        const uint256& txid, unsigned int indexValue, bool isSpending)
+        : type(addressType), hashBytes(addressHash), blockHeight(height), txindex(blockindex),
+          txhash(txid), index(indexValue), spending(isSpending) {}
+
+    void SetNull()
+    {
+        type = 0;
+        hashBytes = 0;
+        blockHeight = 0;
+        txindex = 0;
+        txhash = 0;
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 66;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        WriteBE32ToStream(s, blockHeight);
+        WriteBE32ToStream(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ReadBE32FromStream(s);
+        txindex = ReadBE32FromStream(s);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Prefix of CAddressIndexKey used to seek to the history of an address, optionally from a height */
+struct CAddressIndexIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    CAddressIndexIteratorKey(unsigned int addressType, const uint160& addressHash)
+        : type(addressType), hashBytes(addressHash), fHeight(false), blockHeight(0) {}
+
+    CAddressIndexIteratorKey(unsigned int addressType, const uint160& addressHash, int height)
+        : type(addressType), hashBytes(addressHash), fHeight(true), blockHeight(height) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return fHeight ? 25 : 21;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            WriteBE32ToStream(s, blockHeight);
+    }
+};
+
+/** An unspent output of an address: 'u' + type + hash + txid + index */
+struct CAddressUnspentKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() { SetNull(); }
+
+    CAddressUnspentKey(unsigned int addressType, const uint160& addressHash, const uint256& txid, unsigned int indexValue)
+        : type(addressType), hashBytes(addressHash), txhash(txid), index(indexValue) {}
+
+    void SetNull()
+    {
+        type = 0;
+        hashBytes = 0;
+        txhash = 0;
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 57;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue() { SetNull(); }
+
+    CAddressUnspentValue(CAmount nValue, const CScript& scriptPubKey, int height)
+        : satoshis(nValue), script(scriptPubKey), blockHeight(height) {}
+
+    //! A null value erases the entry when passed to UpdateAddressUnspentIndex
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const { return satoshis == -1; }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
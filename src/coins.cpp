@@ -5,6 +5,7 @@
 
 #include "coins.h"
 
+#include "hash.h"
 #include "random.h"
 
 #include <assert.h>
@@ -33,6 +34,26 @@ void CCoins::CalcMaskSize(unsigned int& nBytes, unsigned int& nNonzeroBytes) con
     nBytes += nLastUsedByte;
 }
 
+void CCoinsStats::UpdateOutput(const COutPoint& outpoint, const CTxOut& out, bool fAdd)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << outpoint << out;
+    uint256 hashOut = ss.GetHash();
+    uint64_t nBytes = ::GetSerializeSize(outpoint, SER_NETWORK, PROTOCOL_VERSION) + ::GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION);
+
+    if (fAdd) {
+        nTransactionOutputs++;
+        nTotalAmount += out.nValue;
+        nOutputBytes += nBytes;
+        hashCommitment += hashOut;
+    } else {
+        nTransactionOutputs--;
+        nTotalAmount -= out.nValue;
+        nOutputBytes -= nBytes;
+        hashCommitment -= hashOut;
+    }
+}
+
 bool CCoins::Spend(const COutPoint& out, CTxInUndo& undo)
 {
     if (out.n >= vout.size())
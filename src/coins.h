@@ -319,6 +319,11 @@ struct CCoinsCacheEntry {
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
+/**
+ * Statistics about the UTXO set. nSerializedSize and hashSerialized need a scan of
+ * the whole chainstate; the other fields are also maintained per output while blocks
+ * are connected, see UpdateCoins(), and stored for every block.
+ */
 struct CCoinsStats {
     int nHeight;
     uint256 hashBlock;
@@ -327,8 +332,29 @@ struct CCoinsStats {
     uint64_t nSerializedSize;
     uint256 hashSerialized;
     CAmount nTotalAmount;
+    //! Serialized size of the unspent outputs and their outpoints
+    uint64_t nOutputBytes;
+    //! Sum modulo 2^256 of the hashes of all unspent outputs, so outputs can be added and removed in any order
+    uint256 hashCommitment;
+
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0), nOutputBytes(0), hashCommitment(0) {}
+
+    //! Account for an output entering (fAdd) or leaving the UTXO set
+    void UpdateOutput(const COutPoint& outpoint, const CTxOut& out, bool fAdd);
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(nOutputBytes);
+        READWRITE(hashCommitment);
+    }
 };
 
 
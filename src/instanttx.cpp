@@ -14,19 +14,44 @@
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
+#include <deque>
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
 using namespace boost;
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
+CCriticalSection cs_instantx;
+TxLockRequestMap mapTxLockReq;
+TxLockRequestMap mapTxLockReqRejected;
+TxLockVoteMap mapTxLockVote;
+TxLockMap mapTxLocks;
 std::map<COutPoint, uint256> mapLockedInputs;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+int64_t nUnknownVotesTotal = 0;
 int nCompleteTXLocks;
 
+// locks ordered by expiration, so cleaning doesn't have to look at every lock
+static std::set<std::pair<int, uint256> > setLockExpirations;
+
+// masternode ranks per lock block height and the time they were computed
+static CCriticalSection cs_quorums;
+static std::map<int, std::pair<int64_t, std::map<COutPoint, int> > > mapQuorumRanks;
+
+// votes waiting for ThreadInstantTXVotes
+static CWaitableCriticalSection csVoteQueue;
+static CConditionVariable condVoteQueue;
+static std::deque<std::pair<CConsensusVote, CNode*> > queueVotes;
+
+// request to lock latency, bucket upper bounds in milliseconds
+static const int64_t LOCK_LATENCY_BOUNDS[] = {100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000};
+static const unsigned int LOCK_LATENCY_BUCKETS = sizeof(LOCK_LATENCY_BOUNDS) / sizeof(LOCK_LATENCY_BOUNDS[0]) + 1;
+static uint64_t nLockLatencyCounts[LOCK_LATENCY_BUCKETS];
+static uint64_t nLocksRequested = 0;
+static uint64_t nLocksCompleted = 0;
+static uint64_t nLocksExpired = 0;
+static int64_t nLockLatencyTotal = 0;
+
 //txlock - Locks transaction
 //
 //step 1.) Broadcast intention to lock transaction inputs, "txlreg", CTransaction
@@ -34,6 +59,71 @@ int nCompleteTXLocks;
 //         Send "txvote", CTransaction, Signature, Approve
 //step 3.) Top 1 masternode, waits for INSTANTTX_SIGNATURES_REQUIRED messages. Upon success, sends "txlock'
 
+static void SetLockExpiration(CTransactionLock& lock, int nExpiration)
+{
+    setLockExpirations.erase(make_pair(lock.nExpiration, lock.txHash));
+    lock.nExpiration = nExpiration;
+    setLockExpirations.insert(make_pair(lock.nExpiration, lock.txHash));
+}
+
+static CTransactionLock& GetOrCreateLock(const uint256& txHash)
+{
+    TxLockMap::iterator it = mapTxLocks.find(txHash);
+    if (it != mapTxLocks.end()) return it->second;
+
+    CTransactionLock& newLock = mapTxLocks[txHash];
+    newLock.txHash = txHash;
+    newLock.nTimeout = GetTime() + (60 * 5);
+    SetLockExpiration(newLock, GetTime() + (60 * 60)); //locks expire after 60 minutes (24 confirmations)
+    return newLock;
+}
+
+static void SetUnknownVoteTime(const uint256& hash, int64_t nTime)
+{
+    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.find(hash);
+    if (it != mapUnknownVotes.end()) {
+        nUnknownVotesTotal -= it->second;
+        it->second = nTime;
+    } else {
+        mapUnknownVotes.insert(make_pair(hash, nTime));
+    }
+    nUnknownVotesTotal += nTime;
+}
+
+static void RecordLockCompleted(CTransactionLock& lock)
+{
+    lock.fCompleted = true;
+    if (lock.nTimeRequested == 0) return;
+
+    int64_t nLatency = GetTimeMillis() - lock.nTimeRequested;
+    unsigned int nBucket = 0;
+    while (nBucket < LOCK_LATENCY_BUCKETS - 1 && nLatency > LOCK_LATENCY_BOUNDS[nBucket])
+        nBucket++;
+
+    nLockLatencyCounts[nBucket]++;
+    nLocksCompleted++;
+    nLockLatencyTotal += nLatency;
+
+    LogPrint("instanttx", "InstantTX - Transaction Lock %s completed in %dms\n", lock.txHash.ToString(), nLatency);
+}
+
+static void QueueConsensusVote(CNode* pfrom, const CConsensusVote& ctx)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csVoteQueue);
+        if (queueVotes.size() < INSTANTTX_MAX_QUEUED_VOTES) {
+            queueVotes.push_back(make_pair(ctx, pfrom->AddRef()));
+            condVoteQueue.notify_one();
+            return;
+        }
+    }
+
+    // forget the vote so it can be requested again later
+    LogPrint("instanttx", "InstantTX - vote queue full, dropping vote %s\n", ctx.GetHash().ToString());
+    LOCK(cs_instantx);
+    mapTxLockVote.erase(ctx.GetHash());
+}
+
 void ProcessMessageInstantTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all masternode related functionality
@@ -49,8 +139,11 @@ void ProcessMessageInstantTX(CNode* pfrom, std::string& strCommand, CDataStream&
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
-            return;
+        {
+            LOCK(cs_instantx);
+            if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+                return;
+            }
         }
 
         if (!IsIXTXValid(tx)) {
@@ -81,7 +174,10 @@ void ProcessMessageInstantTX(CNode* pfrom, std::string& strCommand, CDataStream&
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs_instantx);
+                mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            }
 
             LogPrintf("ProcessMessageInstantTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -90,35 +186,40 @@ void ProcessMessageInstantTX(CNode* pfrom, std::string& strCommand, CDataStream&
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            bool fReprocess = false;
+            {
+                LOCK(cs_instantx);
+                mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
 
-            // can we get the conflicting transaction as proof?
+                // can we get the conflicting transaction as proof?
 
-            LogPrintf("ProcessMessageInstantTX::ix - Transaction Lock Request: %s %s : rejected %s\n",
-                pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
-                tx.GetHash().ToString().c_str());
+                LogPrintf("ProcessMessageInstantTX::ix - Transaction Lock Request: %s %s : rejected %s\n",
+                    pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
+                    tx.GetHash().ToString().c_str());
 
-            BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
+                BOOST_FOREACH (const CTxIn& in, tx.vin) {
+                    if (!mapLockedInputs.count(in.prevout)) {
+                        mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
+                    }
                 }
-            }
 
-            // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= INSTANTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageInstantTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+                // resolve conflicts
+                TxLockMap::iterator i = mapTxLocks.find(tx.GetHash());
+                if (i != mapTxLocks.end()) {
+                    //we only care if we have a complete tx lock
+                    if ((*i).second.CountSignatures() >= INSTANTTX_SIGNATURES_REQUIRED) {
+                        if (!CheckForConflictingLocks(tx)) {
+                            LogPrintf("ProcessMessageInstantTX::ix - Found Existing Complete IX Lock\n");
+                            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+                            fReprocess = true;
+                        }
                     }
                 }
             }
 
+            //reprocess the last 15 blocks
+            if (fReprocess) ReprocessBlocks(15);
+
             return;
         }
     } else if (strCommand == "txlvote") // InstantTX Lock Consensus Votes
@@ -129,38 +230,75 @@ void ProcessMessageInstantTX(CNode* pfrom, std::string& strCommand, CDataStream&
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
-            return;
+        {
+            LOCK(cs_instantx);
+            if (mapTxLockVote.count(ctx.GetHash())) {
+                return;
+            }
+
+            mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
         }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
-
-        if (ProcessConsensusVote(pfrom, ctx)) {
-            //Spam/Dos protection
-            /*
-                Masternodes will sometimes propagate votes before the transaction is known to the client.
-                This tracks those messages and allows it at the same rate of the rest of the network, if
-                a peer violates it, it will simply be ignored
-            */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
-                if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+        // rank and signature checks are done by ThreadInstantTXVotes
+        QueueConsensusVote(pfrom, ctx);
 
-                if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
-                    LogPrintf("ProcessMessageInstantTX::ix - masternode is spamming transaction votes: %s %s\n",
-                        ctx.vinMasternode.ToString().c_str(),
-                        ctx.txHash.ToString().c_str());
-                    return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+        return;
+    }
+}
+
+// verify a vote taken from the queue and relay it if it's good
+static void ProcessQueuedVote(CNode* pfrom, CConsensusVote& ctx)
+{
+    if (!ProcessConsensusVote(pfrom, ctx)) return;
+
+    {
+        LOCK(cs_instantx);
+
+        //Spam/Dos protection
+        /*
+            Masternodes will sometimes propagate votes before the transaction is known to the client.
+            This tracks those messages and allows it at the same rate of the rest of the network, if
+            a peer violates it, it will simply be ignored
+        */
+        if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
+            const uint256& hashMasternode = ctx.vinMasternode.prevout.hash;
+            if (!mapUnknownVotes.count(hashMasternode)) {
+                SetUnknownVoteTime(hashMasternode, GetTime() + (60 * 10));
+            }
+
+            if (mapUnknownVotes[hashMasternode] > GetTime() &&
+                mapUnknownVotes[hashMasternode] - GetAverageVoteTime() > 60 * 10) {
+                LogPrintf("ProcessMessageInstantTX::ix - masternode is spamming transaction votes: %s %s\n",
+                    ctx.vinMasternode.ToString().c_str(),
+                    ctx.txHash.ToString().c_str());
+                return;
+            } else {
+                SetUnknownVoteTime(hashMasternode, GetTime() + (60 * 10));
             }
-            RelayInv(inv);
         }
+    }
 
-        return;
+    CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
+    RelayInv(inv);
+}
+
+void ThreadInstantTXVotes()
+{
+    RenameThread("oxid-ixvotes");
+
+    while (true) {
+        std::pair<CConsensusVote, CNode*> item;
+        {
+            boost::unique_lock<boost::mutex> lock(csVoteQueue);
+            while (queueVotes.empty())
+                condVoteQueue.wait(lock);
+
+            item = queueVotes.front();
+            queueVotes.pop_front();
+        }
+
+        ProcessQueuedVote(item.second, item.first);
+        item.second->Release();
     }
 }
 
@@ -213,12 +351,34 @@ bool IsIXTXValid(const CTransaction& txCollateral)
 
 int64_t CreateNewLock(CTransaction tx)
 {
-    int64_t nTxAge = 0;
-    BOOST_REVERSE_FOREACH (CTxIn i, tx.vin) {
-        nTxAge = GetInputAge(i);
-        if (nTxAge < 5) //1 less than the "send IX" gui requires, incase of a block propagating the network at the time
+    // look up the age of all inputs through one coins view (see GetInputAge)
+    std::vector<int> vTxAge;
+    int nTipHeight;
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (chainActive.Tip() == NULL) return 0;
+        nTipHeight = chainActive.Tip()->nHeight;
+
+        CCoinsView viewDummy;
+        CCoinsViewCache view(&viewDummy);
+        CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+        view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
+
+        BOOST_FOREACH (const CTxIn& in, tx.vin) {
+            const CCoins* coins = view.AccessCoins(in.prevout.hash);
+            if (!coins)
+                vTxAge.push_back(-1);
+            else if (coins->nHeight < 0)
+                vTxAge.push_back(0);
+            else
+                vTxAge.push_back((nTipHeight + 1) - coins->nHeight);
+        }
+    }
+
+    BOOST_FOREACH (int nAge, vTxAge) {
+        if (nAge < 5) //1 less than the "send IX" gui requires, incase of a block propagating the network at the time
         {
-            LogPrintf("CreateNewLock - Transaction not found / too new: %d / %s\n", nTxAge, tx.GetHash().ToString().c_str());
+            LogPrintf("CreateNewLock - Transaction not found / too new: %d / %s\n", nAge, tx.GetHash().ToString().c_str());
             return 0;
         }
     }
@@ -228,32 +388,58 @@ int64_t CreateNewLock(CTransaction tx)
         This prevents attackers from using transaction mallibility to predict which masternodes
         they'll use.
     */
-    int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
+    int64_t nTxAge = vTxAge.empty() ? 0 : vTxAge[0];
+    int nBlockHeight = (nTipHeight - nTxAge) + 4;
+
+    LOCK(cs_instantx);
 
     if (!mapTxLocks.count(tx.GetHash())) {
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
     } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
         LogPrint("instanttx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
     }
 
+    CTransactionLock& lock = GetOrCreateLock(tx.GetHash());
+    lock.nBlockHeight = nBlockHeight;
+    if (lock.nTimeRequested == 0) {
+        lock.nTimeRequested = GetTimeMillis();
+        nLocksRequested++;
+    }
 
     return nBlockHeight;
 }
 
+int GetQuorumRank(const CTxIn& vin, int nBlockHeight)
+{
+    // all votes of a lock are ranked against the same block, rank the masternodes once per height
+    {
+        LOCK(cs_quorums);
+        std::map<int, std::pair<int64_t, std::map<COutPoint, int> > >::const_iterator it = mapQuorumRanks.find(nBlockHeight);
+        if (it != mapQuorumRanks.end() && it->second.first + INSTANTTX_QUORUM_SNAPSHOT_SECONDS >= GetTime()) {
+            std::map<COutPoint, int>::const_iterator itRank = it->second.second.find(vin.prevout);
+            return itRank == it->second.second.end() ? -1 : itRank->second;
+        }
+    }
+
+    // ranking takes cs_main, so it's done without holding cs_quorums
+    std::map<COutPoint, int> mapRanks = mnodeman.GetMasternodeRankMap(nBlockHeight, MIN_INSTANTTX_PROTO_VERSION);
+    std::map<COutPoint, int>::const_iterator itRank = mapRanks.find(vin.prevout);
+    int nRank = itRank == mapRanks.end() ? -1 : itRank->second;
+
+    LOCK(cs_quorums);
+    std::pair<int64_t, std::map<COutPoint, int> >& snapshot = mapQuorumRanks[nBlockHeight];
+    snapshot.first = GetTime();
+    snapshot.second.swap(mapRanks);
+
+    return nRank;
+}
+
 // check if we need to vote on this transaction
 void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_INSTANTTX_PROTO_VERSION);
+    int n = GetQuorumRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("instanttx", "InstantTX::DoConsensusVote - Unknown Masternode\n");
@@ -283,7 +469,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    {
+        LOCK(cs_instantx);
+        mapTxLockVote[ctx.GetHash()] = ctx;
+    }
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -292,7 +481,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_INSTANTTX_PROTO_VERSION);
+    int n = GetQuorumRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if (pmn != NULL)
@@ -317,72 +506,84 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("InstantTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+    // wallet and chain updates are done after releasing cs_instantx
+    bool fComplete = false;
+    bool fReprocess = false;
+    bool fNotifyLock = false;
+    CTransaction txLocked;
+    {
+        LOCK(cs_instantx);
 
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("instanttx", "InstantTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+        if (!mapTxLocks.count(ctx.txHash)) {
+            LogPrintf("InstantTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+        } else
+            LogPrint("instanttx", "InstantTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
-        (*i).second.AddSignature(ctx);
+        //compile consessus vote
+        CTransactionLock& lock = GetOrCreateLock(ctx.txHash);
+        lock.AddSignature(ctx, n);
 
-#ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
-#endif
+        int nSignatures = lock.CountSignatures();
+        LogPrint("instanttx", "InstantTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
 
-        LogPrint("instanttx", "InstantTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+        if (nSignatures >= INSTANTTX_SIGNATURES_REQUIRED) {
+            LogPrint("instanttx", "InstantTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", lock.GetHash().ToString().c_str());
 
-        if ((*i).second.CountSignatures() >= INSTANTTX_SIGNATURES_REQUIRED) {
-            LogPrint("instanttx", "InstantTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+            bool fNewlyCompleted = !lock.fCompleted;
+            if (fNewlyCompleted) RecordLockCompleted(lock);
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
+            TxLockRequestMap::iterator itReq = mapTxLockReq.find(ctx.txHash);
+            CTransaction tx = itReq != mapTxLockReq.end() ? itReq->second : CTransaction();
             if (!CheckForConflictingLocks(tx)) {
-#ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
+                fComplete = true;
+
+                // listeners hear about a lock once, when it first completes
+                if (fNewlyCompleted && itReq != mapTxLockReq.end()) {
+                    fNotifyLock = true;
+                    txLocked = tx;
                 }
-#endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
-                    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                        if (!mapLockedInputs.count(in.prevout)) {
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
+                BOOST_FOREACH (const CTxIn& in, tx.vin) {
+                    if (!mapLockedInputs.count(in.prevout)) {
+                        mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
                     }
                 }
 
                 // resolve conflicts
 
                 //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+                fReprocess = mapTxLockReqRejected.count(ctx.txHash);
             }
         }
-        return true;
     }
 
+#ifdef ENABLE_WALLET
+    if (pwalletMain) {
+        LOCK(pwalletMain->cs_wallet);
 
-    return false;
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+
+        if (fComplete && pwalletMain->UpdatedTransaction(ctx.txHash)) {
+            nCompleteTXLocks++;
+        }
+    }
+#endif
+
+    if (fNotifyLock)
+        GetMainSignals().NotifyTransactionLock(txLocked);
+
+    //reprocess the last 15 blocks
+    if (fReprocess) ReprocessBlocks(15);
+
+    return true;
 }
 
 bool CheckForConflictingLocks(CTransaction& tx)
 {
+    AssertLockHeld(cs_instantx);
+
     /*
         It's possible (very unlikely though) to get 2 conflicting transaction locks approved by the network.
         In that case, they will cancel each other out.
@@ -391,13 +592,14 @@ bool CheckForConflictingLocks(CTransaction& tx)
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
     BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("InstantTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
+        std::map<COutPoint, uint256>::iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second != tx.GetHash()) {
+            LogPrintf("InstantTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), it->second.ToString().c_str());
+            TxLockMap::iterator itLock = mapTxLocks.find(tx.GetHash());
+            if (itLock != mapTxLocks.end()) SetLockExpiration(itLock->second, GetTime());
+            itLock = mapTxLocks.find(it->second);
+            if (itLock != mapTxLocks.end()) SetLockExpiration(itLock->second, GetTime());
+            return true;
         }
     }
 
@@ -406,49 +608,120 @@ bool CheckForConflictingLocks(CTransaction& tx)
 
 int64_t GetAverageVoteTime()
 {
-    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
-    int64_t total = 0;
-    int64_t count = 0;
-
-    while (it != mapUnknownVotes.end()) {
-        total += it->second;
-        count++;
-        it++;
-    }
+    if (mapUnknownVotes.empty()) return 0;
 
-    return total / count;
+    return nUnknownVotesTotal / (int64_t)mapUnknownVotes.size();
 }
 
 void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    {
+        LOCK(cs_quorums);
+        std::map<int, std::pair<int64_t, std::map<COutPoint, int> > >::iterator it = mapQuorumRanks.begin();
+        while (it != mapQuorumRanks.end()) {
+            if (it->second.first + INSTANTTX_QUORUM_SNAPSHOT_SECONDS < GetTime())
+                mapQuorumRanks.erase(it++);
+            else
+                ++it;
+        }
+    }
+
+    LOCK(cs_instantx);
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    while (!setLockExpirations.empty() && GetTime() > setLockExpirations.begin()->first) { //keep them for an hour
+        uint256 txHash = setLockExpirations.begin()->second;
+        setLockExpirations.erase(setLockExpirations.begin());
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+        TxLockMap::iterator it = mapTxLocks.find(txHash);
+        if (it == mapTxLocks.end()) continue;
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+        LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+        if (!it->second.fCompleted && it->second.nTimeRequested != 0) nLocksExpired++;
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
+        TxLockRequestMap::iterator itReq = mapTxLockReq.find(txHash);
+        if (itReq != mapTxLockReq.end()) {
+            BOOST_FOREACH (const CTxIn& in, itReq->second.vin)
+                mapLockedInputs.erase(in.prevout);
+
+            mapTxLockReq.erase(itReq);
+            mapTxLockReqRejected.erase(txHash);
 
-            mapTxLocks.erase(it++);
+            BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
+                mapTxLockVote.erase(v.GetHash());
+        }
+
+        mapTxLocks.erase(it);
+    }
+
+    // spam tracking of masternodes that haven't voted for an hour
+    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
+    while (it != mapUnknownVotes.end()) {
+        if (it->second < GetTime() - (60 * 60)) {
+            nUnknownVotesTotal -= it->second;
+            mapUnknownVotes.erase(it++);
         } else {
-            it++;
+            ++it;
         }
     }
 }
 
+int CountTransactionLockSignatures(const uint256& txHash)
+{
+    LOCK(cs_instantx);
+
+    TxLockMap::iterator i = mapTxLocks.find(txHash);
+    if (i != mapTxLocks.end()) {
+        return (*i).second.CountSignatures();
+    }
+
+    return -1;
+}
+
+bool HasTransactionLockTimedOut(const uint256& txHash)
+{
+    LOCK(cs_instantx);
+
+    TxLockMap::iterator i = mapTxLocks.find(txHash);
+    if (i != mapTxLocks.end()) {
+        return GetTime() > (*i).second.nTimeout;
+    }
+
+    return false;
+}
+
+bool GetConflictingTransactionLock(const CTransaction& tx, uint256& hashLockRet)
+{
+    LOCK(cs_instantx);
+
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        std::map<COutPoint, uint256>::iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second != tx.GetHash()) {
+            hashLockRet = it->second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void GetLockLatencyStats(CLockLatencyStats& stats)
+{
+    LOCK(cs_instantx);
+
+    stats.vBuckets.clear();
+    for (unsigned int i = 0; i < LOCK_LATENCY_BUCKETS; i++) {
+        int64_t nBound = i < LOCK_LATENCY_BUCKETS - 1 ? LOCK_LATENCY_BOUNDS[i] : -1;
+        stats.vBuckets.push_back(make_pair(nBound, nLockLatencyCounts[i]));
+    }
+    stats.nRequested = nLocksRequested;
+    stats.nCompleted = nLocksCompleted;
+    stats.nExpired = nLocksExpired;
+    stats.nTotalMillis = nLockLatencyTotal;
+}
+
 uint256 CConsensusVote::GetHash() const
 {
     return vinMasternode.prevout.hash + vinMasternode.prevout.n + txHash;
@@ -508,7 +781,7 @@ bool CConsensusVote::Sign()
 bool CTransactionLock::SignaturesValid()
 {
     BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_INSTANTTX_PROTO_VERSION);
+        int n = GetQuorumRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
@@ -529,9 +802,10 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
-void CTransactionLock::AddSignature(CConsensusVote& cv)
+void CTransactionLock::AddSignature(CConsensusVote& cv, int nRank)
 {
     vecConsensusVotes.push_back(cv);
+    mapVoteBits[cv.nBlockHeight] |= 1 << (nRank - 1);
 }
 
 int CTransactionLock::CountSignatures()
@@ -543,11 +817,11 @@ int CTransactionLock::CountSignatures()
 
     if (nBlockHeight == 0) return -1;
 
+    std::map<int, uint32_t>::const_iterator it = mapVoteBits.find(nBlockHeight);
+    if (it == mapVoteBits.end()) return 0;
+
     int n = 0;
-    BOOST_FOREACH (CConsensusVote v, vecConsensusVotes) {
-        if (v.nBlockHeight == nBlockHeight) {
-            n++;
-        }
-    }
+    for (uint32_t nBits = it->second; nBits != 0; nBits &= nBits - 1)
+        n++;
     return n;
 }
@@ -35,10 +35,21 @@ class CTransactionLock;
 
 static const int MIN_INSTANTTX_PROTO_VERSION = 70002;
 
-extern map<uint256, CTransaction> mapTxLockReq;
-extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
+/** Votes waiting for verification beyond this are dropped */
+static const unsigned int INSTANTTX_MAX_QUEUED_VOTES = 10000;
+/** Masternode ranks of a lock height are recomputed after this many seconds */
+static const int64_t INSTANTTX_QUORUM_SNAPSHOT_SECONDS = 60;
+
+typedef boost::unordered_map<uint256, CTransaction, BlockHasher> TxLockRequestMap;
+typedef boost::unordered_map<uint256, CConsensusVote, BlockHasher> TxLockVoteMap;
+typedef boost::unordered_map<uint256, CTransactionLock, BlockHasher> TxLockMap;
+
+// protects the maps below, taken after cs_main and cs_wallet
+extern CCriticalSection cs_instantx;
+extern TxLockRequestMap mapTxLockReq;
+extern TxLockRequestMap mapTxLockReqRejected;
+extern TxLockVoteMap mapTxLockVote;
+extern TxLockMap mapTxLocks;
 extern std::map<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
 
@@ -48,6 +59,7 @@ int64_t CreateNewLock(CTransaction tx);
 bool IsIXTXValid(const CTransaction& txCollateral);
 
 // if two conflicting locks are approved by the network, they will cancel out
+// (cs_instantx must be held)
 bool CheckForConflictingLocks(CTransaction& tx);
 
 void ProcessMessageInstantTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -58,11 +70,38 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
 //process consensus vote message
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
 
+// verifies queued consensus votes off the message handler thread
+void ThreadInstantTXVotes();
+
 // keep transaction locks in memory for an hour
 void CleanTransactionLocksList();
 
 int64_t GetAverageVoteTime();
 
+// rank of a masternode in the lock quorum of a block height, -1 if unknown
+int GetQuorumRank(const CTxIn& vin, int nBlockHeight);
+
+// number of votes of the lock for txHash, -1 if there is none
+int CountTransactionLockSignatures(const uint256& txHash);
+bool HasTransactionLockTimedOut(const uint256& txHash);
+
+// true if an input of tx is locked by another transaction, returned in hashLockRet
+bool GetConflictingTransactionLock(const CTransaction& tx, uint256& hashLockRet);
+
+/** Time from a lock request to its completion, in milliseconds */
+class CLockLatencyStats
+{
+public:
+    // upper bound of each bucket and the number of locks in it, the last bucket is unbounded
+    std::vector<std::pair<int64_t, uint64_t> > vBuckets;
+    uint64_t nRequested;
+    uint64_t nCompleted;
+    uint64_t nExpired;
+    int64_t nTotalMillis;
+};
+
+void GetLockLatencyStats(CLockLatencyStats& stats);
+
 class CConsensusVote
 {
 public:
@@ -96,10 +135,26 @@ public:
     std::vector<CConsensusVote> vecConsensusVotes;
     int nExpiration;
     int nTimeout;
+    // GetTimeMillis() when the lock request was seen, 0 if only votes were
+    int64_t nTimeRequested;
+    bool fCompleted;
+
+    // quorum members that voted, by vote block height with bit nRank - 1 set
+    std::map<int, uint32_t> mapVoteBits;
+
+    CTransactionLock()
+    {
+        nBlockHeight = 0;
+        txHash = 0;
+        nExpiration = 0;
+        nTimeout = 0;
+        nTimeRequested = 0;
+        fCompleted = false;
+    }
 
     bool SignaturesValid();
     int CountSignatures();
-    void AddSignature(CConsensusVote& cv);
+    void AddSignature(CConsensusVote& cv, int nRank);
 
     uint256 GetHash()
     {
@@ -0,0 +1,135 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include "tinyformat.h"
+#include "univalue/univalue.h"
+
+#include <assert.h>
+#include <wctype.h>
+
+void CJSONWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vNeedComma.empty()) {
+        if (vNeedComma.back())
+            strOut += ',';
+        vNeedComma.back() = true;
+    }
+}
+
+// Same escape set as json_spirit's add_esc_chars()
+void CJSONWriter::WriteEscaped(const std::string& str)
+{
+    strOut += '"';
+    for (unsigned int i = 0; i < str.size(); i++) {
+        unsigned char ch = str[i];
+
+        switch (ch) {
+        case '"': strOut += "\\\""; break;
+        case '\\': strOut += "\\\\"; break;
+        case '\b': strOut += "\\b"; break;
+        case '\f': strOut += "\\f"; break;
+        case '\n': strOut += "\\n"; break;
+        case '\r': strOut += "\\r"; break;
+        case '\t': strOut += "\\t"; break;
+        default:
+            if (iswprint(ch))
+                strOut += ch;
+            else
+                strOut += strprintf("\\u%04X", ch);
+        }
+    }
+    strOut += '"';
+}
+
+void CJSONWriter::BeginObject()
+{
+    BeginValue();
+    strOut += '{';
+    vNeedComma.push_back(false);
+}
+
+void CJSONWriter::EndObject()
+{
+    assert(!vNeedComma.empty() && !fAfterKey);
+    vNeedComma.pop_back();
+    strOut += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    BeginValue();
+    strOut += '[';
+    vNeedComma.push_back(false);
+}
+
+void CJSONWriter::EndArray()
+{
+    assert(!vNeedComma.empty() && !fAfterKey);
+    vNeedComma.pop_back();
+    strOut += ']';
+}
+
+CJSONWriter& CJSONWriter::Key(const std::string& strKey)
+{
+    assert(!vNeedComma.empty() && !fAfterKey);
+    BeginValue();
+    WriteEscaped(strKey);
+    strOut += ':';
+    fAfterKey = true;
+    return *this;
+}
+
+void CJSONWriter::String(const std::string& str)
+{
+    BeginValue();
+    WriteEscaped(str);
+}
+
+void CJSONWriter::Int(int64_t n)
+{
+    BeginValue();
+    strOut += strprintf("%d", n);
+}
+
+void CJSONWriter::Bool(bool f)
+{
+    BeginValue();
+    strOut += f ? "true" : "false";
+}
+
+void CJSONWriter::Null()
+{
+    BeginValue();
+    strOut += "null";
+}
+
+void CJSONWriter::Real(double d)
+{
+    BeginValue();
+    strOut += strprintf("%.8f", d);
+}
+
+void CJSONWriter::Amount(const CAmount& amount)
+{
+    BeginValue();
+    int64_t n_abs = (amount > 0 ? amount : -amount);
+    strOut += strprintf("%s%d.%08d", amount < 0 ? "-" : "", n_abs / COIN, n_abs % COIN);
+}
+
+void CJSONWriter::Raw(const std::string& strJSON)
+{
+    BeginValue();
+    strOut += strJSON;
+}
+
+void CJSONWriter::Write(const UniValue& val)
+{
+    Raw(val.write());
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONWRITER_H
+#define BITCOIN_JSONWRITER_H
+
+#include "amount.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/**
+ * Streaming JSON writer. Every value is appended to the output string as it
+ * is written, so large RPC and REST responses are produced without building
+ * a json_spirit or UniValue tree first. Strings are escaped and numbers are
+ * formatted like the json_spirit writer used by the RPC server, so the output
+ * is the same as the tree-based one. Values inserted with Write() keep
+ * UniValue's formatting, which also escapes '/'.
+ */
+class CJSONWriter
+{
+public:
+    explicit CJSONWriter(std::string& strOutIn) : strOut(strOutIn), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write the key of the next object member */
+    CJSONWriter& Key(const std::string& strKey);
+
+    void String(const std::string& str);
+    void Int(int64_t n);
+    void Bool(bool f);
+    void Null();
+    void Real(double d);
+    /** Amounts are written as coins with 8 decimals, exactly like ValueFromAmount() */
+    void Amount(const CAmount& amount);
+    /** Insert an already serialized JSON value */
+    void Raw(const std::string& strJSON);
+    void Write(const UniValue& val);
+
+    /** Whether all objects and arrays have been closed */
+    bool IsComplete() const { return vNeedComma.empty() && !fAfterKey; }
+
+private:
+    std::string& strOut;
+    // one entry per open object or array: whether the next element needs a separator
+    std::vector<bool> vNeedComma;
+    bool fAfterKey;
+
+    void BeginValue();
+    void WriteEscaped(const std::string& str);
+};
+
+#endif // BITCOIN_JSONWRITER_H
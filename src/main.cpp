@@ -23,6 +23,7 @@
 #include "net.h"
 #include "obfuscation.h"
 #include "pow.h"
+#include "recorddb.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
@@ -30,6 +31,7 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "validationinterface.h"
 
 #include "libzerocoin/Denominations.h"
 #include "primitives/zerocoin.h"
@@ -73,6 +75,9 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
+bool fZerocoinIndex = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
@@ -185,72 +190,6 @@ set<CBlockIndex*> setDirtyBlockIndex;
 set<int> setDirtyFileInfo;
 } // namespace
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// dispatching functions
-//
-
-// These functions dispatch to one or all registered wallets
-
-namespace
-{
-struct CMainSignals {
-    /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
-    boost::signals2::signal<void(const CTransaction&, const CBlock*)> SyncTransaction;
-    /** Notifies listeners of an erased transaction (currently disabled, requires transaction replacement). */
-    // XX42    boost::signals2::signal<void(const uint256&)> EraseTransaction;
-    /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
-    boost::signals2::signal<void(const uint256&)> UpdatedTransaction;
-    /** Notifies listeners of a new active block chain. */
-    boost::signals2::signal<void(const CBlockLocator&)> SetBestChain;
-    /** Notifies listeners about an inventory item being seen on the network. */
-    boost::signals2::signal<void(const uint256&)> Inventory;
-    /** Tells listeners to broadcast their data. */
-    boost::signals2::signal<void()> Broadcast;
-    /** Notifies listeners of a block validation result */
-    boost::signals2::signal<void(const CBlock&, const CValidationState&)> BlockChecked;
-} g_signals;
-
-} // namespace
-
-void RegisterValidationInterface(CValidationInterface* pwalletIn)
-{
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    // XX42 g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn));
-    g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-}
-
-void UnregisterValidationInterface(CValidationInterface* pwalletIn)
-{
-    g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn));
-    g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    // XX42    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-}
-
-void UnregisterAllValidationInterfaces()
-{
-    g_signals.BlockChecked.disconnect_all_slots();
-    g_signals.Broadcast.disconnect_all_slots();
-    g_signals.Inventory.disconnect_all_slots();
-    g_signals.SetBestChain.disconnect_all_slots();
-    g_signals.UpdatedTransaction.disconnect_all_slots();
-    // XX42    g_signals.EraseTransaction.disconnect_all_slots();
-    g_signals.SyncTransaction.disconnect_all_slots();
-}
-
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock)
-{
-    g_signals.SyncTransaction(tx, pblock);
-}
-
 //////////////////////////////////////////////////////////////////////////////
 //
 // Registration of network node signals.
@@ -902,10 +841,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if (nResult < 0) nResult = 0;
 
     if (nResult < 6) {
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()) {
-            sigs = (*i).second.CountSignatures();
-        }
+        sigs = CountTransactionLockSignatures(nTXHash);
         if (sigs >= INSTANTTX_SIGNATURES_REQUIRED) {
             return nInstantTXDepth + nResult;
         }
@@ -916,12 +852,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 
 int GetIXConfirmations(uint256 nTXHash)
 {
-    int sigs = 0;
-
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
-    }
+    int sigs = CountTransactionLockSignatures(nTXHash);
     if (sigs >= INSTANTTX_SIGNATURES_REQUIRED) {
         return nInstantTXDepth;
     }
@@ -990,8 +921,66 @@ int GetZerocoinStartHeight()
     return Params().Zerocoin_StartHeight();
 }
 
+/**
+ * Whether a zerocoin index entry belongs to the active chain, the index may be left behind by a crash or an older version.
+ * With -txindex this is one lookup; without it the block at the entry's height is read, so block validation only
+ * relies on the index when fTxIndex is set.
+ */
+static bool IsZerocoinIndexValueInChain(const CZerocoinIndexValue& value)
+{
+    CBlockIndex* pindex = chainActive[value.nHeight];
+    if (!pindex)
+        return false;
+
+    if (fTxIndex) {
+        CDiskTxPos postx;
+        return pblocktree->ReadTxIndex(value.txid, postx) && postx.nFile == pindex->nFile && postx.nPos == pindex->nDataPos;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return false;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.GetHash() == value.txid)
+            return true;
+    }
+    return false;
+}
+
 void FindMints(vector<CZerocoinMint> vMintsToFind, vector<CZerocoinMint>& vMintsToUpdate, vector<CZerocoinMint>& vMissingMints, bool fExtendedSearch)
 {
+    if (fZerocoinIndex) {
+        // the zerocoin index knows the height of every confirmed mint and spend
+        for (CZerocoinMint mint : vMintsToFind) {
+            CZerocoinIndexValue mintInfo;
+            if (!zerocoinDB->ReadMintIndex(mint.GetValue(), mintInfo) || !IsZerocoinIndexValueInChain(mintInfo)) {
+                vMissingMints.push_back(mint);
+                continue;
+            }
+
+            CZerocoinIndexValue spendInfo;
+            bool fSpent = zerocoinDB->ReadSpendIndex(mint.GetSerialNumber(), spendInfo) && IsZerocoinIndexValueInChain(spendInfo);
+
+            //a serial that is known but not confirmed is not spent
+            uint256 hashTxSpend = 0;
+            if (!fSpent && zerocoinDB->ReadCoinSpend(mint.GetSerialNumber(), hashTxSpend)) {
+                LogPrintf("%s : spend tx %s is not in the chain. Erasing coinspend from zerocoinDB.\n", __func__, hashTxSpend.GetHex());
+                zerocoinDB->EraseCoinSpend(mint.GetSerialNumber());
+            }
+
+            if (mint.GetTxHash() == mintInfo.txid && mint.GetHeight() == mintInfo.nHeight && mint.IsUsed() == fSpent)
+                continue;
+
+            mint.SetTxHash(mintInfo.txid);
+            mint.SetHeight(mintInfo.nHeight);
+            mint.SetUsed(fSpent);
+            vMintsToUpdate.push_back(mint);
+        }
+
+        // mints that are not in the index are not in the chain, an extended search would not find them
+        return;
+    }
+
     // see which mints are in our public zerocoin database. The mint should be here if it exists, unless
     // something went wrong
     for (CZerocoinMint mint : vMintsToFind) {
@@ -1110,6 +1099,14 @@ bool IsSerialKnown(const CBigNum& bnSerial)
 
 bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx)
 {
+    // the index answers for spends it has in the active chain, anything else is looked up as before.
+    // Without -txindex checking an index entry reads a whole block, no cheaper than the lookup below.
+    CZerocoinIndexValue spendInfo;
+    if (fZerocoinIndex && fTxIndex && zerocoinDB->ReadSpendIndex(bnSerial, spendInfo) && IsZerocoinIndexValueInChain(spendInfo)) {
+        nHeightTx = spendInfo.nHeight;
+        return true;
+    }
+
     uint256 txHash = 0;
     // if not in zerocoinDB then its not in the blockchain
     if (!zerocoinDB->ReadCoinSpend(bnSerial, txHash))
@@ -1132,6 +1129,78 @@ bool RemoveSerialFromDB(const CBigNum& bnSerial)
     return zerocoinDB->EraseCoinSpend(bnSerial);
 }
 
+bool BuildZerocoinIndex(std::string& strError)
+{
+    bool fBuilt = false;
+    if (zerocoinDB->ReadFlag("zerocoinindex", fBuilt) && fBuilt) {
+        fZerocoinIndex = true;
+        return true;
+    }
+
+    // a reindex connects every block again, which writes the index as it goes
+    if (fReindex || chainActive.Height() < Params().Zerocoin_StartHeight()) {
+        fZerocoinIndex = zerocoinDB->WriteFlag("zerocoinindex", true);
+        return true;
+    }
+
+    LogPrintf("%s : indexing zerocoin mints and spends from block %d\n", __func__, Params().Zerocoin_StartHeight());
+    std::vector<std::pair<CBigNum, CZerocoinIndexValue> > vMints;
+    std::vector<std::pair<CBigNum, CZerocoinIndexValue> > vSpends;
+    CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
+    while (pindex) {
+        // the index is built again from the start on the next run
+        if (ShutdownRequested())
+            return true;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            strError = strprintf("Failed to read block %d while building the zerocoin index", pindex->nHeight);
+            return false;
+        }
+
+        for (const CTransaction& tx : block.vtx) {
+            if (!tx.ContainsZerocoins())
+                continue;
+
+            for (const CTxIn& txin : tx.vin) {
+                if (!txin.scriptSig.IsZerocoinSpend())
+                    continue;
+                CoinSpend spend = TxInToZerocoinSpend(txin);
+                vSpends.push_back(make_pair(spend.getCoinSerialNumber(), CZerocoinIndexValue(tx.GetHash(), pindex->nHeight, spend.getDenomination())));
+            }
+
+            for (const CTxOut& txout : tx.vout) {
+                if (txout.scriptPubKey.empty() || !txout.scriptPubKey.IsZerocoinMint())
+                    continue;
+                PublicCoin pubCoin(Params().Zerocoin_Params());
+                CValidationState state;
+                if (!TxOutToPublicCoin(txout, pubCoin, state)) {
+                    strError = strprintf("Failed to read zerocoin mint in block %d", pindex->nHeight);
+                    return false;
+                }
+                vMints.push_back(make_pair(pubCoin.getValue(), CZerocoinIndexValue(tx.GetHash(), pindex->nHeight, pubCoin.getDenomination())));
+            }
+        }
+
+        // write in batches so a full chain does not have to be held in memory
+        if (vMints.size() + vSpends.size() >= 1000 || pindex == chainActive.Tip()) {
+            if (!zerocoinDB->WriteZerocoinIndex(vMints, vSpends)) {
+                strError = "Failed to write the zerocoin index";
+                return false;
+            }
+            vMints.clear();
+            vSpends.clear();
+        }
+
+        if (pindex->nHeight % 10000 == 0)
+            LogPrintf("%s : indexed up to block %d\n", __func__, pindex->nHeight);
+        pindex = chainActive.Next(pindex);
+    }
+
+    fZerocoinIndex = zerocoinDB->WriteFlag("zerocoinindex", true);
+    return true;
+}
+
 /** zerocoin transaction checks */
 bool RecordMintToDB(PublicCoin publicZerocoin, const uint256& txHash)
 {
@@ -1586,7 +1655,53 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+/** Expire old transactions and evict the cheapest ones until the pool fits in limit bytes */
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
+/**
+ * What the checks of a loose transaction under cs_main hand on to the checks of
+ * its input scripts and to its insertion into the pool
+ */
+struct CTxMemPoolAcceptance {
+    CCoinsView dummy;
+    CCoinsViewCache view; //! the coins it spends, detached from the chain and the pool
+    CTxMemPoolEntry entry;
+    CTxMemPool::setEntries setAncestors;
+    uint256 hashTip; //! chain tip the checks ran against
+
+    CTxMemPoolAcceptance() : view(&dummy) {}
+};
+
+/** Find the in-pool ancestors of the entry, failing if they break the package limits */
+static bool CalculateAcceptedAncestors(CTxMemPool& pool, CValidationState& state, CTxMemPoolAcceptance& accept)
+{
+    size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    std::string errString;
+    accept.setAncestors.clear();
+    if (!pool.CalculateMemPoolAncestors(accept.entry, accept.setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+        return state.DoS(0, error("AcceptToMemoryPool : too-long-mempool-chain %s, %s", accept.entry.GetTx().GetHash().ToString(), errString),
+            REJECT_NONSTANDARD, "too-long-mempool-chain");
+    }
+    return true;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, GetTime(), fLimitFree, pfMissingInputs, fRejectInsaneFee, ignoreFees);
+}
+
+/** Everything AcceptToMemoryPool checks except the input scripts, requires cs_main */
+static bool AcceptToMemoryPoolPreChecks(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, int64_t nAcceptTime, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, CTxMemPoolAcceptance& accept)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1620,14 +1735,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
     // ----------- InstantTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLock;
+    if (GetConflictingTransactionLock(tx, hashLock)) {
+        return state.DoS(0,
+            error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1644,8 +1756,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
 
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+        CCoinsView& dummy = accept.dummy;
+        CCoinsViewCache& view = accept.view;
 
         CAmount nValueIn = 0;
         if (tx.IsZerocoinSpend()) {
@@ -1737,10 +1849,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = 0;
         if (!tx.IsZerocoinSpend())
-            view.GetPriority(tx, chainActive.Height());
+            dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
-        unsigned int nSize = entry.GetTxSize();
+        accept.entry = CTxMemPoolEntry(tx, nFees, nAcceptTime, dPriority, chainActive.Height());
+        unsigned int nSize = accept.entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
         // but prioritise dstx and don't check fees for it
@@ -1752,6 +1864,12 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 return state.DoS(0, error("AcceptToMemoryPool : not enough fees %s, %d < %d", hash.ToString(), nFees, txMinFee),
                     REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // the minimum rises while the pool is full and evicting
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee && !tx.IsZerocoinSpend())
+                return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d", hash.ToString(), nFees, mempoolRejectFee),
+                    REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (tx.IsZerocoinMint()) {
                 if (nFees < Params().Zerocoin_MintFee() * tx.GetZerocoinMintCount())
@@ -1789,34 +1907,139 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 hash.ToString(),
                 nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        // Calculate in-mempool ancestors, up to a limit.
+        if (!CalculateAcceptedAncestors(pool, state, accept))
+            return false;
+
+        // The inexpensive part of CheckInputs, the scripts follow in AcceptToMemoryPoolScriptChecks
+        if (!CheckInputs(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, true))
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
-        }
+    }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
-            return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
-        }
+    accept.hashTip = chainActive.Tip()->GetBlockHash();
+    return true;
+}
 
-        // Store transaction in memory
-        pool.addUnchecked(hash, entry);
+/** The input scripts of a transaction that passed AcceptToMemoryPoolPreChecks, needs no lock */
+static bool AcceptToMemoryPoolScriptChecks(CValidationState& state, const CTransaction& tx, const CCoinsViewCache& view)
+{
+    if (tx.IsZerocoinSpend())
+        return true;
+
+    // Check against previous transactions
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    if (!CheckInputScripts(tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        return error("AcceptToMemoryPool: : ConnectInputs failed %s", tx.GetHash().ToString());
     }
 
+    // Check again against just the consensus-critical mandatory script
+    // verification flags, in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    if (!CheckInputScripts(tx, state, view, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+        return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", tx.GetHash().ToString());
+    }
+
+    return true;
+}
+
+/** Store a transaction that passed all checks in the pool, requires cs_main */
+static bool AcceptToMemoryPoolFinish(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, const CTxMemPoolAcceptance& accept)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = tx.GetHash();
+
+    // Store transaction in memory
+    pool.addUnchecked(hash, accept.entry, accept.setAncestors);
+
+    // trim the pool and make sure the new transaction made the cut
+    LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    if (!pool.exists(hash))
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+
     SyncWithWallets(tx, NULL);
 
     return true;
 }
 
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, int64_t nAcceptTime, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+{
+    AssertLockHeld(cs_main);
+    CTxMemPoolAcceptance accept;
+    if (!AcceptToMemoryPoolPreChecks(pool, state, tx, nAcceptTime, fLimitFree, pfMissingInputs, fRejectInsaneFee, ignoreFees, accept))
+        return false;
+    if (!AcceptToMemoryPoolScriptChecks(state, tx, accept.view))
+        return false;
+    return AcceptToMemoryPoolFinish(pool, state, tx, accept);
+}
+
+/**
+ * AcceptToMemoryPool for a transaction relayed by a peer, called without cs_main.
+ * cs_main is held to check the transaction against the chain and the pool and take
+ * a snapshot of the coins it spends, and again to check for conflicts and insert
+ * it. The input scripts are checked against the snapshot in between with no lock
+ * held, so the message handler threads verify independent transactions concurrently.
+ */
+static bool AcceptToMemoryPoolConcurrent(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool ignoreFees)
+{
+    CTxMemPoolAcceptance accept;
+    {
+        LOCK(cs_main);
+        if (!AcceptToMemoryPoolPreChecks(pool, state, tx, GetTime(), fLimitFree, pfMissingInputs, false, ignoreFees, accept))
+            return false;
+    }
+
+    if (!AcceptToMemoryPoolScriptChecks(state, tx, accept.view))
+        return false;
+
+    LOCK(cs_main);
+
+    // An outpoint commits to the script it pays to, so the scripts stay valid for
+    // as long as the same outpoints can be spent. A new tip may have changed
+    // everything else, so then the other checks run again against it.
+    if (chainActive.Tip()->GetBlockHash() != accept.hashTip) {
+        CTxMemPoolAcceptance acceptTip;
+        if (!AcceptToMemoryPoolPreChecks(pool, state, tx, GetTime(), fLimitFree, pfMissingInputs, false, ignoreFees, acceptTip))
+            return false;
+        return AcceptToMemoryPoolFinish(pool, state, tx, acceptTip);
+    }
+
+    // On the same tip only the pool and the transaction locks can have changed
+    uint256 hash = tx.GetHash();
+    if (pool.exists(hash))
+        return false;
+
+    uint256 hashLock;
+    if (GetConflictingTransactionLock(tx, hashLock))
+        return state.DoS(0, error("AcceptToMemoryPool : conflicts with existing transaction lock"),
+            REJECT_INVALID, "tx-lock-conflict");
+
+    if (!tx.IsZerocoinSpend()) {
+        LOCK(pool.cs);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            if (pool.mapNextTx.count(tx.vin[i].prevout))
+                return false;
+        }
+
+        // a parent in the pool may have been evicted or expired meanwhile
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        if (!view.HaveInputs(tx))
+            return state.Invalid(error("AcceptToMemoryPool : inputs already spent"),
+                REJECT_DUPLICATE, "bad-txns-inputs-spent");
+    }
+
+    if (!CalculateAcceptedAncestors(pool, state, accept))
+        return false;
+
+    return AcceptToMemoryPoolFinish(pool, state, tx, accept);
+}
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool isDSTX)
 {
     AssertLockHeld(cs_main);
@@ -1846,14 +2069,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
     // ----------- InstantTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLock;
+    if (GetConflictingTransactionLock(tx, hashLock)) {
+        return state.DoS(0,
+            error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1985,6 +2205,18 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
                 hash.ToString(),
                 nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Calculate in-mempool ancestors, up to a limit.
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+        std::string errString;
+        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+            return state.DoS(0, error("AcceptToMemoryPool : too-long-mempool-chain %s, %s", hash.ToString(), errString),
+                REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!CheckInputs(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
@@ -2015,10 +2247,274 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+/** mempool.dat, the transactions of the memory pool with their entry times and prioritisation */
+class CMempoolDB : public CRecordDB
+{
+public:
+    enum RecordType {
+        RECORD_TX = 1,
+        RECORD_DELTA
+    };
+
+    CMempoolDB() : CRecordDB("mempool.dat", "MempoolRecords") {}
+
+    bool Write(const CTxMemPool& pool)
+    {
+        CRecordBatch batch;
+        {
+            LOCK(pool.cs);
+            for (CTxMemPool::indexed_transaction_set::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it)
+                batch.Write(RECORD_TX, it->GetTx().GetHash(), std::make_pair(it->GetTx(), it->GetTime()));
+            batch.WriteMap(RECORD_DELTA, pool.mapDeltas);
+        }
+        return WriteRecords(batch);
+    }
+
+    ReadResult Read(std::vector<std::pair<CTransaction, int64_t> >& vTxs, std::map<uint256, std::pair<double, CAmount> >& mapDeltas)
+    {
+        return ReadRecords([&vTxs, &mapDeltas](unsigned char nRecordType, const uint256& key, CDataStream& ssValue) {
+            switch (nRecordType) {
+            case RECORD_TX: {
+                std::pair<CTransaction, int64_t> txRead;
+                ssValue >> txRead;
+                vTxs.push_back(txRead);
+                break;
+            }
+            case RECORD_DELTA:
+                ReadMapRecord(ssValue, mapDeltas, key);
+                break;
+            }
+        });
+    }
+};
+
+static CMempoolDB mempoolDB;
+// set once the saved pool was read back, a pool that is still loading is not dumped
+static bool fMempoolLoaded = false;
+
+bool LoadMempool()
+{
+    int64_t nStart = GetTimeMillis();
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+
+    std::vector<std::pair<CTransaction, int64_t> > vTxs;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    CRecordDB::ReadResult result = mempoolDB.Read(vTxs, mapDeltas);
+    if (result != CRecordDB::Ok) {
+        // missing on first start and after -persistmempool=0
+        LogPrint("mempool", "%s : no saved mempool to load (%d)\n", __func__, result);
+        fMempoolLoaded = true;
+        return false;
+    }
+
+    for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); ++it)
+        mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+
+    // records come back in no particular order, parents mostly entered the pool first
+    std::sort(vTxs.begin(), vTxs.end(), [](const std::pair<CTransaction, int64_t>& a, const std::pair<CTransaction, int64_t>& b) {
+        return a.second < b.second;
+    });
+
+    int nAccepted = 0;
+    int nFailed = 0;
+    int nExpired = 0;
+    while (!vTxs.empty()) {
+        // transactions whose parent came later in the same second get another pass
+        std::vector<std::pair<CTransaction, int64_t> > vMissingInputs;
+        BOOST_FOREACH (const PAIRTYPE(CTransaction, int64_t) & item, vTxs) {
+            if (item.second + nExpiryTimeout < GetTime()) {
+                nExpired++;
+                continue;
+            }
+
+            CValidationState state;
+            bool fMissingInputs = false;
+            {
+                LOCK(cs_main);
+                if (AcceptToMemoryPoolWithTime(mempool, state, item.first, item.second, true, &fMissingInputs))
+                    nAccepted++;
+                else if (fMissingInputs)
+                    vMissingInputs.push_back(item);
+                else
+                    nFailed++;
+            }
+
+            if (ShutdownRequested())
+                return false;
+        }
+
+        if (vMissingInputs.size() == vTxs.size()) {
+            nFailed += vMissingInputs.size();
+            break;
+        }
+        vTxs.swap(vMissingInputs);
+    }
+
+    fMempoolLoaded = true;
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired  %dms\n", nAccepted, nFailed, nExpired, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool DumpMempool()
+{
+    if (!fMempoolLoaded)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    if (!mempoolDB.Write(mempool))
+        return error("%s : failed to write mempool.dat", __func__);
+
+    LogPrint("mempool", "Dumped mempool: %dms\n", GetTimeMillis() - nStart);
+    return true;
+}
+
+bool GetScriptAddressIndexKey(const CScript& scriptPubKey, int& nType, uint160& hashBytes)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+
+    // Pay-to-pubkey outputs, like most stake rewards, are indexed under the key's address
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        nType = ADDRESS_TYPE_PUBKEYHASH;
+        hashBytes = *keyID;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        nType = ADDRESS_TYPE_SCRIPTHASH;
+        hashBytes = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("%s: address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("%s: unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s: address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s: unable to get txids for address", __func__);
+
+    return true;
+}
+
+void AddConnectedTxIndexUpdates(const CTransaction& tx, unsigned int nTx, int nHeight, const CCoinsViewCache& view, CAddressIndexUpdates& updates)
+{
+    const uint256& txhash = tx.GetHash();
+    if ((fAddressIndex || fSpentIndex) && !tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const CTxOut& prevTxOut = view.GetOutputFor(tx.vin[j]);
+            int nType = ADDRESS_TYPE_NONE;
+            uint160 hashBytes;
+            bool fHasAddress = GetScriptAddressIndexKey(prevTxOut.scriptPubKey, nType, hashBytes);
+
+            if (fAddressIndex && fHasAddress) {
+                // record spending activity and remove the output from the unspent index
+                updates.addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, nHeight, nTx, txhash, j, true), prevTxOut.nValue * -1));
+                updates.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+            }
+            if (fSpentIndex)
+                updates.spentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n),
+                    CSpentIndexValue(txhash, j, nHeight, prevTxOut.nValue, nType, hashBytes)));
+        }
+    }
+
+    if (fAddressIndex) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            int nType;
+            uint160 hashBytes;
+            if (!GetScriptAddressIndexKey(out.scriptPubKey, nType, hashBytes))
+                continue;
+
+            // record receiving activity and the new unspent output
+            updates.addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, nHeight, nTx, txhash, k, false), out.nValue));
+            updates.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
+    }
+}
+
+void AddDisconnectedTxIndexUpdates(const CTransaction& tx, unsigned int nTx, int nHeight, const CCoinsViewCache& view, CAddressIndexUpdates& updates)
+{
+    const uint256& txhash = tx.GetHash();
+    if (fAddressIndex) {
+        for (unsigned int k = tx.vout.size(); k-- > 0;) {
+            const CTxOut& out = tx.vout[k];
+            int nType;
+            uint160 hashBytes;
+            if (!GetScriptAddressIndexKey(out.scriptPubKey, nType, hashBytes))
+                continue;
+
+            // undo receiving activity and the unspent output
+            updates.addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, nHeight, nTx, txhash, k, false), out.nValue));
+            updates.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue()));
+        }
+    }
+
+    if ((fAddressIndex || fSpentIndex) && !tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+        for (unsigned int j = tx.vin.size(); j-- > 0;) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const CCoins* coins = view.AccessCoins(prevout.hash);
+            if (!coins || !coins->IsAvailable(prevout.n))
+                continue;
+            const CTxOut& prevTxOut = coins->vout[prevout.n];
+            int nType = ADDRESS_TYPE_NONE;
+            uint160 hashBytes;
+            bool fHasAddress = GetScriptAddressIndexKey(prevTxOut.scriptPubKey, nType, hashBytes);
+
+            if (fAddressIndex && fHasAddress) {
+                // undo spending activity and make the output unspent again
+                updates.addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, nHeight, nTx, txhash, j, true), prevTxOut.nValue * -1));
+                updates.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n),
+                    CAddressUnspentValue(prevTxOut.nValue, prevTxOut.scriptPubKey, coins->nHeight)));
+            }
+            if (fSpentIndex)
+                updates.spentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue()));
+        }
+    }
+}
+
+bool WriteAddressIndexUpdates(const CAddressIndexUpdates& updates, bool fErase)
+{
+    if (fAddressIndex) {
+        if (!(fErase ? pblocktree->EraseAddressIndex(updates.addressIndex) : pblocktree->WriteAddressIndex(updates.addressIndex)))
+            return false;
+        // erasing and restoring unspent outputs are both updates, in the order collected
+        if (!pblocktree->UpdateAddressUnspentIndex(updates.addressUnspentIndex))
+            return false;
+    }
+    if (fSpentIndex && !pblocktree->UpdateSpentIndex(updates.spentIndex))
+        return false;
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
     CBlockIndex* pindexSlow = NULL;
+    CDiskTxPos postx;
+    bool fFoundInIndex = false;
     {
         LOCK(cs_main);
         {
@@ -2028,30 +2524,11 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
             // transaction not found in the index, nothing more can be done
-            return false;
-        }
-
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            if (!pblocktree->ReadTxIndex(hash, postx))
+                return false;
+            fFoundInIndex = true;
+        } else if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -2064,6 +2541,25 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
     }
 
+    // Block files are only appended to, so the transaction is read without holding cs_main
+    if (fFoundInIndex) {
+        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: OpenBlockFile failed", __func__);
+        CBlockHeader header;
+        try {
+            file >> header;
+            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+            file >> txOut;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        hashBlock = header.GetHash();
+        if (txOut.GetHash() != hash)
+            return error("%s : txid mismatch", __func__);
+        return true;
+    }
+
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
@@ -2112,34 +2608,83 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     block.SetNull();
 
     // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadBlockFromDisk : OpenBlockFile failed");
+
+    // Read block
+    try {
+        filein >> block;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    // Check the header
+    if (block.IsProofOfWork()) {
+        if (!CheckProofOfWork(block.GetHash(), block.nBits))
+            return error("ReadBlockFromDisk : Errors in block header");
+    }
+
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+{
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
+        return false;
+    if (block.GetHash() != pindex->GetBlockHash()) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CDiskBlockPos& pos)
+{
+    vchBlock.clear();
+
+    // The block is preceded by the network magic and its size
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid block position %d:%u", __func__, pos.nFile, pos.nPos);
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int));
+
+    // Open history file to read
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+        return error("ReadRawBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
     try {
-        filein >> block;
+        unsigned char pchMessageStart[MESSAGE_START_SIZE];
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s : block magic mismatch at %d:%u", __func__, pos.nFile, pos.nPos);
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : invalid block size %u at %d:%u", __func__, nSize, pos.nFile, pos.nPos);
+        vchBlock.resize(nSize);
+        filein.read(&vchBlock[0], nSize);
     } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-    }
-
-    // Check the header
-    if (block.IsProofOfWork()) {
-        if (!CheckProofOfWork(block.GetHash(), block.nBits))
-            return error("ReadBlockFromDisk : Errors in block header");
+        return error("%s : I/O error - %s", __func__, e.what());
     }
 
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CBlockIndex* pindex)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos()))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash()) {
-        LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
+
+    // Only the header is deserialized to check that the bytes belong to the indexed block
+    CBlockHeader header;
+    try {
+        CDataStream ssHeader(&vchBlock[0], &vchBlock[0] + std::min(vchBlock.size(), sizeof(CBlockHeader)), SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
     }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CSerializeData&, CBlockIndex*) : GetHash() doesn't match index");
     return true;
 }
 
@@ -2381,20 +2926,41 @@ void static InvalidBlockFound(CBlockIndex* pindex, const CValidationState& state
     }
 }
 
-void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight)
+void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight, CCoinsStats* pstats)
 {
     // mark inputs spent
     if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
+            bool ret = coins->Spend(txin.prevout, txundo.vprevout.back());
             assert(ret);
+            if (pstats) {
+                pstats->UpdateOutput(txin.prevout, txundo.vprevout.back().txout, false);
+                if (coins->IsPruned())
+                    pstats->nTransactions--;
+            }
         }
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    const uint256& hash = tx.GetHash();
+    CCoinsModifier outs = inputs.ModifyCoins(hash);
+    if (pstats && !outs->IsPruned()) {
+        // a duplicate coinbase overwrites the unspent outputs of its earlier copy
+        for (unsigned int i = 0; i < outs->vout.size(); i++)
+            if (!outs->vout[i].IsNull())
+                pstats->UpdateOutput(COutPoint(hash, i), outs->vout[i], false);
+        pstats->nTransactions--;
+    }
+    outs->FromTx(tx, nHeight);
+    if (pstats && !outs->IsPruned()) {
+        for (unsigned int i = 0; i < outs->vout.size(); i++)
+            if (!outs->vout[i].IsNull())
+                pstats->UpdateOutput(COutPoint(hash, i), outs->vout[i], true);
+        pstats->nTransactions++;
+    }
 }
 
 bool CScriptCheck::operator()()
@@ -2573,6 +3139,45 @@ CAmount GetInvalidUTXOValue()
     return nValue;
 }
 
+bool CheckInputScripts(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+{
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const COutPoint& prevout = tx.vin[i].prevout;
+        const CCoins* coins = inputs.AccessCoins(prevout.hash);
+        assert(coins);
+
+        // Verify signature
+        CScriptCheck check(*coins, tx, i, flags, cacheStore);
+        if (pvChecks) {
+            pvChecks->push_back(CScriptCheck());
+            check.swap(pvChecks->back());
+        } else if (!check()) {
+            if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+                // Check whether the failure was caused by a
+                // non-mandatory script verification check, such as
+                // non-standard DER encodings or non-null dummy
+                // arguments; if so, don't trigger DoS protection to
+                // avoid splitting the network between upgraded and
+                // non-upgraded nodes.
+                CScriptCheck check(*coins, tx, i,
+                    flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                if (check())
+                    return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+            }
+            // Failures of other flags indicate a transaction that is
+            // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+            // such nodes as they are not following the protocol. That
+            // said during an upgrade careful thought should be taken
+            // as to the correct behavior - we may want to continue
+            // peering with non-upgraded nodes even after a soft-fork
+            // super-majority vote has passed.
+            return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+        }
+    }
+
+    return true;
+}
+
 bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
 {
     if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
@@ -2632,41 +3237,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // Skip ECDSA signature verification when connecting blocks
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
-        if (fScriptChecks) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                const COutPoint& prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
-
-                // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
-                if (pvChecks) {
-                    pvChecks->push_back(CScriptCheck());
-                    check.swap(pvChecks->back());
-                } else if (!check()) {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
-                        if (check())
-                            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after a soft-fork
-                    // super-majority vote has passed.
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
-                }
-            }
-        }
+        if (fScriptChecks)
+            return CheckInputScripts(tx, state, inputs, flags, cacheStore, pvChecks);
     }
 
     return true;
@@ -2683,6 +3255,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     bool fClean = true;
 
+    // Index entries to remove; not touched while VerifyDB disconnects blocks on a scratch view
+    bool fUpdateIndexes = !fVerifyingBlocks;
+    CAddressIndexUpdates addressIndexUpdates;
+    std::vector<std::pair<CBigNum, CZerocoinIndexValue> > vZerocoinMints;
+    std::vector<std::pair<CBigNum, CZerocoinIndexValue> > vZerocoinSpends;
+
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull())
@@ -2709,6 +3287,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                         CoinSpend spend = TxInToZerocoinSpend(txin);
                         if (!zerocoinDB->EraseCoinSpend(spend.getCoinSerialNumber()))
                             return error("failed to erase spent zerocoin in block");
+                        if (fUpdateIndexes)
+                            vZerocoinSpends.push_back(make_pair(spend.getCoinSerialNumber(), CZerocoinIndexValue(tx.GetHash(), pindex->nHeight, spend.getDenomination())));
                     }
                 }
             }
@@ -2724,6 +3304,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
                     if (!zerocoinDB->EraseCoinMint(pubCoin.getValue()))
                         return error("DisconnectBlock(): Failed to erase coin mint");
+                    if (fUpdateIndexes)
+                        vZerocoinMints.push_back(make_pair(pubCoin.getValue(), CZerocoinIndexValue(tx.GetHash(), pindex->nHeight, pubCoin.getDenomination())));
                 }
             }
         }
@@ -2780,8 +3362,18 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 coins->vout[out.n] = undo.txout;
             }
         }
+
+        if (fUpdateIndexes)
+            AddDisconnectedTxIndexUpdates(tx, i, pindex->nHeight, view, addressIndexUpdates);
     }
 
+    if (fUpdateIndexes && !WriteAddressIndexUpdates(addressIndexUpdates, true))
+        return state.Abort("Failed to delete address or spent index");
+
+    if (fUpdateIndexes && (!vZerocoinMints.empty() || !vZerocoinSpends.empty()))
+        if (!zerocoinDB->EraseZerocoinIndex(vZerocoinMints, vZerocoinSpends))
+            return state.Abort("Failed to delete zerocoin index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2910,6 +3502,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == Params().HashGenesisBlock()) {
+        if (!fJustCheck) {
+            CCoinsStats stats;
+            stats.hashBlock = pindex->GetBlockHash();
+            if (!pblocktree->WriteUTXOStats(stats))
+                return state.Abort("Failed to write UTXO set statistics");
+        }
         view.SetBestBlock(pindex->GetBlockHash());
         return true;
     }
@@ -2970,6 +3568,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    CAddressIndexUpdates addressIndexUpdates;
+    std::vector<std::pair<CBigNum, CZerocoinIndexValue> > vZerocoinMints;
+    std::vector<std::pair<CBigNum, CZerocoinIndexValue> > vZerocoinSpends;
+    // Index entries are only collected for blocks that are really connected, see DisconnectBlock
+    bool fUpdateIndexes = !fJustCheck && !fVerifyingBlocks;
+    // The UTXO set statistics are carried forward from the parent when it has them, see gettxoutsetinfo
+    CCoinsStats utxoStats;
+    bool fUpdateStats = fUpdateIndexes && pblocktree->ReadUTXOStats(hashPrevBlock, utxoStats);
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
@@ -3022,6 +3628,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 //record spend to database
                 if (!zerocoinDB->WriteCoinSpend(spend.getCoinSerialNumber(), tx.GetHash()))
                     return error("%s : failed to record coin serial to database");
+                if (fUpdateIndexes)
+                    vZerocoinSpends.push_back(make_pair(spend.getCoinSerialNumber(), CZerocoinIndexValue(tx.GetHash(), pindex->nHeight, spend.getDenomination())));
             }
         } else if (!tx.IsCoinBase()) {
             if (!view.HaveInputs(tx))
@@ -3056,11 +3664,26 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         nValueOut += tx.GetValueOut();
 
+        if (fUpdateIndexes)
+            AddConnectedTxIndexUpdates(tx, i, pindex->nHeight, view, addressIndexUpdates);
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
-        UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, fUpdateStats ? &utxoStats : NULL);
+
+        if (fUpdateIndexes && tx.IsZerocoinMint()) {
+            for (const CTxOut& txout : tx.vout) {
+                if (txout.scriptPubKey.empty() || !txout.scriptPubKey.IsZerocoinMint())
+                    continue;
+
+                PublicCoin pubCoin(Params().Zerocoin_Params());
+                if (!TxOutToPublicCoin(txout, pubCoin, state))
+                    return error("ConnectBlock() : TxOutToPublicCoin() failed");
+                vZerocoinMints.push_back(make_pair(pubCoin.getValue(), CZerocoinIndexValue(tx.GetHash(), pindex->nHeight, pubCoin.getDenomination())));
+            }
+        }
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
@@ -3205,6 +3828,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fUpdateIndexes && !WriteAddressIndexUpdates(addressIndexUpdates, false))
+        return state.Abort("Failed to write address or spent index");
+
+    if (fUpdateIndexes && (!vZerocoinMints.empty() || !vZerocoinSpends.empty()))
+        if (!zerocoinDB->WriteZerocoinIndex(vZerocoinMints, vZerocoinSpends))
+            return state.Abort("Failed to write zerocoin index");
+
+    if (fUpdateStats) {
+        utxoStats.nHeight = pindex->nHeight;
+        utxoStats.hashBlock = pindex->GetBlockHash();
+        if (!pblocktree->WriteUTXOStats(utxoStats))
+            return state.Abort("Failed to write UTXO set statistics");
+    }
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3214,7 +3851,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
-    g_signals.UpdatedTransaction(hashPrevBestCoinBase);
+    GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
     int64_t nTime4 = GetTimeMicros();
@@ -3280,7 +3917,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 return state.Abort("Failed to write to coin database");
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
-                g_signals.SetBestChain(chainActive.GetLocator());
+                GetMainSignals().SetBestChain(chainActive.GetLocator());
             }
             nLastWrite = GetTimeMicros();
         }
@@ -3296,10 +3933,47 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+static CCriticalSection cs_chainTipSnapshot;
+static CChainTipSnapshot chainTipSnapshot;
+
+/** Publish the current chainActive tip to readers that don't hold cs_main. */
+static void UpdateChainTipSnapshot()
+{
+    const CBlockIndex* pindex = chainActive.Tip();
+    LOCK(cs_chainTipSnapshot);
+    chainTipSnapshot.pindex = pindex;
+    chainTipSnapshot.nHeight = pindex ? pindex->nHeight : -1;
+    chainTipSnapshot.hashBlock = pindex ? pindex->GetBlockHash() : 0;
+}
+
+CChainTipSnapshot GetChainTipSnapshot()
+{
+    LOCK(cs_chainTipSnapshot);
+    return chainTipSnapshot;
+}
+
+// Copy of mapBlockIndex for lookups that don't hold cs_main, filled once an entry is fully set up
+static CCriticalSection cs_blockIndexLookup;
+static boost::unordered_map<uint256, const CBlockIndex*, BlockHasher> mapBlockIndexLookup;
+
+static void PublishBlockIndex(const CBlockIndex* pindex)
+{
+    LOCK(cs_blockIndexLookup);
+    mapBlockIndexLookup.insert(make_pair(pindex->GetBlockHash(), pindex));
+}
+
+const CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    LOCK(cs_blockIndexLookup);
+    boost::unordered_map<uint256, const CBlockIndex*, BlockHasher>::const_iterator it = mapBlockIndexLookup.find(hash);
+    return it == mapBlockIndexLookup.end() ? NULL : it->second;
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    UpdateChainTipSnapshot();
 
     // If turned on AutoZeromint will automatically convert OXID to zOXID
     if (pwalletMain->isZeromintEnabled())
@@ -3414,7 +4088,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
-        g_signals.BlockChecked(*pblock, state);
+        GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
@@ -3739,6 +4413,7 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             }
             // Notify external listeners about the new tip.
             uiInterface.NotifyBlockTip(hashNewTip);
+            GetMainSignals().UpdatedBlockTip(pindexNewTip);
         }
     } while (pindexMostWork != chainActive.Tip());
     CheckBlockIndex();
@@ -3885,6 +4560,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->pprev->pnext = pindexNew;
 
     setDirtyBlockIndex.insert(pindexNew);
+    PublishBlockIndex(pindexNew);
 
     return pindexNew;
 }
@@ -4104,15 +4780,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                    if (mapLockedInputs.count(in.prevout)) {
-                        if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                            mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
-                            LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString(), tx.GetHash().ToString());
-                            return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
-                                REJECT_INVALID, "conflicting-tx-ix");
-                        }
-                    }
+                uint256 hashLock;
+                if (GetConflictingTransactionLock(tx, hashLock)) {
+                    mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
+                    LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", hashLock.ToString(), tx.GetHash().ToString());
+                    return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
+                        REJECT_INVALID, "conflicting-tx-ix");
                 }
             }
         }
@@ -4730,6 +5403,13 @@ bool static LoadBlockIndexDB(string& strError)
             pindexBestHeader = pindex;
     }
 
+    {
+        LOCK(cs_blockIndexLookup);
+        mapBlockIndexLookup.rehash(mapBlockIndex.size());
+        BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight)
+            mapBlockIndexLookup.insert(make_pair(item.second->GetBlockHash(), item.second));
+    }
+
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -4843,6 +5523,12 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -4851,6 +5537,7 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    UpdateChainTipSnapshot();
 
     PruneBlockIndexCandidates();
 
@@ -4951,9 +5638,14 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
 
 void UnloadBlockIndex()
 {
+    {
+        LOCK(cs_blockIndexLookup);
+        mapBlockIndexLookup.clear();
+    }
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    UpdateChainTipSnapshot();
     pindexBestInvalid = NULL;
 }
 
@@ -4976,6 +5668,10 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5307,32 +6003,91 @@ string GetWarnings(string strFor)
 //
 
 
-bool static AlreadyHave(const CInv& inv)
+/**
+ * The masternode, budget, obfuscation, IX, spork and sync extensions each handle
+ * their own messages. Every subsystem is serialized by its own lock, so message
+ * handler threads working on different peers only wait for each other when they
+ * feed the same subsystem. Handlers take cs_main while holding their subsystem lock,
+ * so a subsystem lock is never waited for under cs_main.
+ */
+enum MessageSubsystem {
+    MSG_SUBSYSTEM_OBFUSCATION,
+    MSG_SUBSYSTEM_MASTERNODES,
+    MSG_SUBSYSTEM_BUDGET,
+    MSG_SUBSYSTEM_PAYMENTS,
+    MSG_SUBSYSTEM_INSTANTX,
+    MSG_SUBSYSTEM_SPORKS,
+    MSG_SUBSYSTEM_SYNC,
+    MSG_SUBSYSTEM_COUNT
+};
+
+static CCriticalSection cs_messageSubsystem[MSG_SUBSYSTEM_COUNT];
+
+static int GetMessageSubsystem(const string& strCommand)
+{
+    static const struct {
+        const char* pszCommand;
+        int nSubsystem;
+    } subsystemCommands[] = {
+        {"dsa", MSG_SUBSYSTEM_OBFUSCATION}, {"dsc", MSG_SUBSYSTEM_OBFUSCATION}, {"dsf", MSG_SUBSYSTEM_OBFUSCATION},
+        {"dsi", MSG_SUBSYSTEM_OBFUSCATION}, {"dsq", MSG_SUBSYSTEM_OBFUSCATION}, {"dss", MSG_SUBSYSTEM_OBFUSCATION},
+        {"dssu", MSG_SUBSYSTEM_OBFUSCATION},
+        {"dseg", MSG_SUBSYSTEM_MASTERNODES}, {"dsegd", MSG_SUBSYSTEM_MASTERNODES}, {"mnb", MSG_SUBSYSTEM_MASTERNODES},
+        {"mnp", MSG_SUBSYSTEM_MASTERNODES},
+        {"fbs", MSG_SUBSYSTEM_BUDGET}, {"fbvote", MSG_SUBSYSTEM_BUDGET}, {"mnvs", MSG_SUBSYSTEM_BUDGET},
+        {"mnvsd", MSG_SUBSYSTEM_BUDGET}, {"mprop", MSG_SUBSYSTEM_BUDGET}, {"mvote", MSG_SUBSYSTEM_BUDGET},
+        {"mnget", MSG_SUBSYSTEM_PAYMENTS}, {"mnw", MSG_SUBSYSTEM_PAYMENTS},
+        {"ix", MSG_SUBSYSTEM_INSTANTX}, {"txlvote", MSG_SUBSYSTEM_INSTANTX},
+        {"getsporks", MSG_SUBSYSTEM_SPORKS}, {"spork", MSG_SUBSYSTEM_SPORKS},
+        {"ssc", MSG_SUBSYSTEM_SYNC},
+    };
+
+    for (unsigned int i = 0; i < sizeof(subsystemCommands) / sizeof(subsystemCommands[0]); i++)
+        if (strCommand == subsystemCommands[i].pszCommand)
+            return subsystemCommands[i].nSubsystem;
+    return -1;
+}
+
+/** Subsystem whose handler writes the relay maps of an inventory type, -1 for inventory handled outside the subsystems */
+static int GetInvSubsystem(int nType)
 {
-    switch (inv.type) {
-    case MSG_TX: {
-        bool txInMap = false;
-        txInMap = mempool.exists(inv.hash);
-        return txInMap || mapOrphanTransactions.count(inv.hash) ||
-               pcoinsTip->HaveCoins(inv.hash);
-    }
-    case MSG_DSTX:
-        return mapObfuscationBroadcastTxes.count(inv.hash);
-    case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash);
-    case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
-    case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+    switch (nType) {
     case MSG_SPORK:
-        return mapSporks.count(inv.hash);
+        return MSG_SUBSYSTEM_SPORKS;
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+        return MSG_SUBSYSTEM_PAYMENTS;
+    case MSG_BUDGET_VOTE:
+    case MSG_BUDGET_PROPOSAL:
+    case MSG_BUDGET_FINALIZED_VOTE:
+    case MSG_BUDGET_FINALIZED:
+        return MSG_SUBSYSTEM_BUDGET;
+    case MSG_MASTERNODE_ANNOUNCE:
+    case MSG_MASTERNODE_PING:
+        return MSG_SUBSYSTEM_MASTERNODES;
+    }
+    return -1;
+}
+
+/** Whether an extension inventory item is known, requires cs_messageSubsystem[GetInvSubsystem(inv.type)] */
+bool static AlreadyHaveExtension(const CInv& inv)
+{
+    switch (inv.type) {
+    case MSG_SPORK: {
+        LOCK(cs_sporks);
+        return mapSporks.count(inv.hash);
+    }
+    case MSG_MASTERNODE_WINNER: {
+        bool fSeen;
+        {
+            LOCK(cs_mapMasternodePayeeVotes);
+            fSeen = masternodePayments.mapMasternodePayeeVotes.count(inv.hash);
+        }
+        if (fSeen) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
         return false;
+    }
     case MSG_BUDGET_VOTE:
         if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
             masternodeSync.AddedBudgetItem(inv.hash);
@@ -5370,6 +6125,64 @@ bool static AlreadyHave(const CInv& inv)
     return true;
 }
 
+/**
+ * Whether an inventory item handled outside the subsystems is known, requires cs_main.
+ * Subsystem handlers take cs_main while holding their own lock, so extension items are
+ * looked up with AlreadyHaveExtension before cs_main is taken.
+ */
+bool static AlreadyHave(const CInv& inv)
+{
+    switch (inv.type) {
+    case MSG_TX: {
+        bool txInMap = false;
+        txInMap = mempool.exists(inv.hash);
+        return txInMap || mapOrphanTransactions.count(inv.hash) ||
+               pcoinsTip->HaveCoins(inv.hash);
+    }
+    case MSG_DSTX:
+        return mapObfuscationBroadcastTxes.count(inv.hash);
+    case MSG_BLOCK:
+        return mapBlockIndex.count(inv.hash);
+    case MSG_TXLOCK_REQUEST: {
+        LOCK(cs_instantx);
+        return mapTxLockReq.count(inv.hash) ||
+               mapTxLockReqRejected.count(inv.hash);
+    }
+    case MSG_TXLOCK_VOTE: {
+        LOCK(cs_instantx);
+        return mapTxLockVote.count(inv.hash);
+    }
+    }
+    // Don't know what it is, just say we already got one
+    return true;
+}
+
+
+/** Recently requested blocks as framed "block" messages, shared by every peer that asks for them (guarded by cs_main) */
+static std::map<uint256, CSerializedNetMsg> mapBlockMessages;
+static std::deque<uint256> vBlockMessagesOrder;
+
+static CSerializedNetMsg GetBlockMessage(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    std::map<uint256, CSerializedNetMsg>::iterator it = mapBlockMessages.find(pindex->GetBlockHash());
+    if (it != mapBlockMessages.end())
+        return it->second;
+
+    CSerializeData vchBlock;
+    if (!ReadRawBlockFromDisk(vchBlock, pindex))
+        return CSerializedNetMsg();
+    CSerializedNetMsg msg = MakeNetMessage("block", vchBlock);
+
+    if (vBlockMessagesOrder.size() >= BLOCK_MESSAGE_CACHE_SIZE) {
+        mapBlockMessages.erase(vBlockMessagesOrder.front());
+        vBlockMessagesOrder.pop_front();
+    }
+    mapBlockMessages.insert(std::make_pair(pindex->GetBlockHash(), msg));
+    vBlockMessagesOrder.push_back(pindex->GetBlockHash());
+    return msg;
+}
 
 void static ProcessGetData(CNode* pfrom)
 {
@@ -5377,8 +6190,6 @@ void static ProcessGetData(CNode* pfrom)
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -5390,6 +6201,7 @@ void static ProcessGetData(CNode* pfrom)
             it++;
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+                LOCK(cs_main);
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end()) {
@@ -5408,14 +6220,18 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_BLOCK) {
+                        // Send the block's bytes from disk as they are, without deserializing them
+                        CSerializedNetMsg msg = GetBlockMessage((*mi).second);
+                        if (!msg)
+                            assert(!"cannot load block from disk");
+                        pfrom->PushSerializedMessage(msg);
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -5451,9 +6267,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSerializedNetMsg>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushSerializedMessage((*mi).second);
                         pushed = true;
                     }
                 }
@@ -5469,102 +6285,105 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_instantx);
+                        TxLockVoteMap::iterator it = mapTxLockVote.find(inv.hash);
+                        if (it != mapTxLockVote.end()) {
+                            ss.reserve(1000);
+                            ss << it->second;
+                            pushed = true;
+                        }
                     }
+                    if (pushed) pfrom->PushMessage("txlvote", ss);
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-                    if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-                    if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-                    if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-                    if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
-                        pushed = true;
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_instantx);
+                        TxLockRequestMap::iterator it = mapTxLockReq.find(inv.hash);
+                        if (it != mapTxLockReq.end()) {
+                            ss.reserve(1000);
+                            ss << it->second;
+                            pushed = true;
+                        }
                     }
+                    if (pushed) pfrom->PushMessage("ix", ss);
                 }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
-                        pushed = true;
+                int nSubsystem = GetInvSubsystem(inv.type);
+                if (!pushed && nSubsystem != -1) {
+                    // the relay maps of the extensions are written by their subsystem's handler, which may run on another thread
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    const char* pszCommand = NULL;
+                    {
+                        LOCK(cs_messageSubsystem[nSubsystem]);
+                        if (inv.type == MSG_SPORK) {
+                            LOCK(cs_sporks);
+                            std::map<uint256, CSporkMessage>::iterator mi = mapSporks.find(inv.hash);
+                            if (mi != mapSporks.end()) {
+                                ss << mi->second;
+                                pszCommand = "spork";
+                            }
+                        }
+                        if (inv.type == MSG_MASTERNODE_WINNER) {
+                            LOCK(cs_mapMasternodePayeeVotes);
+                            std::map<uint256, CMasternodePaymentWinner>::iterator mi = masternodePayments.mapMasternodePayeeVotes.find(inv.hash);
+                            if (mi != masternodePayments.mapMasternodePayeeVotes.end()) {
+                                ss << mi->second;
+                                pszCommand = "mnw";
+                            }
+                        }
+                        if (inv.type == MSG_BUDGET_VOTE) {
+                            std::map<uint256, CBudgetVote>::iterator mi = budget.mapSeenMasternodeBudgetVotes.find(inv.hash);
+                            if (mi != budget.mapSeenMasternodeBudgetVotes.end()) {
+                                ss << mi->second;
+                                pszCommand = "mvote";
+                            }
+                        }
+                        if (inv.type == MSG_BUDGET_PROPOSAL) {
+                            std::map<uint256, CBudgetProposalBroadcast>::iterator mi = budget.mapSeenMasternodeBudgetProposals.find(inv.hash);
+                            if (mi != budget.mapSeenMasternodeBudgetProposals.end()) {
+                                ss << mi->second;
+                                pszCommand = "mprop";
+                            }
+                        }
+                        if (inv.type == MSG_BUDGET_FINALIZED_VOTE) {
+                            std::map<uint256, CFinalizedBudgetVote>::iterator mi = budget.mapSeenFinalizedBudgetVotes.find(inv.hash);
+                            if (mi != budget.mapSeenFinalizedBudgetVotes.end()) {
+                                ss << mi->second;
+                                pszCommand = "fbvote";
+                            }
+                        }
+                        if (inv.type == MSG_BUDGET_FINALIZED) {
+                            std::map<uint256, CFinalizedBudgetBroadcast>::iterator mi = budget.mapSeenFinalizedBudgets.find(inv.hash);
+                            if (mi != budget.mapSeenFinalizedBudgets.end()) {
+                                ss << mi->second;
+                                pszCommand = "fbs";
+                            }
+                        }
+                        if (inv.type == MSG_MASTERNODE_ANNOUNCE) {
+                            std::map<uint256, CMasternodeBroadcast>::iterator mi = mnodeman.mapSeenMasternodeBroadcast.find(inv.hash);
+                            if (mi != mnodeman.mapSeenMasternodeBroadcast.end()) {
+                                ss << mi->second;
+                                pszCommand = "mnb";
+                            }
+                        }
+                        if (inv.type == MSG_MASTERNODE_PING) {
+                            std::map<uint256, CMasternodePing>::iterator mi = mnodeman.mapSeenMasternodePing.find(inv.hash);
+                            if (mi != mnodeman.mapSeenMasternodePing.end()) {
+                                ss << mi->second;
+                                pszCommand = "mnp";
+                            }
+                        }
                     }
-                }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
+                    if (pszCommand) {
+                        pfrom->PushMessage(pszCommand, ss);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_DSTX) {
+                    LOCK(cs_main);
                     if (mapObfuscationBroadcastTxes.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
@@ -5582,7 +6401,7 @@ void static ProcessGetData(CNode* pfrom)
             }
 
             // Track requests for our stuff.
-            g_signals.Inventory(inv.hash);
+            GetMainSignals().Inventory(inv.hash);
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
                 break;
@@ -5604,6 +6423,35 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+
+static void ProcessSubsystemMessage(int nSubsystem, CNode* pfrom, string& strCommand, CDataStream& vRecv)
+{
+    LOCK(cs_messageSubsystem[nSubsystem]);
+    switch (nSubsystem) {
+    case MSG_SUBSYSTEM_OBFUSCATION:
+        obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
+        break;
+    case MSG_SUBSYSTEM_MASTERNODES:
+        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+        break;
+    case MSG_SUBSYSTEM_BUDGET:
+        budget.ProcessMessage(pfrom, strCommand, vRecv);
+        break;
+    case MSG_SUBSYSTEM_PAYMENTS:
+        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
+        break;
+    case MSG_SUBSYSTEM_INSTANTX:
+        ProcessMessageInstantTX(pfrom, strCommand, vRecv);
+        break;
+    case MSG_SUBSYSTEM_SPORKS:
+        ProcessSpork(pfrom, strCommand, vRecv);
+        break;
+    case MSG_SUBSYSTEM_SYNC:
+        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        break;
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -5818,6 +6666,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return error("message inv size() = %u", vInv.size());
         }
 
+        // extension items are looked up under their subsystem lock, which must not be taken under cs_main
+        std::vector<bool> vHaveExtension(vInv.size(), false);
+        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
+            int nSubsystem = GetInvSubsystem(vInv[nInv].type);
+            if (nSubsystem == -1) continue;
+            LOCK(cs_messageSubsystem[nSubsystem]);
+            vHaveExtension[nInv] = AlreadyHaveExtension(vInv[nInv]);
+        }
+
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
@@ -5828,7 +6685,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             boost::this_thread::interruption_point();
             pfrom->AddInventoryKnown(inv);
 
-            bool fAlreadyHave = AlreadyHave(inv);
+            bool fAlreadyHave = GetInvSubsystem(inv.type) == -1 ? AlreadyHave(inv) : vHaveExtension[nInv];
             LogPrint("net", "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
 
             if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
@@ -5845,7 +6702,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
 
             // Track requests for our stuff
-            g_signals.Inventory(inv.hash);
+            GetMainSignals().Inventory(inv.hash);
 
             if (pfrom->nSendSize > (SendBufferSize() * 2)) {
                 Misbehaving(pfrom->GetId(), 50);
@@ -5986,6 +6843,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 ignoreFees = true;
                 pmn->allowFreeTx = false;
 
+                LOCK(cs_main);
                 if (!mapObfuscationBroadcastTxes.count(tx.GetHash())) {
                     CObfuscationBroadcastTx dstx;
                     dstx.tx = tx;
@@ -6001,15 +6859,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
         bool fMissingInputs = false;
         bool fMissingZerocoinInputs = false;
         CValidationState state;
 
+        // the scripts are checked without cs_main, so other peers' transactions are validated meanwhile
+        bool fAccepted = AcceptToMemoryPoolConcurrent(mempool, state, tx, true, tx.IsZerocoinSpend() ? &fMissingZerocoinInputs : &fMissingInputs, ignoreFees);
+
+        LOCK(cs_main);
+
         mapAlreadyAskedFor.erase(inv);
 
-        if (!tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) {
+        if (!tx.IsZerocoinSpend() && fAccepted) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx);
             vWorkQueue.push_back(inv.hash);
@@ -6064,7 +6925,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             BOOST_FOREACH (uint256 hash, vEraseQueue)
                 EraseOrphanTx(hash);
-        } else if (tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingZerocoinInputs, false, ignoreFees)) {
+        } else if (tx.IsZerocoinSpend() && fAccepted) {
             //Presstab: ZCoin has a bunch of code commented out here. Is this something that should have more going on?
             //Also there is nothing that handles fMissingZerocoinInputs. Does there need to be?
             RelayTransaction(tx);
@@ -6420,14 +7281,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
     } else {
-        //probably one the extensions
-        obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
-        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        budget.ProcessMessage(pfrom, strCommand, vRecv);
-        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageInstantTX(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        //probably one the extensions, commands we don't know are offered to all of them
+        int nSubsystem = GetMessageSubsystem(strCommand);
+        if (nSubsystem != -1) {
+            ProcessSubsystemMessage(nSubsystem, pfrom, strCommand, vRecv);
+        } else {
+            for (int i = 0; i < MSG_SUBSYSTEM_COUNT; i++)
+                ProcessSubsystemMessage(i, pfrom, strCommand, vRecv);
+        }
     }
 
 
@@ -6677,7 +7538,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
         if (!fReindex /*&& !fImporting && !IsInitialBlockDownload()*/) {
-            g_signals.Broadcast();
+            GetMainSignals().Broadcast(nTimeBestReceived);
         }
 
         //
@@ -6769,7 +7630,18 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow) {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv)) {
+            bool fAlreadyHave;
+            int nSubsystem = GetInvSubsystem(inv.type);
+            if (nSubsystem == -1) {
+                fAlreadyHave = AlreadyHave(inv);
+            } else {
+                // cs_main is held, so the subsystem lock may only be tried; the rest is asked for on the next round
+                TRY_LOCK(cs_messageSubsystem[nSubsystem], lockSubsystem);
+                if (!lockSubsystem)
+                    break;
+                fAlreadyHave = AlreadyHaveExtension(inv);
+            }
+            if (!fAlreadyHave) {
                 if (fDebug)
                     LogPrint("net", "Requesting %s peer=%d\n", inv.ToString(), pto->id);
                 vGetData.push_back(inv);
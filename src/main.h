@@ -12,6 +12,7 @@
 #include "config/oxid-config.h"
 #endif
 
+#include "addressindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -24,11 +25,13 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "spentindex.h"
 #include "sync.h"
 #include "tinyformat.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "undo.h"
+#include "validationinterface.h"
 
 #include <algorithm>
 #include <exception>
@@ -78,6 +81,20 @@ static const unsigned int MAX_TX_SIGOPS_CURRENT = MAX_BLOCK_SIGOPS_CURRENT / 5;
 static const unsigned int MAX_TX_SIGOPS_LEGACY = MAX_BLOCK_SIGOPS_LEGACY / 5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -limitancestorcount, max number of in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -limitancestorsize, maximum kilobytes of tx + all in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
+/** Default for -limitdescendantcount, max number of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+/** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -102,6 +119,8 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Number of recently requested blocks kept as ready-to-send "block" messages. */
+static const unsigned int BLOCK_MESSAGE_CACHE_SIZE = 16;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
@@ -109,6 +128,10 @@ static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 
 /** Enable bloom filter */
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -spentindex */
+static const bool DEFAULT_SPENTINDEX = false;
 
 /** "reject" message codes */
 static const unsigned char REJECT_MALFORMED = 0x01;
@@ -139,6 +162,9 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fZerocoinIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -166,15 +192,6 @@ extern CBlockIndex* pindexBestHeader;
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
-void UnregisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister all wallets from core */
-void UnregisterAllValidationInterfaces();
-/** Push an updated transaction to all registered wallets */
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
-
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
@@ -232,6 +249,27 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Address type and hash an output script is indexed under by -addressindex; false if it pays no single address */
+bool GetScriptAddressIndexKey(const CScript& scriptPubKey, int& nType, uint160& hashBytes);
+/** Look up what spent an output (-spentindex) */
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+/** Outputs received and spent by an address, optionally limited to a height range (-addressindex) */
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+/** Unspent outputs of an address (-addressindex) */
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+
+/** Address and spent index entries of a block, collected while it is connected or disconnected */
+struct CAddressIndexUpdates {
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+};
+/** Collect the entries of transaction nTx of a block at nHeight, before UpdateCoins spends its inputs from view */
+void AddConnectedTxIndexUpdates(const CTransaction& tx, unsigned int nTx, int nHeight, const CCoinsViewCache& view, CAddressIndexUpdates& updates);
+/** Collect the entries undoing transaction nTx of a block at nHeight, once its inputs are restored in view */
+void AddDisconnectedTxIndexUpdates(const CTransaction& tx, unsigned int nTx, int nHeight, const CCoinsViewCache& view, CAddressIndexUpdates& updates);
+/** Store the entries of a connected block, or remove those of a disconnected one (fErase) */
+bool WriteAddressIndexUpdates(const CAddressIndexUpdates& updates, bool fErase);
 /** Find the best known block, and make it the tip of the block chain */
 
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -254,10 +292,16 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Load the mempool saved by DumpMempool */
+bool LoadMempool();
+/** Save the mempool to mempool.dat */
+bool DumpMempool();
 
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, int64_t nAcceptTime, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
@@ -348,8 +392,14 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  */
 bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
 
-/** Apply the effects of this transaction on the UTXO set represented by view */
-void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
+/**
+ * The script part of CheckInputs(), for inputs whose coins already passed it without fScriptChecks.
+ * It only reads the transaction and the coins in view, so it does not need cs_main.
+ */
+bool CheckInputScripts(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
+
+/** Apply the effects of this transaction on the UTXO set represented by view, and on pstats if not NULL */
+void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight, CCoinsStats* pstats = NULL);
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
@@ -366,6 +416,8 @@ bool GetZerocoinMint(const CBigNum& bnPubcoin, uint256& txHash);
 bool IsSerialKnown(const CBigNum& bnSerial);
 bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx);
 bool RemoveSerialFromDB(const CBigNum& bnSerial);
+/** Build the zerocoin height index from the active chain if it has not been built yet */
+bool BuildZerocoinIndex(std::string& strError);
 int GetZerocoinStartHeight();
 bool IsTransactionInChain(uint256 txId, int& nHeightTx);
 bool IsBlockHashInChain(const uint256& hashBlock);
@@ -448,6 +500,9 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read a block's serialized bytes without deserializing it. They are identical on disk and on the wire. */
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CDiskBlockPos& pos);
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -633,6 +688,41 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex);
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 
+/**
+ * The tip of chainActive as of its last change. Readers don't need cs_main, block indexes are never freed while running.
+ * The rest of the snapshotted chain is reached through pprev and pskip, which don't change once a block index is published.
+ */
+struct CChainTipSnapshot {
+    const CBlockIndex* pindex;
+    int nHeight;
+    uint256 hashBlock;
+
+    CChainTipSnapshot() : pindex(NULL), nHeight(-1), hashBlock(0) {}
+
+    /** The block at the given height of the snapshotted chain, or NULL. O(log n) through the skip list. */
+    const CBlockIndex* operator[](int nHeightIn) const
+    {
+        if (nHeightIn < 0 || nHeightIn > nHeight)
+            return NULL;
+        return pindex->GetAncestor(nHeightIn);
+    }
+
+    bool Contains(const CBlockIndex* pindexIn) const
+    {
+        return pindexIn && (*this)[pindexIn->nHeight] == pindexIn;
+    }
+
+    const CBlockIndex* Next(const CBlockIndex* pindexIn) const
+    {
+        return Contains(pindexIn) ? (*this)[pindexIn->nHeight + 1] : NULL;
+    }
+};
+
+CChainTipSnapshot GetChainTipSnapshot();
+
+/** Find a block index by hash without cs_main. Only the fields of the block header, nHeight, nChainWork, pprev and pskip may be read. */
+const CBlockIndex* LookupBlockIndex(const uint256& hash);
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
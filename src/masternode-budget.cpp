@@ -246,126 +246,74 @@ void CBudgetManager::SubmitFinalBudget()
 // CBudgetDB
 //
 
-CBudgetDB::CBudgetDB()
+CBudgetDB budgetDB;
+
+CBudgetDB::CBudgetDB() : CRecordDB("budget.dat", "MasternodeBudgetRecords")
 {
-    pathDB = GetDataDir() / "budget.dat";
-    strMagicMessage = "MasternodeBudget";
 }
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
-
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
+    CRecordBatch batch;
+    {
+        LOCK(objToSave.cs);
 
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+        batch.WriteMap(RECORD_SEEN_PROPOSAL, objToSave.mapSeenMasternodeBudgetProposals);
+        batch.WriteMap(RECORD_SEEN_PROPOSAL_VOTE, objToSave.mapSeenMasternodeBudgetVotes);
+        batch.WriteMap(RECORD_SEEN_FINALIZED_BUDGET, objToSave.mapSeenFinalizedBudgets);
+        batch.WriteMap(RECORD_SEEN_FINALIZED_BUDGET_VOTE, objToSave.mapSeenFinalizedBudgetVotes);
+        batch.WriteMap(RECORD_ORPHAN_PROPOSAL_VOTE, objToSave.mapOrphanMasternodeBudgetVotes);
+        batch.WriteMap(RECORD_ORPHAN_FINALIZED_BUDGET_VOTE, objToSave.mapOrphanFinalizedBudgetVotes);
+        batch.WriteMap(RECORD_PROPOSAL, objToSave.mapProposals);
+        batch.WriteMap(RECORD_FINALIZED_BUDGET, objToSave.mapFinalizedBudgets);
     }
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
 
-    return true;
+    return WriteRecords(batch);
 }
 
-CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
+CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad)
 {
     LOCK(objToLoad.cs);
 
-    int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CBudgetManager object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
-    }
+    ReadResult result = ReadRecords([&objToLoad](unsigned char nRecordType, const uint256& key, CDataStream& ssValue) {
+        switch (nRecordType) {
+        case RECORD_SEEN_PROPOSAL:
+            ReadMapRecord(ssValue, objToLoad.mapSeenMasternodeBudgetProposals, key);
+            break;
+        case RECORD_SEEN_PROPOSAL_VOTE:
+            ReadMapRecord(ssValue, objToLoad.mapSeenMasternodeBudgetVotes, key);
+            break;
+        case RECORD_SEEN_FINALIZED_BUDGET:
+            ReadMapRecord(ssValue, objToLoad.mapSeenFinalizedBudgets, key);
+            break;
+        case RECORD_SEEN_FINALIZED_BUDGET_VOTE:
+            ReadMapRecord(ssValue, objToLoad.mapSeenFinalizedBudgetVotes, key);
+            break;
+        case RECORD_ORPHAN_PROPOSAL_VOTE:
+            ReadMapRecord(ssValue, objToLoad.mapOrphanMasternodeBudgetVotes, key);
+            break;
+        case RECORD_ORPHAN_FINALIZED_BUDGET_VOTE:
+            ReadMapRecord(ssValue, objToLoad.mapOrphanFinalizedBudgetVotes, key);
+            break;
+        case RECORD_PROPOSAL:
+            ReadMapRecord(ssValue, objToLoad.mapProposals, key);
+            break;
+        case RECORD_FINALIZED_BUDGET:
+            ReadMapRecord(ssValue, objToLoad.mapFinalizedBudgets, key);
+            break;
+        }
+    });
+
+    if (result != Ok)
+        return result;
+
+    objToLoad.InvalidateBudgetCache();
 
-    LogPrint("masternode","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("masternode","Budget manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
+    LogPrint("masternode","Budget manager - cleaning....\n");
+    objToLoad.CheckAndRemove();
+    LogPrint("masternode","Budget manager - result:\n");
+    LogPrint("masternode","  %s\n", objToLoad.ToString());
 
     return Ok;
 }
@@ -374,25 +322,8 @@ void DumpBudgets()
 {
     int64_t nStart = GetTimeMillis();
 
-    CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint("masternode","Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint("masternode","Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint("masternode","Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("masternode","Writting info to budget.dat...\n");
-    budgetdb.Write(budget);
+    budgetDB.Write(budget);
 
     LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
@@ -424,6 +355,7 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    nProposalsVersion++;
     LogPrint("masternode","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
     return true;
 }
@@ -463,7 +395,9 @@ void CBudgetManager::CheckAndRemove()
     std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
     while (it2 != mapProposals.end()) {
         CBudgetProposal* pbudgetProposal = &((*it2).second);
+        bool fValidOld = pbudgetProposal->fValid;
         pbudgetProposal->fValid = pbudgetProposal->IsValid(strError);
+        if (pbudgetProposal->fValid != fValidOld) nProposalsVersion++;
         if (!strError.empty ()) {
             LogPrint("masternode","CBudgetManager::CheckAndRemove - Invalid budget proposal - %s\n", strError);
             strError = "";
@@ -621,7 +555,8 @@ bool CBudgetManager::IsTransactionValid(const CTransaction& txNew, int nBlockHei
     LOCK(cs);
 
     int nHighestCount = 0;
-    int nFivePercent = mnodeman.CountEnabled(ActiveProtocol()) / 20;
+    int nEnabled = mnodeman.CountEnabled(ActiveProtocol());
+    int nFivePercent = nEnabled / 20;
     std::vector<CFinalizedBudget*> ret;
 
     // ------- Grab The Highest Count
@@ -651,7 +586,7 @@ bool CBudgetManager::IsTransactionValid(const CTransaction& txNew, int nBlockHei
     while (it != mapFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = &((*it).second);
 
-        if (pfinalizedBudget->GetVoteCount() > nHighestCount - mnodeman.CountEnabled(ActiveProtocol()) / 10) {
+        if (pfinalizedBudget->GetVoteCount() > nHighestCount - nEnabled / 10) {
             if (nBlockHeight >= pfinalizedBudget->GetBlockStart() && nBlockHeight <= pfinalizedBudget->GetBlockEnd()) {
                 if (pfinalizedBudget->IsTransactionValid(txNew, nBlockHeight)) {
                     return true;
@@ -666,16 +601,31 @@ bool CBudgetManager::IsTransactionValid(const CTransaction& txNew, int nBlockHei
     return false;
 }
 
+void CBudgetManager::CheckProposalVotes()
+{
+    // read the version first, so that a change during the check is caught next time
+    unsigned int nListVersion = mnodeman.GetListVersion();
+    if (nListVersion == nVotesMasternodeListVersion) return;
+
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        if ((*it).second.CleanAndRemove(false)) nProposalsVersion++;
+        ++it;
+    }
+
+    nVotesMasternodeListVersion = nListVersion;
+}
+
 std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 {
     LOCK(cs);
 
+    CheckProposalVotes();
+
     std::vector<CBudgetProposal*> vBudgetProposalRet;
 
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
 
@@ -702,13 +652,37 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    std::vector<CBudgetProposal*> vBudgetProposalsRet;
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev == NULL) return vBudgetProposalsRet;
+
+    // votes of masternodes that left the list must not count towards the ranking
+    CheckProposalVotes();
+
+    int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
+    int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
+    int nThreshold = mnodeman.CountEnabled(ActiveProtocol()) / 10;
+    int64_t nNow = GetTime();
+
+    // ------- Reuse the ranking as long as votes, cycle, threshold and established proposals are unchanged
+
+    if (nCachedBudgetVersion == nProposalsVersion && nCachedBudgetBlockStart == nBlockStart &&
+        nCachedBudgetThreshold == nThreshold && nNow < nCachedBudgetExpires) {
+        BOOST_FOREACH (const uint256& nHash, vCachedBudget) {
+            std::map<uint256, CBudgetProposal>::iterator it = mapProposals.find(nHash);
+            if (it != mapProposals.end())
+                vBudgetProposalsRet.push_back(&((*it).second));
+        }
+        return vBudgetProposalsRet;
+    }
+
     // ------- Sort budgets by Yes Count
 
     std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
 
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
         vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetYeas() - (*it).second.GetNays()));
         ++it;
     }
@@ -717,16 +691,9 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 
     // ------- Grab The Budgets In Order
 
-    std::vector<CBudgetProposal*> vBudgetProposalsRet;
-
     CAmount nBudgetAllocated = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    if (pindexPrev == NULL) return vBudgetProposalsRet;
-
-    int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
-    int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
-
+    int64_t nExpires = std::numeric_limits<int64_t>::max();
 
     std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
     while (it2 != vBudgetPorposalsSort.end()) {
@@ -736,12 +703,12 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         //prop start/end should be inside this period
         if (pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= nBlockStart &&
             pbudgetProposal->nBlockEnd >= nBlockEnd &&
-            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > mnodeman.CountEnabled(ActiveProtocol()) / 10 &&
+            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > nThreshold &&
             pbudgetProposal->IsEstablished()) {
 
             LogPrint("masternode","CBudgetManager::GetBudget() -   Check 1 passed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), nThreshold,
                       pbudgetProposal->IsEstablished());
 
             if (pbudgetProposal->GetAmount() + nBudgetAllocated <= nTotalBudget) {
@@ -757,13 +724,25 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         else {
             LogPrint("masternode","CBudgetManager::GetBudget() -   Check 1 failed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), nThreshold,
                       pbudgetProposal->IsEstablished());
+
+            // the ranking changes once this proposal becomes established
+            if (!pbudgetProposal->IsEstablished())
+                nExpires = std::min(nExpires, pbudgetProposal->GetEstablishedTime());
         }
 
         ++it2;
     }
 
+    vCachedBudget.clear();
+    BOOST_FOREACH (CBudgetProposal* pbudgetProposal, vBudgetProposalsRet)
+        vCachedBudget.push_back(pbudgetProposal->GetHash());
+    nCachedBudgetVersion = nProposalsVersion;
+    nCachedBudgetBlockStart = nBlockStart;
+    nCachedBudgetThreshold = nThreshold;
+    nCachedBudgetExpires = nExpires;
+
     return vBudgetProposalsRet;
 }
 
@@ -894,7 +873,7 @@ void CBudgetManager::NewBlock()
     LogPrint("masternode","CBudgetManager::NewBlock - mapProposals cleanup - size: %d\n", mapProposals.size());
     std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
     while (it2 != mapProposals.end()) {
-        (*it2).second.CleanAndRemove(false);
+        if ((*it2).second.CleanAndRemove(false)) nProposalsVersion++;
         ++it2;
     }
 
@@ -985,6 +964,23 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         LogPrint("mnbudget", "mnvs - Sent Masternode votes to peer %i\n", pfrom->GetId());
     }
 
+    if (strCommand == "mnvsd") { //Masternode vote sync, only the items missing from the peer's digests
+        CSyncDigest propDigest, finDigest;
+        vRecv >> propDigest >> finDigest;
+
+        if (Params().NetworkID() == CBaseChainParams::MAIN) {
+            if (pfrom->HasFulfilledRequest("mnvs")) {
+                LogPrint("masternode","mnvsd - peer already asked me for the list\n");
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+            pfrom->FulfilledRequest("mnvs");
+        }
+
+        Sync(pfrom, 0, false, &propDigest, &finDigest);
+        LogPrint("mnbudget", "mnvsd - Sent Masternode votes to peer %i\n", pfrom->GetId());
+    }
+
     if (strCommand == "mprop") { //Masternode Proposal
         CBudgetProposalBroadcast budgetProposalBroadcast;
         vRecv >> budgetProposalBroadcast;
@@ -1213,7 +1209,54 @@ void CBudgetManager::MarkSynced()
 }
 
 
-void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
+void CBudgetManager::GetSyncDigests(CSyncDigest& propDigest, CSyncDigest& finDigest)
+{
+    LOCK(cs);
+
+    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
+    while (it1 != mapSeenMasternodeBudgetProposals.end()) {
+        CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
+        if (pbudgetProposal && pbudgetProposal->fValid) {
+            propDigest.Add((*it1).second.GetHash());
+
+            std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
+            while (it2 != pbudgetProposal->mapVotes.end()) {
+                if ((*it2).second.fValid) propDigest.Add((*it2).second.GetHash());
+                ++it2;
+            }
+        }
+        ++it1;
+    }
+
+    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
+    while (it3 != mapSeenFinalizedBudgets.end()) {
+        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
+        if (pfinalizedBudget && pfinalizedBudget->fValid) {
+            finDigest.Add((*it3).second.GetHash());
+
+            std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
+            while (it4 != pfinalizedBudget->mapVotes.end()) {
+                if ((*it4).second.fValid) finDigest.Add((*it4).second.GetHash());
+                ++it4;
+            }
+        }
+        ++it3;
+    }
+}
+
+void CBudgetManager::RequestSync(CNode* pnode)
+{
+    if (pnode->nVersion >= MNSYNC_DIGEST_VERSION) {
+        CSyncDigest propDigest, finDigest;
+        GetSyncDigests(propDigest, finDigest);
+        pnode->PushMessage("mnvsd", propDigest, finDigest);
+    } else {
+        uint256 n = 0;
+        pnode->PushMessage("mnvs", n);
+    }
+}
+
+void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial, const CSyncDigest* pPropDigest, const CSyncDigest* pFinDigest)
 {
     LOCK(cs);
 
@@ -1225,24 +1268,40 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
         This code checks each of the hash maps for all known budget proposals and finalized budget proposals, then checks them against the
         budget object to see if they're OK. If all checks pass, we'll send it to the peer.
 
+        When the peer sent digests of what it already has, only the items in buckets that differ from ours are sent.
+
     */
 
+    std::vector<bool> vPropDiffer, vFinDiffer;
+    if (pPropDigest && pFinDigest) {
+        CSyncDigest propDigest, finDigest;
+        GetSyncDigests(propDigest, finDigest);
+        vPropDiffer = propDigest.GetDifferingBuckets(*pPropDigest);
+        vFinDiffer = finDigest.GetDifferingBuckets(*pFinDigest);
+    }
+
     int nInvCount = 0;
 
     std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
     while (it1 != mapSeenMasternodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
-            nInvCount++;
+            uint256 hash = (*it1).second.GetHash();
+            if (vPropDiffer.empty() || vPropDiffer[CSyncDigest::GetBucket(hash)]) {
+                pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, hash));
+                nInvCount++;
+            }
 
             //send votes
             std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
             while (it2 != pbudgetProposal->mapVotes.end()) {
                 if ((*it2).second.fValid) {
                     if ((fPartial && !(*it2).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
-                        nInvCount++;
+                        uint256 hashVote = (*it2).second.GetHash();
+                        if (vPropDiffer.empty() || vPropDiffer[CSyncDigest::GetBucket(hashVote)]) {
+                            pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, hashVote));
+                            nInvCount++;
+                        }
                     }
                 }
                 ++it2;
@@ -1261,16 +1320,22 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
-            nInvCount++;
+            uint256 hash = (*it3).second.GetHash();
+            if (vFinDiffer.empty() || vFinDiffer[CSyncDigest::GetBucket(hash)]) {
+                pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, hash));
+                nInvCount++;
+            }
 
             //send votes
             std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
                 if ((*it4).second.fValid) {
                     if ((fPartial && !(*it4).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
-                        nInvCount++;
+                        uint256 hashVote = (*it4).second.GetHash();
+                        if (vFinDiffer.empty() || vFinDiffer[CSyncDigest::GetBucket(hashVote)]) {
+                            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, hashVote));
+                            nInvCount++;
+                        }
                     }
                 }
                 ++it4;
@@ -1307,7 +1372,11 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    nProposalsVersion++;
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1344,6 +1413,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1356,6 +1426,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1370,6 +1441,7 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
     fValid = true;
+    RecountVotes();
 }
 
 bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral)
@@ -1476,36 +1548,68 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.find(hash);
+    if (it != mapVotes.end())
+        TallyVote(it->second, -1);
     mapVotes[hash] = vote;
+    TallyVote(vote, 1);
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
 }
 
-// If masternode voted for a proposal, but is now invalid -- remove the vote
-void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
+void CBudgetProposal::TallyVote(const CBudgetVote& vote, int nDelta)
 {
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    if (vote.nVote < VOTE_ABSTAIN || vote.nVote > VOTE_NO) return;
 
+    nVoteTally[vote.nVote] += nDelta;
+    if (vote.fValid) nValidVoteTally[vote.nVote] += nDelta;
+}
+
+void CBudgetProposal::RecountVotes()
+{
+    LOCK(cs);
+
+    for (int i = 0; i < 3; i++) {
+        nVoteTally[i] = 0;
+        nValidVoteTally[i] = 0;
+    }
+
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        TallyVote((*it).second, 1);
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+// If masternode voted for a proposal, but is now invalid -- remove the vote
+// Returns true if the tallies changed
+bool CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
 {
-    int yeas = 0;
-    int nays = 0;
+    LOCK(cs);
 
+    bool fChanged = false;
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        bool fValidNew = (*it).second.SignatureValid(fSignatureCheck);
+        if ((*it).second.fValid != fValidNew) {
+            TallyVote((*it).second, -1);
+            (*it).second.fValid = fValidNew;
+            TallyVote((*it).second, 1);
+            fChanged = true;
+        }
         ++it;
     }
 
+    return fChanged;
+}
+
+double CBudgetProposal::GetRatio()
+{
+    int yeas = nVoteTally[VOTE_YES];
+    int nays = nVoteTally[VOTE_NO];
+
     if (yeas + nays == 0) return 0.0f;
 
     return ((double)(yeas) / (double)(yeas + nays));
@@ -1513,41 +1617,17 @@ double CBudgetProposal::GetRatio()
 
 int CBudgetProposal::GetYeas()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nValidVoteTally[VOTE_YES];
 }
 
 int CBudgetProposal::GetNays()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nValidVoteTally[VOTE_NO];
 }
 
 int CBudgetProposal::GetAbstains()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nValidVoteTally[VOTE_ABSTAIN];
 }
 
 int CBudgetProposal::GetBlockStartCycle()
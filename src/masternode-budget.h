@@ -13,6 +13,7 @@
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
+#include "recorddb.h"
 #include "sync.h"
 #include "util.h"
 #include <boost/lexical_cast.hpp>
@@ -27,6 +28,7 @@ class CFinalizedBudget;
 class CBudgetProposal;
 class CBudgetProposalBroadcast;
 class CTxBudgetPayment;
+class CSyncDigest;
 
 #define VOTE_ABSTAIN 0
 #define VOTE_YES 1
@@ -145,28 +147,27 @@ public:
 
 /** Save Budget Manager (budget.dat)
  */
-class CBudgetDB
+class CBudgetDB : public CRecordDB
 {
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
+    enum RecordType {
+        RECORD_SEEN_PROPOSAL = 1,
+        RECORD_SEEN_PROPOSAL_VOTE,
+        RECORD_SEEN_FINALIZED_BUDGET,
+        RECORD_SEEN_FINALIZED_BUDGET_VOTE,
+        RECORD_ORPHAN_PROPOSAL_VOTE,
+        RECORD_ORPHAN_FINALIZED_BUDGET_VOTE,
+        RECORD_PROPOSAL,
+        RECORD_FINALIZED_BUDGET
     };
 
     CBudgetDB();
     bool Write(const CBudgetManager& objToSave);
-    ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+    ReadResult Read(CBudgetManager& objToLoad);
 };
 
+extern CBudgetDB budgetDB;
+
 
 //
 // Budget Manager : Contains all proposals for the budget
@@ -178,6 +179,22 @@ private:
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    // bumped whenever proposals, their validity or their vote tallies change
+    unsigned int nProposalsVersion;
+
+    // masternode list version the proposal votes were last checked against
+    unsigned int nVotesMasternodeListVersion;
+
+    // recount the proposal votes if masternodes were added or removed since the last check
+    void CheckProposalVotes();
+
+    // ranked budget returned by GetBudget(), valid while nothing it depends on changes
+    std::vector<uint256> vCachedBudget;
+    unsigned int nCachedBudgetVersion;
+    int nCachedBudgetBlockStart;
+    int nCachedBudgetThreshold;
+    int64_t nCachedBudgetExpires;
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -197,6 +214,17 @@ public:
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
+        nProposalsVersion = 0;
+        nVotesMasternodeListVersion = 0;
+        InvalidateBudgetCache();
+    }
+
+    /** Force the next GetBudget() to rank the proposals again */
+    void InvalidateBudgetCache()
+    {
+        vCachedBudget.clear();
+        nCachedBudgetVersion = nProposalsVersion - 1;
+        nVotesMasternodeListVersion = 0;
     }
 
     void ClearSeen()
@@ -212,7 +240,11 @@ public:
 
     void ResetSync();
     void MarkSynced();
-    void Sync(CNode* node, uint256 nProp, bool fPartial = false);
+    void Sync(CNode* node, uint256 nProp, bool fPartial = false, const CSyncDigest* pPropDigest = NULL, const CSyncDigest* pFinDigest = NULL);
+    /// Digests of the proposals, finalized budgets and their votes we announce to syncing peers
+    void GetSyncDigests(CSyncDigest& propDigest, CSyncDigest& finDigest);
+    /// Ask a peer for the budget items we're missing
+    void RequestSync(CNode* pnode);
 
     void Calculate();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -244,6 +276,7 @@ public:
         LOCK(cs);
 
         LogPrintf("Budget object cleared\n");
+        nProposalsVersion++;
         mapProposals.clear();
         mapFinalizedBudgets.clear();
         mapSeenMasternodeBudgetProposals.clear();
@@ -457,6 +490,12 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // vote tallies indexed by nVote, kept in sync with mapVotes
+    int nVoteTally[3];      // every vote, used for the ratio
+    int nValidVoteTally[3]; // only the votes currently counted (fValid)
+
+    void TallyVote(const CBudgetVote& vote, int nDelta);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -482,20 +521,23 @@ public:
 
     void Calculate();
     bool AddOrUpdateVote(CBudgetVote& vote, std::string& strError);
+    void RecountVotes();
     bool HasMinimumRequiredSupport();
     std::pair<std::string, std::string> GetVotes();
 
     bool IsValid(std::string& strError, bool fCheckCollateral = true);
 
-    bool IsEstablished()
+    int64_t GetEstablishedTime()
     {
         // Proposals must be at least a day old to make it into a budget
-        if (Params().NetworkID() == CBaseChainParams::MAIN) return (nTime < GetTime() - (60 * 60 * 24));
+        if (Params().NetworkID() == CBaseChainParams::MAIN) return nTime + (60 * 60 * 24);
 
         // For testing purposes - 5 minutes
-        return (nTime < GetTime() - (60 * 5));
+        return nTime + (60 * 5);
     }
 
+    bool IsEstablished() { return GetEstablishedTime() < GetTime(); }
+
     std::string GetName() { return strProposalName; }
     std::string GetURL() { return strURL; }
     int GetBlockStart() { return nBlockStart; }
@@ -514,7 +556,7 @@ public:
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
 
-    void CleanAndRemove(bool fSignatureCheck);
+    bool CleanAndRemove(bool fSignatureCheck);
 
     uint256 GetHash()
     {
@@ -548,6 +590,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -576,6 +620,8 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        first.RecountVotes();
+        second.RecountVotes();
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -16,6 +16,7 @@
 #include "sync.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "validationinterface.h"
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -25,126 +26,67 @@ CMasternodePayments masternodePayments;
 CCriticalSection cs_vecPayments;
 CCriticalSection cs_mapMasternodeBlocks;
 CCriticalSection cs_mapMasternodePayeeVotes;
+CCriticalSection cs_mapPendingWinners;
 
 //
 // CMasternodePaymentDB
 //
 
-CMasternodePaymentDB::CMasternodePaymentDB()
+CMasternodePaymentDB masternodePaymentsDB;
+
+CMasternodePaymentDB::CMasternodePaymentDB() : CRecordDB("mnpayments.dat", "MasternodePaymentsRecords")
 {
-    pathDB = GetDataDir() / "mnpayments.dat";
-    strMagicMessage = "MasternodePayments";
 }
 
 bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 {
-    int64_t nStart = GetTimeMillis();
+    CRecordBatch batch;
+    {
+        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+        batch.WriteMap(RECORD_PAYEE_VOTE, objToSave.mapMasternodePayeeVotes);
+        for (std::map<int, CMasternodeBlockPayees>::const_iterator it = objToSave.mapMasternodeBlocks.begin(); it != objToSave.mapMasternodeBlocks.end(); ++it)
+            batch.Write(RECORD_BLOCK_PAYEES, uint256(it->first), it->second);
     }
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
+    return WriteRecords(batch);
 }
 
-CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
+CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad)
 {
-    int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
+    // block payees are keyed by height, so the ones CleanPaymentList() would
+    // throw away are skipped without being deserialized
+    int nMinHeight = 0;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != NULL)
+            nMinHeight = chainActive.Tip()->nHeight - objToLoad.GetStorageLimit();
     }
 
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode payement cache magic message", __func__);
-            return IncorrectMagicMessage;
+    ReadResult result = ReadRecords([&objToLoad, nMinHeight](unsigned char nRecordType, const uint256& key, CDataStream& ssValue) {
+        switch (nRecordType) {
+        case RECORD_PAYEE_VOTE:
+            ReadMapRecord(ssValue, objToLoad.mapMasternodePayeeVotes, key);
+            break;
+        case RECORD_BLOCK_PAYEES: {
+            int nBlockHeight = (int)key.GetLow64();
+            if (nBlockHeight >= nMinHeight)
+                ReadMapRecord(ssValue, objToLoad.mapMasternodeBlocks, nBlockHeight);
+            break;
         }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
         }
+    });
 
-        // de-serialize data into CMasternodePayments object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
-    }
+    if (result != Ok)
+        return result;
 
-    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("masternode","Masternode payments manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
+    LogPrint("masternode","Masternode payments manager - cleaning....\n");
+    objToLoad.CleanPaymentList();
+    LogPrint("masternode","Masternode payments manager - result:\n");
+    LogPrint("masternode","  %s\n", objToLoad.ToString());
 
     return Ok;
 }
@@ -153,27 +95,10 @@ void DumpMasternodePayments()
 {
     int64_t nStart = GetTimeMillis();
 
-    CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint("masternode","Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint("masternode","Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint("masternode","Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("masternode","Writting info to mnpayments.dat...\n");
-    paymentdb.Write(masternodePayments);
+    masternodePaymentsDB.Write(masternodePayments);
 
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Masternode payments dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
@@ -512,87 +437,171 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
             nHeight = chainActive.Tip()->nHeight;
         }
 
-        //////////////////////////////////////////////// vvvvv ////////////////////////////////////////
-
-        CTxDestination address1;
-        ExtractDestination(winner.payee, address1);
-        CBitcoinAddress address2(address1);
+        bool fSeen;
+        {
+            LOCK(cs_mapMasternodePayeeVotes);
+            fSeen = masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash());
+        }
 
-        auto winnerMasternode = mnodeman.Find(winner.payee);
+        if (fSeen) {
+            LogPrint("mnpayments", "mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
+            masternodeSync.AddedMasternodeWinner(winner.GetHash());
+            return;
+        }
 
-        if (!winnerMasternode) {
-            LogPrintf("mnw - Unknown payee %s\n", address2.ToString().c_str());
+        if (winner.nBlockHeight > nHeight + 20) {
+            LogPrintf("mnw - winner out of range - Height %d bestHeight %d\n", winner.nBlockHeight, nHeight);
             return;
         }
 
-        LogPrintf("CMasternodePayments::ProcessMessageMasternodePayments() WINNER_ADDRESS=%s WINNER_DEPOSIT=%s WINNER_TIER=%d \nWINNER_MASTERNODE=%s\n", address2.ToString().c_str(), FormatMoney(winnerMasternode->deposit).c_str(), winnerMasternode->mnTier(), winnerMasternode->ToString());
+        // votes for upcoming blocks are verified right away, votes for past blocks
+        // (mostly from syncing) are verified in batches
+        masternodePayments.QueueWinner(pfrom, winner, winner.nBlockHeight > nHeight);
+    }
+}
 
-        CTransaction prevoutTx;
-        uint256 hashBlock = 0;
-        bool vinValid =  GetMasternodeTransaction(winnerMasternode, prevoutTx, hashBlock);
+// Tier of the masternode paid by a vote, UNKNOWN if it or its collateral can't be found
+static unsigned GetPayeeTier(const CScript& payee)
+{
+    CTxDestination address1;
+    ExtractDestination(payee, address1);
+    CBitcoinAddress address2(address1);
 
-        if (!vinValid) {
-            LogPrintf("CMasternodePayments::ProcessMessageMasternodePayments() vinValid=%d\n", vinValid);
-            return;
-        }
+    CMasternode* winnerMasternode = mnodeman.Find(payee);
 
-        if (winnerMasternode->mnTier() == CMasternode::nodeTier::UNKNOWN) {
-            LogPrintf("mnw - Masternode tier is UNKNOWN!!! Exiting...\n");
-            return;
-        }
+    if (!winnerMasternode) {
+        LogPrintf("mnw - Unknown payee %s\n", address2.ToString().c_str());
+        return CMasternode::nodeTier::UNKNOWN;
+    }
 
-        //////////////////////////////////////////////// ^^^^^ ////////////////////////////////////////
+    LogPrint("mnpayments", "GetPayeeTier() WINNER_ADDRESS=%s WINNER_DEPOSIT=%s WINNER_TIER=%d \nWINNER_MASTERNODE=%s\n", address2.ToString().c_str(), FormatMoney(winnerMasternode->deposit).c_str(), winnerMasternode->mnTier(), winnerMasternode->ToString());
 
-        winner.payeeTier = winnerMasternode->mnTier();
+    CTransaction prevoutTx;
+    uint256 hashBlock = 0;
+    bool vinValid;
+    {
+        LOCK(cs_main);
+        vinValid = GetMasternodeTransaction(winnerMasternode, prevoutTx, hashBlock);
+    }
 
-        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) {
-            LogPrintf("mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
-            masternodeSync.AddedMasternodeWinner(winner.GetHash());
-            return;
-        }
+    if (!vinValid) {
+        LogPrintf("GetPayeeTier() vinValid=%d\n", vinValid);
+        return CMasternode::nodeTier::UNKNOWN;
+    }
 
-        std::string strError = "";
-        if (!winner.IsValid(pfrom, strError)) {
-            if(strError != "") {
-                LogPrintf("mnw - invalid message 1 - %s\n", strError);
-            }
-            return;
-        }
+    if (winnerMasternode->mnTier() == CMasternode::nodeTier::UNKNOWN)
+        LogPrintf("mnw - Masternode tier is UNKNOWN!!! Exiting...\n");
 
-        int nFirstBlock = nHeight - (mnodeman.CountEnabled(winner.payeeTier) / 100 * 125);
-        if (winner.nBlockHeight < nFirstBlock || winner.nBlockHeight > nHeight + 20) {
-            LogPrintf("mnw - winner out of range - FirstBlock %d Height %d bestHeight %d\n", nFirstBlock, winner.nBlockHeight, nHeight);
-            return;
+    return winnerMasternode->mnTier();
+}
+
+void CMasternodePayments::QueueWinner(CNode* pfrom, CMasternodePaymentWinner& winner, bool fFlush)
+{
+    {
+        LOCK(cs_mapPendingWinners);
+
+        // the same vote relayed by several peers is only verified once
+        std::map<uint256, std::pair<CMasternodePaymentWinner, CNode*> >& mapHeight = mapPendingWinners[winner.nBlockHeight];
+        uint256 hash = winner.GetHash();
+        if (!mapHeight.count(hash)) {
+            mapHeight.insert(make_pair(hash, make_pair(winner, pfrom->AddRef())));
+            nPendingWinners++;
         }
 
-        if (!winner.IsValid(pfrom, strError)) {
-            if(strError != "") {
-                LogPrintf("mnw - invalid message 2 - %s\n", strError);
+        if (nPendingWinners >= MNPAYMENTS_BATCH_SIZE) fFlush = true;
+    }
+
+    if (fFlush) ProcessPendingWinners();
+}
+
+void CMasternodePayments::ProcessPendingWinners()
+{
+    std::map<int, std::map<uint256, std::pair<CMasternodePaymentWinner, CNode*> > > mapPending;
+    {
+        LOCK(cs_mapPendingWinners);
+        mapPending.swap(mapPendingWinners);
+        nPendingWinners = 0;
+    }
+
+    if (mapPending.empty()) return;
+
+    int nHeight = -1;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != NULL) nHeight = chainActive.Tip()->nHeight;
+    }
+
+    // payee lookups (which read the collateral from disk) and masternode counts are shared by the whole batch
+    std::map<CScript, unsigned> mapPayeeTier;
+    std::map<unsigned, int> mapEnabled;
+    std::vector<CMasternodePaymentWinner> vAccepted;
+    std::vector<CNode*> vNodesToRelease;
+
+    for (auto& pendingHeight : mapPending) {
+        // all votes for a block are ranked against the same list
+        std::map<COutPoint, int> mapRanks;
+        if (nHeight != -1) mapRanks = mnodeman.GetMasternodeRankMap(pendingHeight.first - 100, ActiveProtocol());
+
+        for (auto& pending : pendingHeight.second) {
+            CMasternodePaymentWinner& winner = pending.second.first;
+            CNode* pfrom = pending.second.second;
+            vNodesToRelease.push_back(pfrom);
+
+            if (nHeight == -1) continue;
+
+            auto itTier = mapPayeeTier.find(winner.payee);
+            if (itTier == mapPayeeTier.end())
+                itTier = mapPayeeTier.insert(make_pair(winner.payee, GetPayeeTier(winner.payee))).first;
+            if (itTier->second == CMasternode::nodeTier::UNKNOWN) continue;
+
+            winner.payeeTier = itTier->second;
+
+            if (!mapEnabled.count(winner.payeeTier)) mapEnabled[winner.payeeTier] = mnodeman.CountEnabled(winner.payeeTier);
+            int nFirstBlock = nHeight - (mapEnabled[winner.payeeTier] / 100 * 125);
+            if (winner.nBlockHeight < nFirstBlock || winner.nBlockHeight > nHeight + 20) {
+                LogPrintf("mnw - winner out of range - FirstBlock %d Height %d bestHeight %d\n", nFirstBlock, winner.nBlockHeight, nHeight);
+                continue;
             }
-            return;
-        }
 
-        if (!masternodePayments.CanVote(winner.vinMasternode.prevout, winner.nBlockHeight, winner.payeeTier)) {
-            LogPrintf("mnw - masternode already voted - %s\n", winner.vinMasternode.prevout.ToStringShort());
-            return;
-        }
+            auto itRank = mapRanks.find(winner.vinMasternode.prevout);
+            std::string strError = "";
+            if (!winner.IsValid(pfrom, itRank == mapRanks.end() ? -1 : itRank->second, strError)) {
+                if (strError != "") {
+                    LogPrintf("mnw - invalid message - %s\n", strError);
+                }
+                continue;
+            }
 
-        if (!winner.SignatureValid()) {
-            if (masternodeSync.IsSynced()) {
-                LogPrintf("MISBEHAVING: !winner.SignatureValid() and masternodeSync.IsSynced()\n");
-                Misbehaving(pfrom->GetId(), 20);
+            if (!winner.SignatureValid()) {
+                if (masternodeSync.IsSynced()) {
+                    LogPrintf("MISBEHAVING: !winner.SignatureValid() and masternodeSync.IsSynced()\n");
+                    Misbehaving(pfrom->GetId(), 20);
+                }
+                // it could just be a non-synced masternode
+                mnodeman.AskForMN(pfrom, winner.vinMasternode);
+                continue;
             }
-            // it could just be a non-synced masternode
-            mnodeman.AskForMN(pfrom, winner.vinMasternode);
-            return;
-        }
 
-        if (masternodePayments.AddWinningMasternode(winner)) {
-            LogPrintf("Relaying winner... mnw - Addr %s Height %d bestHeight %d - %s\n", address2.ToString().c_str(), winner.nBlockHeight, nHeight, winner.vinMasternode.prevout.ToStringShort());
-            winner.Relay();
-            masternodeSync.AddedMasternodeWinner(winner.GetHash());
+            // only now that the signature checked out, count it as this masternode's vote
+            if (!CanVote(winner.vinMasternode.prevout, winner.nBlockHeight, winner.payeeTier)) {
+                LogPrintf("mnw - masternode already voted - %s\n", winner.vinMasternode.prevout.ToStringShort());
+                continue;
+            }
+
+            vAccepted.push_back(winner);
         }
     }
+
+    AddWinningMasternodes(vAccepted);
+
+    for (CMasternodePaymentWinner& winner : vAccepted) {
+        LogPrint("mnpayments", "Relaying winner... mnw - Height %d bestHeight %d - %s\n", winner.nBlockHeight, nHeight, winner.vinMasternode.prevout.ToStringShort());
+        winner.Relay();
+        masternodeSync.AddedMasternodeWinner(winner.GetHash());
+    }
+
+    for (CNode* pnode : vNodesToRelease)
+        pnode->Release();
 }
 
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
@@ -661,29 +670,57 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
 
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
 {
-    uint256 blockHash = 0;
-    if (!GetBlockHash(blockHash, winnerIn.nBlockHeight - 100)) {
-        return false;
+    std::vector<CMasternodePaymentWinner> vWinners(1, winnerIn);
+    return AddWinningMasternodes(vWinners) > 0;
+}
+
+int CMasternodePayments::AddWinningMasternodes(std::vector<CMasternodePaymentWinner>& vWinners)
+{
+    // votes are only accepted for blocks whose ranking block is known
+    std::set<int> setKnownHeights;
+    for (const CMasternodePaymentWinner& winner : vWinners) {
+        uint256 blockHash = 0;
+        if (!setKnownHeights.count(winner.nBlockHeight) && GetBlockHash(blockHash, winner.nBlockHeight - 100))
+            setKnownHeights.insert(winner.nBlockHeight);
     }
 
+    std::vector<CMasternodePaymentWinner> vAdded;
     {
         LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-        if (mapMasternodePayeeVotes.count(winnerIn.GetHash())) {
-            return false;
-        }
+        // payee vote counts are updated once per block and payee
+        std::map<int, std::map<std::pair<unsigned, CScript>, int> > mapIncrements;
+
+        for (CMasternodePaymentWinner& winner : vWinners) {
+            if (!setKnownHeights.count(winner.nBlockHeight)) continue;
+
+            uint256 hash = winner.GetHash();
+            if (mapMasternodePayeeVotes.count(hash)) continue;
+
+            mapMasternodePayeeVotes[hash] = winner;
 
-        mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+            if (!mapMasternodeBlocks.count(winner.nBlockHeight)) {
+                CMasternodeBlockPayees blockPayees(winner.nBlockHeight);
+                mapMasternodeBlocks[winner.nBlockHeight] = blockPayees;
+            }
+
+            mapIncrements[winner.nBlockHeight][make_pair(winner.payeeTier, winner.payee)]++;
+            vAdded.push_back(winner);
+        }
 
-        if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
-            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
+        for (const auto& blockIncrements : mapIncrements) {
+            CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[blockIncrements.first];
+            for (const auto& increment : blockIncrements.second)
+                blockPayees.AddPayee(increment.first.first, increment.first.second, increment.second);
         }
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payeeTier, winnerIn.payee, 1);
+    // listeners are told outside the vote locks
+    for (const CMasternodePaymentWinner& winner : vAdded)
+        GetMainSignals().NotifyMasternodeWinner(winner);
 
-    return true;
+    vWinners.swap(vAdded);
+    return vWinners.size();
 }
 
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
@@ -786,6 +823,12 @@ bool CMasternodePayments::IsTransactionValid(const CTransaction& txNew, int nBlo
     return true;
 }
 
+int CMasternodePayments::GetStorageLimit()
+{
+    //keep up to five cycles for historical sake
+    return std::max(int(mnodeman.size() * 1.25), 1000);
+}
+
 void CMasternodePayments::CleanPaymentList()
 {
     LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
@@ -797,8 +840,7 @@ void CMasternodePayments::CleanPaymentList()
         nHeight = chainActive.Tip()->nHeight;
     }
 
-    //keep up to five cycles for historical sake
-    int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
+    int nLimit = GetStorageLimit();
 
     std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
@@ -806,16 +848,40 @@ void CMasternodePayments::CleanPaymentList()
 
         if (nHeight - winner.nBlockHeight > nLimit) {
             LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
+            masternodeSync.RemovedMasternodeWinner((*it).first);
             mapMasternodePayeeVotes.erase(it++);
             mapMasternodeBlocks.erase(winner.nBlockHeight);
         } else {
             ++it;
         }
     }
+
+    std::map<uint256, int>::iterator itLastVote = mapMasternodesLastVote.begin();
+    while (itLastVote != mapMasternodesLastVote.end()) {
+        if (nHeight - (*itLastVote).second > nLimit)
+            mapMasternodesLastVote.erase(itLastVote++);
+        else
+            ++itLastVote;
+    }
+
+    LOCK(cs_mapPendingWinners);
+
+    // queued votes that fell out of the window are dropped unverified
+    auto itPending = mapPendingWinners.begin();
+    while (itPending != mapPendingWinners.end() && nHeight - itPending->first > nLimit) {
+        for (auto& pending : itPending->second)
+            pending.second.second->Release();
+        nPendingWinners -= itPending->second.size();
+        mapPendingWinners.erase(itPending++);
+    }
 }
 
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
+{
+    return IsValid(pnode, mnodeman.GetMasternodeRank(vinMasternode, nBlockHeight - 100, ActiveProtocol()), strError);
+}
+
+bool CMasternodePaymentWinner::IsValid(CNode* pnode, int nRank, std::string& strError)
 {
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
@@ -832,7 +898,7 @@ bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
         return false;
     }
 
-    int n = mnodeman.GetMasternodeRank(vinMasternode, nBlockHeight - 100, ActiveProtocol());
+    int n = nRank;
 
     if (n > MNPAYMENTS_SIGNATURES_TOTAL) {
         //It's common to have masternodes mistakenly think they are in the top 10
@@ -9,6 +9,7 @@
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
+#include "recorddb.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -16,6 +17,7 @@ using namespace std;
 extern CCriticalSection cs_vecPayments;
 extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
+extern CCriticalSection cs_mapPendingWinners;
 
 class CMasternodePayments;
 class CMasternodePaymentWinner;
@@ -25,6 +27,7 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+#define MNPAYMENTS_BATCH_SIZE 100
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -37,28 +40,21 @@ void DumpMasternodePayments();
 
 /** Save Masternode Payment Data (mnpayments.dat)
  */
-class CMasternodePaymentDB
+class CMasternodePaymentDB : public CRecordDB
 {
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
+    enum RecordType {
+        RECORD_PAYEE_VOTE = 1,
+        RECORD_BLOCK_PAYEES
     };
 
     CMasternodePaymentDB();
     bool Write(const CMasternodePayments& objToSave);
-    ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
+    ReadResult Read(CMasternodePayments& objToLoad);
 };
 
+extern CMasternodePaymentDB masternodePaymentsDB;
+
 class CMasternodePayee
 {
 public:
@@ -219,6 +215,7 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
+    bool IsValid(CNode* pnode, int nRank, std::string& strError);
     bool SignatureValid();
     void Relay();
 
@@ -256,6 +253,10 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // payment votes waiting to be verified as a batch, by block height and vote hash
+    std::map<int, std::map<uint256, std::pair<CMasternodePaymentWinner, CNode*> > > mapPendingWinners;
+    int nPendingWinners;
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -265,6 +266,7 @@ public:
     {
         nSyncedFromPeer = 0;
         nLastBlockHeight = 0;
+        nPendingWinners = 0;
     }
 
     void Clear()
@@ -275,9 +277,17 @@ public:
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
+    /// Add a batch of verified votes, vWinners is left with the ones that were new
+    int AddWinningMasternodes(std::vector<CMasternodePaymentWinner>& vWinners);
+
+    /// Queue a payment vote for verification, fFlush verifies the queue right away
+    void QueueWinner(CNode* pfrom, CMasternodePaymentWinner& winner, bool fFlush);
+    /// Verify, add and relay the queued payment votes
+    void ProcessPendingWinners();
     bool ProcessBlock(int nBlockHeight);
 
     void Sync(CNode* node, int nCountNeeded);
+    int GetStorageLimit();
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
 
@@ -19,6 +19,17 @@
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
+std::vector<bool> CSyncDigest::GetDifferingBuckets(const CSyncDigest& other) const
+{
+    std::vector<bool> vDiffer(BUCKETS, true);
+    if (other.vBuckets.size() != BUCKETS) return vDiffer;
+
+    for (unsigned int i = 0; i < BUCKETS; i++)
+        vDiffer[i] = vBuckets[i] != other.vBuckets[i];
+
+    return vDiffer;
+}
+
 CMasternodeSync::CMasternodeSync()
 {
     Reset();
@@ -62,6 +73,7 @@ bool CMasternodeSync::IsBlockchainSynced()
 
 void CMasternodeSync::Reset()
 {
+    LOCK(cs);
     lastMasternodeList = 0;
     lastMasternodeWinner = 0;
     lastBudgetItem = 0;
@@ -83,8 +95,16 @@ void CMasternodeSync::Reset()
     nAssetSyncStarted = GetTime();
 }
 
+void CMasternodeSync::AssetSynced()
+{
+    LOCK(cs);
+    mapAssetSynced[RequestedMasternodeAssets] = GetTime();
+    GetNextAsset();
+}
+
 void CMasternodeSync::AddedMasternodeList(uint256 hash)
 {
+    LOCK(cs);
     if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
         if (mapSeenSyncMNB[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeList = GetTime();
@@ -98,6 +118,7 @@ void CMasternodeSync::AddedMasternodeList(uint256 hash)
 
 void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 {
+    LOCK(cs);
     if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
         if (mapSeenSyncMNW[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeWinner = GetTime();
@@ -111,6 +132,7 @@ void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 
 void CMasternodeSync::AddedBudgetItem(uint256 hash)
 {
+    LOCK(cs);
     if (budget.mapSeenMasternodeBudgetProposals.count(hash) || budget.mapSeenMasternodeBudgetVotes.count(hash) ||
         budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash)) {
         if (mapSeenSyncBudget[hash] < MASTERNODE_SYNC_THRESHOLD) {
@@ -123,6 +145,18 @@ void CMasternodeSync::AddedBudgetItem(uint256 hash)
     }
 }
 
+void CMasternodeSync::RemovedMasternodeList(uint256 hash)
+{
+    LOCK(cs);
+    mapSeenSyncMNB.erase(hash);
+}
+
+void CMasternodeSync::RemovedMasternodeWinner(uint256 hash)
+{
+    LOCK(cs);
+    mapSeenSyncMNW.erase(hash);
+}
+
 bool CMasternodeSync::IsBudgetPropEmpty()
 {
     return sumBudgetItemProp == 0 && countBudgetItemProp > 0;
@@ -135,6 +169,7 @@ bool CMasternodeSync::IsBudgetFinEmpty()
 
 void CMasternodeSync::GetNextAsset()
 {
+    LOCK(cs);
     switch (RequestedMasternodeAssets) {
     case (MASTERNODE_SYNC_INITIAL):
     case (MASTERNODE_SYNC_FAILED): // should never be used here actually, use Reset() instead
@@ -157,6 +192,13 @@ void CMasternodeSync::GetNextAsset()
     }
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+
+    // resume after the assets that finished recently instead of fetching them again
+    if (RequestedMasternodeAssets != MASTERNODE_SYNC_FINISHED && mapAssetSynced.count(RequestedMasternodeAssets) &&
+        mapAssetSynced[RequestedMasternodeAssets] + MASTERNODE_SYNC_RESUME_SECONDS > GetTime()) {
+        LogPrint("masternode", "CMasternodeSync::GetNextAsset - asset %d synced recently, skipping\n", RequestedMasternodeAssets);
+        GetNextAsset();
+    }
 }
 
 std::string CMasternodeSync::GetSyncStatus()
@@ -187,6 +229,7 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         int nCount;
         vRecv >> nItemID >> nCount;
 
+        LOCK(cs);
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
         //this means we will receive no further communication
@@ -213,6 +256,12 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             break;
         }
 
+        // a digest sync that finds nothing to send means we are already up to date
+        if (nCount == 0 && pfrom->nVersion >= MNSYNC_DIGEST_VERSION) {
+            if (nItemID == MASTERNODE_SYNC_LIST) lastMasternodeList = GetTime();
+            if (nItemID == MASTERNODE_SYNC_BUDGET_PROP || nItemID == MASTERNODE_SYNC_BUDGET_FIN) lastBudgetItem = GetTime();
+        }
+
         LogPrint("masternode", "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
     }
 }
@@ -241,6 +290,10 @@ void CMasternodeSync::Process()
             Resync if we lose all masternodes from sleep/wake or failure to sync originally
         */
         if (mnodeman.CountEnabled(CMasternode::nodeTier::MASTERNODE) == 0 && mnodeman.CountEnabled(CMasternode::nodeTier::SUPERNODE) == 0) {
+            {
+                LOCK(cs);
+                mapAssetSynced.clear();
+            }
             Reset();
         } else {
             return;
@@ -299,7 +352,7 @@ void CMasternodeSync::Process()
             if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
                 LogPrint("masternode", "CMasternodeSync::Process() - lastMasternodeList %lld (GetTime() - MASTERNODE_SYNC_TIMEOUT) %lld\n", lastMasternodeList, GetTime() - MASTERNODE_SYNC_TIMEOUT);
                 if (lastMasternodeList > 0 && lastMasternodeList < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
+                    AssetSynced();
                     return;
                 }
 
@@ -330,7 +383,7 @@ void CMasternodeSync::Process()
 
             if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
                 if (lastMasternodeWinner > 0 && lastMasternodeWinner < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
+                    AssetSynced();
                     return;
                 }
 
@@ -373,7 +426,7 @@ void CMasternodeSync::Process()
                 if (lastBudgetItem > 0 && lastBudgetItem < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) {
 
                     // Hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
+                    AssetSynced();
 
                     // Try to activate our masternode if possible
                     activeMasternode.ManageStatus();
@@ -395,8 +448,7 @@ void CMasternodeSync::Process()
 
                 if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
 
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync masternode votes
+                budget.RequestSync(pnode); //sync masternode votes
                 RequestedMasternodeAttempt++;
 
                 return;
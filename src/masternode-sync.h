@@ -6,6 +6,13 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
 #define MASTERNODE_SYNC_LIST 2
@@ -18,16 +25,55 @@
 
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
+#define MASTERNODE_SYNC_RESUME_SECONDS (30 * 60)
 
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
 
+//
+// CSyncDigest : Compact summary of a set of inventory hashes
+//
+// Hashes are spread over a fixed number of buckets, each bucket holds the xor of its
+// members. Two peers comparing digests only need to exchange the items of the buckets
+// that differ.
+//
+
+class CSyncDigest
+{
+public:
+    static const unsigned int BUCKETS = 256;
+
+    std::vector<uint64_t> vBuckets;
+
+    CSyncDigest() : vBuckets(BUCKETS, 0) {}
+
+    static unsigned int GetBucket(const uint256& hash) { return hash.Get64(0) % BUCKETS; }
+
+    void Add(const uint256& hash) { vBuckets[GetBucket(hash)] ^= hash.Get64(1); }
+
+    /// Buckets whose content differs from other, all of them if other is malformed
+    std::vector<bool> GetDifferingBuckets(const CSyncDigest& other) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vBuckets);
+    }
+};
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
 
 class CMasternodeSync
 {
+private:
+    // critical section to protect the inner data structures, the masternode, budget,
+    // payments and sync handlers update them from different message handler threads
+    mutable CCriticalSection cs;
+
 public:
     std::map<uint256, int> mapSeenSyncMNB;
     std::map<uint256, int> mapSeenSyncMNW;
@@ -57,12 +103,18 @@ public:
     // Time when current masternode asset sync started
     int64_t nAssetSyncStarted;
 
+    // Time each asset last finished syncing, a retry skips the ones that are still recent
+    std::map<int, int64_t> mapAssetSynced;
+
     CMasternodeSync();
 
     void AddedMasternodeList(uint256 hash);
     void AddedMasternodeWinner(uint256 hash);
     void AddedBudgetItem(uint256 hash);
+    void RemovedMasternodeList(uint256 hash);
+    void RemovedMasternodeWinner(uint256 hash);
     void GetNextAsset();
+    void AssetSynced();
     std::string GetSyncStatus();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     bool IsBudgetFinEmpty();
@@ -9,6 +9,7 @@
 #include "obfuscation.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 #include <boost/lexical_cast.hpp>
 
 // keep track of the scanning errors I've seen
@@ -605,6 +606,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
         if (pmn->UpdateFromNewBroadcast((*this))) {
             pmn->Check();
             if (pmn->IsEnabled()) Relay();
+            GetMainSignals().NotifyMasternodeBroadcast(*this);
         }
         masternodeSync.AddedMasternodeList(GetHash());
     }
@@ -643,7 +645,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
         if (!lockMain) {
             // not mnb fault, let it to be checked again later
             mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
-            masternodeSync.mapSeenSyncMNB.erase(GetHash());
+            masternodeSync.RemovedMasternodeList(GetHash());
             return false;
         }
 
@@ -661,7 +663,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
         LogPrint("masternode", "mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
         // maybe we miss few blocks, let this mnb to be checked again later
         mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
-        masternodeSync.mapSeenSyncMNB.erase(GetHash());
+        masternodeSync.RemovedMasternodeList(GetHash());
         return false;
     }
 
@@ -684,6 +686,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
     LogPrint("masternode", "mnb - Got NEW Masternode entry - %s - %lli \n", vin.prevout.hash.ToString(), sigTime);
     CMasternode mn(*this);
     mnodeman.Add(mn);
+    GetMainSignals().NotifyMasternodeBroadcast(*this);
 
     // if it matches our Masternode privkey, then we've been remotely activated
     if (pubKeyMasternode == activeMasternode.pubKeyMasternode && protocolVersion == PROTOCOL_VERSION) {
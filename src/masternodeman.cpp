@@ -6,6 +6,7 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "masternode.h"
+#include "masternode-sync.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "spork.h"
@@ -46,122 +47,78 @@ struct CompareScoreMN {
 // CMasternodeDB
 //
 
-CMasternodeDB::CMasternodeDB()
+CMasternodeDB mnodemanDB;
+
+CMasternodeDB::CMasternodeDB() : CRecordDB("mncache.dat", "MasternodeCacheRecords")
 {
-    pathMN = GetDataDir() / "mncache.dat";
-    strMagicMessage = "MasternodeCache";
 }
 
 bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
-    int64_t nStart = GetTimeMillis();
+    CRecordBatch batch;
+    {
+        LOCK(mnodemanToSave.cs);
+
+        BOOST_FOREACH (const CMasternode& mn, mnodemanToSave.vMasternodes)
+            batch.Write(RECORD_MASTERNODE, SerializeHash(mn.vin.prevout), mn);
+        batch.Write(RECORD_ASKED_US_FOR_LIST, 0, mnodemanToSave.mAskedUsForMasternodeList);
+        batch.Write(RECORD_WE_ASKED_FOR_LIST, 0, mnodemanToSave.mWeAskedForMasternodeList);
+        batch.Write(RECORD_WE_ASKED_FOR_ENTRY, 0, mnodemanToSave.mWeAskedForMasternodeListEntry);
+        batch.Write(RECORD_DSQ_COUNT, 0, mnodemanToSave.nDsqCount);
+        batch.WriteMap(RECORD_SEEN_BROADCAST, mnodemanToSave.mapSeenMasternodeBroadcast);
+        batch.WriteMap(RECORD_SEEN_PING, mnodemanToSave.mapSeenMasternodePing);
+    }
+
+    if (!WriteRecords(batch))
+        return false;
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
-
-    LogPrint("masternode", "Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode", "  %s\n", mnodemanToSave.ToString());
 
     return true;
 }
 
-CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
+CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
 {
-    int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathMN.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathMN);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssMasternodes(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-
-        ssMasternodes >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
+    LOCK(mnodemanToLoad.cs);
+
+    ReadResult result = ReadRecords([&mnodemanToLoad](unsigned char nRecordType, const uint256& key, CDataStream& ssValue) {
+        switch (nRecordType) {
+        case RECORD_MASTERNODE: {
+            CMasternode mn;
+            ssValue >> mn;
+            mnodemanToLoad.vMasternodes.push_back(mn);
+            mnodemanToLoad.nListVersion++;
+            break;
         }
-
-        // de-serialize file header (network specific magic number) and ..
-        ssMasternodes >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
+        case RECORD_ASKED_US_FOR_LIST:
+            ReadRecord(ssValue, mnodemanToLoad.mAskedUsForMasternodeList);
+            break;
+        case RECORD_WE_ASKED_FOR_LIST:
+            ReadRecord(ssValue, mnodemanToLoad.mWeAskedForMasternodeList);
+            break;
+        case RECORD_WE_ASKED_FOR_ENTRY:
+            ReadRecord(ssValue, mnodemanToLoad.mWeAskedForMasternodeListEntry);
+            break;
+        case RECORD_DSQ_COUNT:
+            ReadRecord(ssValue, mnodemanToLoad.nDsqCount);
+            break;
+        case RECORD_SEEN_BROADCAST:
+            ReadMapRecord(ssValue, mnodemanToLoad.mapSeenMasternodeBroadcast, key);
+            break;
+        case RECORD_SEEN_PING:
+            ReadMapRecord(ssValue, mnodemanToLoad.mapSeenMasternodePing, key);
+            break;
         }
-        // de-serialize data into CMasternodeMan object
-        ssMasternodes >> mnodemanToLoad;
-    } catch (std::exception& e) {
-        mnodemanToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
-    }
+    });
+
+    if (result != Ok)
+        return result;
 
-    LogPrint("masternode", "Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode", "  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode", "Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint("masternode", "Masternode manager - result:\n");
-        LogPrint("masternode", "  %s\n", mnodemanToLoad.ToString());
-    }
+    LogPrint("masternode", "Masternode manager - cleaning....\n");
+    mnodemanToLoad.CheckAndRemove(true);
+    LogPrint("masternode", "Masternode manager - result:\n");
+    LogPrint("masternode", "  %s\n", mnodemanToLoad.ToString());
 
     return Ok;
 }
@@ -170,25 +127,8 @@ void DumpMasternodes()
 {
     int64_t nStart = GetTimeMillis();
 
-    CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint("masternode", "Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint("masternode", "Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint("masternode", "Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint("masternode", "magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode", "file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("masternode", "Writting info to mncache.dat...\n");
-    mndb.Write(mnodeman);
+    mnodemanDB.Write(mnodeman);
 
     LogPrint("masternode", "Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
@@ -196,6 +136,7 @@ void DumpMasternodes()
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    nListVersion = 1;
 }
 
 CValidationState CMasternodeMan::CheckCollateralInTx(const CTxIn& vin, CMutableTransaction& tx)
@@ -230,6 +171,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        nListVersion++;
         return true;
     }
 
@@ -282,7 +224,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
             while (it3 != mapSeenMasternodeBroadcast.end()) {
                 if ((*it3).second.vin == (*it).vin) {
-                    masternodeSync.mapSeenSyncMNB.erase((*it3).first);
+                    masternodeSync.RemovedMasternodeList((*it3).first);
                     mapSeenMasternodeBroadcast.erase(it3++);
                 } else {
                     ++it3;
@@ -300,6 +242,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -340,7 +283,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     while (it3 != mapSeenMasternodeBroadcast.end()) {
         if ((*it3).second.lastPing.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
             mapSeenMasternodeBroadcast.erase(it3++);
-            masternodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
+            masternodeSync.RemovedMasternodeList((*it3).second.GetHash());
         } else {
             ++it3;
         }
@@ -361,6 +304,7 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    nListVersion++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -490,11 +434,30 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    if (pnode->nVersion >= MNSYNC_DIGEST_VERSION) {
+        // only ask for the entries we don't have yet
+        CSyncDigest digest;
+        GetSyncDigest(digest);
+        pnode->PushMessage("dsegd", digest);
+    } else {
+        pnode->PushMessage("dseg", CTxIn());
+    }
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+void CMasternodeMan::GetSyncDigest(CSyncDigest& digest)
+{
+    LOCK(cs);
+
+    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        if (mn.addr.IsRFC1918()) continue; //local network
+
+        if (mn.IsEnabled())
+            digest.Add(CMasternodeBroadcast(mn).GetHash());
+    }
+}
+
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
@@ -682,7 +645,7 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(unsigned mnTier, int mod, int6
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+std::vector<pair<int64_t, CTxIn> > CMasternodeMan::GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
     std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
@@ -690,7 +653,7 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeScores;
 
     // scan for winner
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
@@ -718,6 +681,13 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
+    return vecMasternodeScores;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores = GetMasternodeScores(nBlockHeight, minProtocol, fOnlyActive);
+
     int rank = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
@@ -729,6 +699,20 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+std::map<COutPoint, int> CMasternodeMan::GetMasternodeRankMap(int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores = GetMasternodeScores(nBlockHeight, minProtocol, fOnlyActive);
+    std::map<COutPoint, int> mapRanks;
+
+    int rank = 0;
+    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
+        rank++;
+        mapRanks.insert(make_pair(s.second.prevout, rank));
+    }
+
+    return mapRanks;
+}
+
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
@@ -887,10 +871,18 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         // we might have to ask for a masternode entry once
         AskForMN(pfrom, mnp.vin);
 
-    } else if (strCommand == "dseg") { //Get Masternode list or specific entry
+    } else if (strCommand == "dseg" || strCommand == "dsegd") { //Get Masternode list, specific entry or the entries missing from a digest
 
         CTxIn vin;
-        vRecv >> vin;
+        std::vector<bool> vDiffer;
+        if (strCommand == "dsegd") {
+            CSyncDigest digestPeer, digest;
+            vRecv >> digestPeer;
+            GetSyncDigest(digest);
+            vDiffer = digest.GetDifferingBuckets(digestPeer);
+        } else {
+            vRecv >> vin;
+        }
 
         if (vin == CTxIn()) { //only should ask for this once
             //local network
@@ -922,6 +914,9 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                 if (vin == CTxIn() || vin == mn.vin) {
                     CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
                     uint256 hash = mnb.GetHash();
+
+                    // the peer already has every entry of this bucket
+                    if (!vDiffer.empty() && !vDiffer[CSyncDigest::GetBucket(hash)]) continue;
                     pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
                     nInvCount++;
 
@@ -951,6 +946,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            nListVersion++;
             break;
         }
         ++it;
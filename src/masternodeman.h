@@ -11,6 +11,7 @@
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
+#include "recorddb.h"
 #include "sync.h"
 #include "util.h"
 
@@ -20,36 +21,37 @@
 using namespace std;
 
 class CMasternodeMan;
+class CSyncDigest;
 
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
 
 /** Access to the MN database (mncache.dat)
  */
-class CMasternodeDB
+class CMasternodeDB : public CRecordDB
 {
-private:
-    boost::filesystem::path pathMN;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
+    enum RecordType {
+        RECORD_MASTERNODE = 1,
+        RECORD_ASKED_US_FOR_LIST,
+        RECORD_WE_ASKED_FOR_LIST,
+        RECORD_WE_ASKED_FOR_ENTRY,
+        RECORD_DSQ_COUNT,
+        RECORD_SEEN_BROADCAST,
+        RECORD_SEEN_PING
     };
 
     CMasternodeDB();
     bool Write(const CMasternodeMan& mnodemanToSave);
-    ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
+    ReadResult Read(CMasternodeMan& mnodemanToLoad);
 };
 
+extern CMasternodeDB mnodemanDB;
+
 class CMasternodeMan
 {
+    friend class CMasternodeDB;
+
 private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -65,6 +67,11 @@ private:
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // bumped whenever a Masternode is added to or removed from vMasternodes
+    unsigned int nListVersion;
+
+    /// Scores of the Masternodes for the block, best first
+    std::vector<pair<int64_t, CTxIn> > GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive);
 
 public:
     // Keep track of all broadcasts I've seen
@@ -111,6 +118,13 @@ public:
     /// Clear Masternode vector
     void Clear();
 
+    /// Changes whenever the set of known Masternodes does
+    unsigned int GetListVersion()
+    {
+        LOCK(cs);
+        return nListVersion;
+    }
+
     int CountEnabled(unsigned mnTier = CMasternode::nodeTier::UNKNOWN, int protocolVersion = -1);
 
     std::map<unsigned, int> CountEnabledByTiers(int protocolVersion = -1);
@@ -119,6 +133,9 @@ public:
 
     void DsegUpdate(CNode* pnode);
 
+    /// Digest of the entries we announce to syncing peers
+    void GetSyncDigest(CSyncDigest& digest);
+
     /// Find an entry
     CMasternode* Find(const CScript& payee);
     CMasternode* Find(const CTxIn& vin);
@@ -141,6 +158,8 @@ public:
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
+    /// Ranks of all Masternodes for the block, as GetMasternodeRank() reports them one by one
+    std::map<COutPoint, int> GetMasternodeRankMap(int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
     void ProcessMasternodeConnections();
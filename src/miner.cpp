@@ -26,7 +26,8 @@
 #include "spork.h"
 
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
+
+#include <limits>
 
 using namespace std;
 
@@ -36,54 +37,321 @@ using namespace std;
 //
 //////////////////////////////////////////////////////////////////////////////
 
+uint64_t nLastBlockTx = 0;
+uint64_t nLastBlockSize = 0;
+int64_t nLastCoinStakeSearchInterval = 0;
+
+// Give up on filling a nearly full block after this many packages in a row didn't fit
+static const int MAX_CONSECUTIVE_FAILURES = 1000;
+
 //
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// The mempool keeps its entries sorted by ancestor fee rate as they come and go,
+// so filling a block is a walk down that index which stops once the block is
+// full, instead of a scan of the whole pool. The transactions picked for a tip
+// are kept and reused as long as neither the tip nor the mempool changed, which
+// is what happens when a template is only refreshed for a new timestamp. Time
+// locks are checked against the clock, so the selection also records the range
+// of lock-time cutoffs that leaves every time-locked transaction it looked at
+// as final, or as non-final, as it found it.
 //
-class COrphan
+class CBlockSelection
 {
 public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+    uint256 hashPrevBlock;
+    unsigned int nTransactionsUpdated;
+    int64_t nLockTimeCutoffMin;
+    int64_t nLockTimeCutoffMax;
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    uint64_t nBlockSize;
+    int nBlockSigOps;
+    CAmount nFees;
+
+    CBlockSelection() : nTransactionsUpdated(0), nLockTimeCutoffMin(std::numeric_limits<int64_t>::min()),
+                        nLockTimeCutoffMax(std::numeric_limits<int64_t>::max()), nBlockSize(1000), nBlockSigOps(100), nFees(0) {}
+
+    /** Whether the time-locked transactions are final at nLockTimeCutoff as they were when selected */
+    bool SameLockTimes(int64_t nLockTimeCutoff) const
     {
+        return nLockTimeCutoff >= nLockTimeCutoffMin && nLockTimeCutoff <= nLockTimeCutoffMax;
     }
 };
 
-uint64_t nLastBlockTx = 0;
-uint64_t nLastBlockSize = 0;
-int64_t nLastCoinStakeSearchInterval = 0;
+// We want to sort transactions by priority in the priority area of the block, so:
+typedef std::pair<double, CTxMemPool::txiter> TxCoinAgePriority;
+class TxCoinAgePriorityCompare
+{
+public:
+    bool operator()(const TxCoinAgePriority& a, const TxCoinAgePriority& b)
+    {
+        if (a.first == b.first)
+            return CTxMemPool::CompareIteratorByHash()(b.second, a.second); // Reverse order to make sort less than
+        return a.first < b.first;
+    }
+};
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
+class CBlockTxSelector
 {
-    bool byFee;
+private:
+    CBlockSelection& selection;
+    CCoinsViewCache view;
+    CTxMemPool::setEntries inBlock;
+    CTxMemPool::setEntries failedTx;
+    const int nHeight;
+    const int64_t nLockTimeCutoff;
+    const unsigned int nBlockMaxSize;
+    const unsigned int nBlockPrioritySize;
+    const unsigned int nBlockMinSize;
+    const bool fPrintPriority;
+
+    bool IsEligible(CTxMemPool::txiter iter);
+    bool AddTx(CTxMemPool::txiter iter, double dPriority, const CFeeRate& feeRate);
 
 public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
-    bool operator()(const TxPriority& a, const TxPriority& b)
+    CBlockTxSelector(CBlockSelection& selectionIn, int nHeightIn, int64_t nLockTimeCutoffIn, unsigned int nBlockMaxSizeIn, unsigned int nBlockPrioritySizeIn, unsigned int nBlockMinSizeIn)
+        : selection(selectionIn), view(pcoinsTip), nHeight(nHeightIn), nLockTimeCutoff(nLockTimeCutoffIn), nBlockMaxSize(nBlockMaxSizeIn),
+          nBlockPrioritySize(nBlockPrioritySizeIn), nBlockMinSize(nBlockMinSizeIn), fPrintPriority(GetBoolArg("-printpriority", false))
     {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
-        }
     }
+
+    /** Fill the area reserved for high-priority transactions, regardless of the fees they pay */
+    void AddPriorityTxs();
+    /** Fill the rest of the block with packages, best ancestor fee rate first */
+    void AddPackageTxs();
 };
 
+bool CBlockTxSelector::IsEligible(CTxMemPool::txiter iter)
+{
+    const CTransaction& tx = iter->GetTx();
+    if (tx.IsCoinBase() || tx.IsCoinStake())
+        return false;
+
+    bool fFinal = IsFinalTx(tx, nHeight, nLockTimeCutoff);
+    if (tx.nLockTime >= LOCKTIME_THRESHOLD) {
+        // final while the cutoff is past the lock time, a later cutoff may finalize it
+        if (fFinal)
+            selection.nLockTimeCutoffMin = std::max(selection.nLockTimeCutoffMin, (int64_t)tx.nLockTime + 1);
+        else
+            selection.nLockTimeCutoffMax = std::min(selection.nLockTimeCutoffMax, (int64_t)tx.nLockTime);
+    }
+    if (!fFinal)
+        return false;
+
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (mapInvalidOutPoints.count(txin.prevout)) {
+            LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CBlockTxSelector::AddTx(CTxMemPool::txiter iter, double dPriority, const CFeeRate& feeRate)
+{
+    const CTransaction& tx = iter->GetTx();
+
+    // Size limits
+    unsigned int nTxSize = iter->GetTxSize();
+    if (selection.nBlockSize + nTxSize >= nBlockMaxSize)
+        return false;
+
+    // Legacy limits on sigOps:
+    unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+    unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+    if (selection.nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+        return false;
+
+    // The mempool already checked the scripts, and TestBlockValidity checks
+    // them again on the finished block, only the inputs are needed here
+    if (!view.HaveInputs(tx))
+        return false;
+
+    nTxSigOps += GetP2SHSigOpCount(tx, view);
+    if (selection.nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+        return false;
+
+    CValidationState state;
+    CTxUndo txundo;
+    UpdateCoins(tx, state, view, txundo, nHeight);
+
+    // Added
+    selection.vtx.push_back(tx);
+    selection.vTxFees.push_back(iter->GetFee());
+    selection.vTxSigOps.push_back(nTxSigOps);
+    selection.nBlockSize += nTxSize;
+    selection.nBlockSigOps += nTxSigOps;
+    selection.nFees += iter->GetFee();
+    inBlock.insert(iter);
+
+    if (fPrintPriority) {
+        LogPrintf("priority %.1f fee %s txid %s\n",
+            dPriority, feeRate.ToString(), tx.GetHash().ToString());
+    }
+    return true;
+}
+
+void CBlockTxSelector::AddPriorityTxs()
+{
+    if (nBlockPrioritySize == 0)
+        return;
+
+    // The priority of an entry at this height is its priority at height 0 plus
+    // the height times its growth, and the pool keeps an index on each part.
+    // Walking both indexes together, an entry not reached on either has both
+    // parts no larger than the ones last reached, so once the best candidate
+    // beats that sum it is the highest priority left and only the entries that
+    // end up in the priority area are looked at. Transactions with parents in
+    // the pool wait for them to be added first.
+    TxCoinAgePriorityCompare comparer;
+    vector<TxCoinAgePriority> vecReady;
+    CTxMemPool::setEntries setSeen;
+    typedef CTxMemPool::indexed_transaction_set::index<priority_base>::type::iterator baseiter;
+    typedef CTxMemPool::indexed_transaction_set::index<priority_growth>::type::iterator growthiter;
+    baseiter miBase = mempool.mapTx.get<priority_base>().begin();
+    baseiter miBaseEnd = mempool.mapTx.get<priority_base>().end();
+    growthiter miGrowth = mempool.mapTx.get<priority_growth>().begin();
+    growthiter miGrowthEnd = mempool.mapTx.get<priority_growth>().end();
+
+    while (true) {
+        while (miBase != miBaseEnd || miGrowth != miGrowthEnd) {
+            if (miBase != miBaseEnd && setSeen.count(mempool.mapTx.project<0>(miBase))) {
+                ++miBase;
+                continue;
+            }
+            if (miGrowth != miGrowthEnd && setSeen.count(mempool.mapTx.project<0>(miGrowth))) {
+                ++miGrowth;
+                continue;
+            }
+            double dThreshold = (miBase != miBaseEnd ? miBase->GetModifiedPriorityBase() : miGrowth->GetModifiedPriorityBase()) +
+                                nHeight * (miGrowth != miGrowthEnd ? miGrowth->GetPriorityGrowth() : miBase->GetPriorityGrowth());
+            if (!vecReady.empty() && vecReady.front().first >= dThreshold)
+                break;
+
+            // Take the next entry from the index whose part contributes the least
+            CTxMemPool::txiter it;
+            if (miGrowth == miGrowthEnd || (miBase != miBaseEnd && miBase->GetModifiedPriorityBase() >= nHeight * miGrowth->GetPriorityGrowth()))
+                it = mempool.mapTx.project<0>(miBase++);
+            else
+                it = mempool.mapTx.project<0>(miGrowth++);
+            setSeen.insert(it);
+            if (mempool.GetMemPoolParents(it).empty()) {
+                vecReady.push_back(TxCoinAgePriority(it->GetModifiedPriority(nHeight), it));
+                std::push_heap(vecReady.begin(), vecReady.end(), comparer);
+            }
+        }
+
+        // Take the highest priority transaction left
+        if (vecReady.empty())
+            break;
+        CTxMemPool::txiter iter = vecReady.front().second;
+        std::pop_heap(vecReady.begin(), vecReady.end(), comparer);
+        vecReady.pop_back();
+
+        double dPriority = iter->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
+
+        // The rest is filled by fee rate once past the priority size or
+        // out of high-priority transactions
+        if (selection.nBlockSize + iter->GetTxSize() >= nBlockPrioritySize || !AllowFree(dPriority))
+            break;
+
+        if (!IsEligible(iter) || !AddTx(iter, dPriority, CFeeRate(iter->GetFee(), iter->GetTxSize())))
+            continue;
+
+        // Children whose parents are all in the block can follow
+        BOOST_FOREACH (CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter)) {
+            bool fParentsAdded = true;
+            BOOST_FOREACH (CTxMemPool::txiter parent, mempool.GetMemPoolParents(child)) {
+                if (!inBlock.count(parent)) {
+                    fParentsAdded = false;
+                    break;
+                }
+            }
+            if (!fParentsAdded)
+                continue;
+            vecReady.push_back(TxCoinAgePriority(child->GetModifiedPriority(nHeight), child));
+            std::push_heap(vecReady.begin(), vecReady.end(), comparer);
+        }
+    }
+}
+
+// Ancestors come before their descendants in the block
+static bool CompareByAncestorCount(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b)
+{
+    return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+}
+
+void CBlockTxSelector::AddPackageTxs()
+{
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    int nConsecutiveFailed = 0;
+
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    for (; mi != mempool.mapTx.get<ancestor_score>().end(); ++mi) {
+        CTxMemPool::txiter iter = mempool.mapTx.project<0>(mi);
+        if (inBlock.count(iter) || failedTx.count(iter))
+            continue;
+
+        // The package is the transaction and whatever of its ancestors isn't in the block yet
+        CTxMemPool::setEntries setAncestors;
+        mempool.CalculateMemPoolAncestors(*iter, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        std::vector<CTxMemPool::txiter> vPackage;
+        uint64_t nPackageSize = iter->GetTxSize();
+        CAmount nPackageFees = iter->GetFee();
+        bool fPrioritised = false;
+        bool fFailed = false;
+        BOOST_FOREACH (CTxMemPool::txiter ancestor, setAncestors) {
+            if (inBlock.count(ancestor))
+                continue;
+            if (failedTx.count(ancestor)) {
+                fFailed = true;
+                break;
+            }
+            vPackage.push_back(ancestor);
+            nPackageSize += ancestor->GetTxSize();
+            nPackageFees += ancestor->GetFee();
+        }
+        vPackage.push_back(iter);
+        if (fFailed) {
+            failedTx.insert(iter);
+            continue;
+        }
+
+        if (selection.nBlockSize + nPackageSize >= nBlockMaxSize) {
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && selection.nBlockSize > nBlockMaxSize - 1000)
+                break; // Give up if we're close to full and haven't succeeded in a while
+            continue;
+        }
+
+        BOOST_FOREACH (CTxMemPool::txiter entry, vPackage) {
+            double dPriorityDelta = 0;
+            CAmount nFeeDelta = 0;
+            mempool.ApplyDeltas(entry->GetTx().GetHash(), dPriorityDelta, nFeeDelta);
+            nPackageFees += nFeeDelta;
+            if (dPriorityDelta > 0 || nFeeDelta > 0 || entry->GetTx().IsZerocoinSpend())
+                fPrioritised = true;
+        }
+
+        // Skip free transactions if we're past the minimum block size:
+        CFeeRate packageRate(nPackageFees, nPackageSize);
+        if (!fPrioritised && packageRate < ::minRelayTxFee && selection.nBlockSize + nPackageSize >= nBlockMinSize)
+            continue;
+
+        std::sort(vPackage.begin(), vPackage.end(), CompareByAncestorCount);
+        BOOST_FOREACH (CTxMemPool::txiter entry, vPackage) {
+            if (!IsEligible(entry) || !AddTx(entry, entry->GetPriority(nHeight), packageRate)) {
+                // descendants of a transaction that can't go in are skipped with it
+                failedTx.insert(entry);
+                break;
+            }
+        }
+        nConsecutiveFailed = 0;
+    }
+}
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -93,9 +361,89 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
 }
 
+// Transactions last selected from the mempool, protected by cs_main
+static CBlockSelection lastSelection;
+
+/** The mempool transactions to include in a block on top of pindexPrev, reused while nothing changed */
+static const CBlockSelection& GetBlockSelection(CBlockIndex* pindexPrev)
+{
+    AssertLockHeld(cs_main);
+    LOCK(mempool.cs);
+
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    int64_t nLockTimeCutoff = GetAdjustedTime();
+    if (lastSelection.hashPrevBlock == pindexPrev->GetBlockHash() && lastSelection.nTransactionsUpdated == nTransactionsUpdated &&
+        lastSelection.SameLockTimes(nLockTimeCutoff)) {
+        LogPrint("miner", "%s : reusing %u transactions selected for %s\n", __func__, lastSelection.vtx.size(), lastSelection.hashPrevBlock.ToString());
+        return lastSelection;
+    }
+
+    // Largest block you're willing to create:
+    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+    unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
+    nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
+
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+    // Minimum block size you want to create; block will be filled with free transactions
+    // until there are no more or the block reaches this size:
+    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+    CBlockSelection selection;
+    selection.hashPrevBlock = pindexPrev->GetBlockHash();
+    selection.nTransactionsUpdated = nTransactionsUpdated;
+
+    CBlockTxSelector selector(selection, pindexPrev->nHeight + 1, nLockTimeCutoff, nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+    selector.AddPriorityTxs();
+    selector.AddPackageTxs();
+    lastSelection = selection;
+    return lastSelection;
+}
+
+void UpdateBlockSelection()
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev)
+        GetBlockSelection(pindexPrev);
+}
+
+// oxid: look for a coinstake kernel in the time passed since the last search
+static bool SearchCoinStake(CWallet* pwallet, CMutableTransaction& txCoinStake, unsigned int& nTxNewTime, unsigned int& nBits)
+{
+    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
+    boost::this_thread::interruption_point();
+
+    CBlockHeader header;
+    header.nTime = GetAdjustedTime();
+    nBits = GetNextWorkRequired(chainActive.Tip(), &header);
+    int64_t nSearchTime = header.nTime; // search to current time
+    bool fStakeFound = false;
+    if (nSearchTime >= nLastCoinStakeSearchTime) {
+        if (pwallet->CreateCoinStake(*pwallet, nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime))
+            fStakeFound = true;
+        nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
+        nLastCoinStakeSearchTime = nSearchTime;
+    }
+    LogPrint("staking", "%s : fStakeFound=%d\n", __func__, fStakeFound);
+    return fStakeFound;
+}
+
 std::pair<int, std::pair<uint256, uint256> > pCheckpointCache;
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
 {
+    // oxid: the block is only assembled once a coinstake kernel was found
+    CMutableTransaction txCoinStake;
+    unsigned int nTxNewTime = 0;
+    unsigned int nStakeBits = 0;
+    if (fProofOfStake && !SearchCoinStake(pwallet, txCoinStake, nTxNewTime, nStakeBits))
+        return NULL;
+
     std::string blockType = fProofOfStake ? "Proof-of-Stake" : "Proof-of-Work";
     CBlockIndex* pindexPrevious = chainActive.Tip();
     int previousBlocknHeight = 0;
@@ -125,50 +473,15 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     pblocktemplate->vTxFees.push_back(-1);   // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-    // oxid: if coinstake available add coinstake tx
-    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
-    LogPrintf("miner.cpp CreateNewBlock() nLastCoinStakeSearchTime=%d\n", nLastCoinStakeSearchTime);
+    // oxid: add the coinstake tx
     if (fProofOfStake) {
-        boost::this_thread::interruption_point();
-        pblock->nTime = GetAdjustedTime();
-        CBlockIndex* pindexPrev = chainActive.Tip();
-        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
-        CMutableTransaction txCoinStake;
-        int64_t nSearchTime = pblock->nTime; // search to current time
-        bool fStakeFound = false;
-        if (nSearchTime >= nLastCoinStakeSearchTime) {
-            unsigned int nTxNewTime = 0;
-            if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime)) {
-                // TX2<EMPTY-vout, vout.nCredit-masternodePayment, MN-vout.payee.nValue>
-                pblock->nTime = nTxNewTime;
-                pblock->vtx[0].vout[0].SetEmpty(); // ALREADY EMPTY
-                pblock->vtx.push_back(CTransaction(txCoinStake)); // 2nd TRANSACTION
-                fStakeFound = true;
-            }
-            nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-            nLastCoinStakeSearchTime = nSearchTime;
-        }
-        LogPrintf("miner.cpp CreateNewBlock() 146: fStakeFound=%d\n", fStakeFound);
-        if (!fStakeFound)
-            return NULL;
+        // TX2<EMPTY-vout, vout.nCredit-masternodePayment, MN-vout.payee.nValue>
+        pblock->nTime = nTxNewTime;
+        pblock->nBits = nStakeBits;
+        pblock->vtx[0].vout[0].SetEmpty(); // ALREADY EMPTY
+        pblock->vtx.push_back(CTransaction(txCoinStake)); // 2nd TRANSACTION
     }
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-    unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
-
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
     {
@@ -176,185 +489,14 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)) {
-                continue;
-            }
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-
-                if (mapInvalidOutPoints.count(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    fMissingInputs = true;
-                    break;
-                }
-
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-            }
-            if (fMissingInputs) continue;
 
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        vector<CBigNum> vBlockSerials;
-        vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) { // ADD ALL TRANSACTIONS TO THE BLOCK
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.IsZerocoinSpend() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        const CBlockSelection& selection = GetBlockSelection(pindexPrev);
+        pblock->vtx.insert(pblock->vtx.end(), selection.vtx.begin(), selection.vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), selection.vTxFees.begin(), selection.vTxFees.end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), selection.vTxSigOps.begin(), selection.vTxSigOps.end());
+        nFees = selection.nFees;
+        uint64_t nBlockTx = selection.vtx.size();
+        uint64_t nBlockSize = selection.nBlockSize;
 
         // If POW still active:
         if (!fProofOfStake) {
@@ -411,6 +553,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         CValidationState state;
         if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
             LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
+            lastSelection = CBlockSelection();
             mempool.clear();
             return NULL;
         }
@@ -447,11 +590,15 @@ int64_t nHPSTimerStart = 0;
 
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake)
 {
-    CPubKey pubkey;
-    if (!reservekey.GetReservedKey(pubkey))
-        return NULL;
-
-    CScript scriptPubKey = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
+    // the coinbase of a proof-of-stake block is empty, don't take a key from
+    // the pool for every kernel search
+    CScript scriptPubKey;
+    if (!fProofOfStake) {
+        CPubKey pubkey;
+        if (!reservekey.GetReservedKey(pubkey))
+            return NULL;
+        scriptPubKey = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
+    }
     return CreateNewBlock(scriptPubKey, pwallet, fProofOfStake);
 }
 
@@ -501,6 +648,7 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
     // Each thread has its own key and counter
     CReserveKey reservekey(pwallet);
     unsigned int nExtraNonce = 0;
+    CBlockIndex* pindexSelection = NULL;
 
     while (fGenerateBitcoins || fProofOfStake) {
         if (fProofOfStake) {
@@ -539,6 +687,13 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
                     continue;
                 }
             }
+
+            // Pick the transactions for a new tip while waiting for a kernel,
+            // so a found stake is signed and relayed without the assembly delay
+            if (pindexSelection != chainActive.Tip()) {
+                UpdateBlockSelection();
+                pindexSelection = chainActive.Tip();
+            }
         }
 
         MilliSleep(1000);
@@ -26,6 +26,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -88,7 +92,7 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSerializedNetMsg> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -610,7 +614,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -665,12 +669,14 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 
 
 // requires LOCK(cs_vSend)
-void SocketSendData(CNode* pnode)
+// Returns false if the socket could not take all queued data.
+bool SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    bool fWritable = true;
+    std::deque<CSerializedNetMsg>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
+        const CSerializeData& data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -684,13 +690,16 @@ void SocketSendData(CNode* pnode)
                 it++;
             } else {
                 // could not send full message; stop sending more
+                fWritable = false;
                 break;
             }
         } else {
             if (nBytes < 0) {
                 // error
                 int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+                if (nErr == WSAEWOULDBLOCK) {
+                    fWritable = false;
+                } else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
                     pnode->CloseSocketDisconnect();
                 }
@@ -705,13 +714,245 @@ void SocketSendData(CNode* pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+    return fWritable;
+}
+
+// requires LOCK(cs_vRecvMsg)
+static bool ReceiveBufferHasRoom(CNode* pnode)
+{
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+           pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
+// requires LOCK(cs_vRecvMsg)
+static void SocketRecvData(CNode* pnode, bool fEdgeTriggered)
+{
+    // typical socket buffer is 8K-64K, the buffer is reused while draining the socket
+    char pchBuf[0x10000];
+    while (pnode->hSocket != INVALID_SOCKET && ReceiveBufferHasRoom(pnode)) {
+        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes > 0) {
+            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                pnode->CloseSocketDisconnect();
+            pnode->nLastRecv = GetTime();
+            pnode->nRecvBytes += nBytes;
+            pnode->RecordBytesRecv(nBytes);
+            // edge-triggered readiness is only reported again once the socket has been drained
+            if (fEdgeTriggered)
+                continue;
+        } else if (nBytes == 0) {
+            // socket closed gracefully
+            if (!pnode->fDisconnect)
+                LogPrint("net", "socket closed\n");
+            pnode->CloseSocketDisconnect();
+        } else if (nBytes < 0) {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr == WSAEWOULDBLOCK) {
+                pnode->fRecvReady = false;
+            } else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+                if (!pnode->fDisconnect)
+                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+                pnode->CloseSocketDisconnect();
+            }
+        }
+        break;
+    }
+}
+
+/**
+ * Wait up to 50ms for socket readiness with select(). Readiness is level-triggered,
+ * so the node flags are recomputed on every call.
+ */
+static void SelectSockets(std::set<SOCKET>& setListenReady)
+{
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                    continue;
+                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && ReceiveBufferHasRoom(pnode))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec / 1000);
+    }
+
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            setListenReady.insert(hListenSocket.socket);
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH (CNode* pnode, vNodes) {
+        SOCKET hSocket = pnode->hSocket;
+        pnode->fRecvReady = hSocket != INVALID_SOCKET && (FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError));
+        pnode->fSendReady = hSocket != INVALID_SOCKET && FD_ISSET(hSocket, &fdsetSend);
+    }
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+/** Maximum number of readiness events fetched by one epoll_wait() call */
+static const int MAX_EPOLL_EVENTS = 256;
+/** epoll instance of the socket handler, -1 if select() is used instead */
+static int hEpoll = -1;
+
+static bool EpollCreate()
+{
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1) {
+        LogPrintf("epoll_create1 failed: %s, falling back to select()\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+
+    // listening sockets stay level-triggered, accept() is called once per wakeup
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1) {
+            LogPrintf("epoll_ctl failed for listening socket: %s, falling back to select()\n", NetworkErrorString(WSAGetLastError()));
+            close(hEpoll);
+            hEpoll = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Wait up to 50ms for socket readiness with epoll. Node sockets are registered
+ * edge-triggered, so a readiness flag stays set until the socket reports
+ * EWOULDBLOCK and is only raised again by a new event. Closed sockets are
+ * removed from the epoll set by the kernel.
+ */
+static void EpollSockets(std::set<SOCKET>& setListenReady)
+{
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->fPolled || pnode->hSocket == INVALID_SOCKET)
+                continue;
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.fd = pnode->hSocket;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1) {
+                LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(WSAGetLastError()));
+                pnode->CloseSocketDisconnect();
+                continue;
+            }
+            pnode->fPolled = true;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(hEpoll, events, MAX_EPOLL_EVENTS, 50);
+    boost::this_thread::interruption_point();
+
+    if (nEvents == -1) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            MilliSleep(50);
+        }
+        return;
+    }
+    if (nEvents == 0)
+        return;
+
+    LOCK(cs_vNodes);
+    std::map<SOCKET, CNode*> mapSocketNode;
+    BOOST_FOREACH (CNode* pnode, vNodes)
+        if (pnode->hSocket != INVALID_SOCKET)
+            mapSocketNode[pnode->hSocket] = pnode;
+
+    for (int i = 0; i < nEvents; i++) {
+        std::map<SOCKET, CNode*>::iterator mi = mapSocketNode.find(events[i].data.fd);
+        if (mi == mapSocketNode.end()) {
+            setListenReady.insert(events[i].data.fd);
+            continue;
+        }
+        CNode* pnode = mi->second;
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            pnode->fRecvReady = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSendReady = true;
+    }
+}
+#endif
+
 static list<CNode*> vNodesDisconnected;
 
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    bool fEdgeTriggered = false;
+#ifdef HAVE_SYS_EPOLL_H
+    fEdgeTriggered = EpollCreate();
+#endif
     while (true) {
         //
         // Disconnect nodes
@@ -777,86 +1018,19 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
+        std::set<SOCKET> setListenReady;
+#ifdef HAVE_SYS_EPOLL_H
+        if (fEdgeTriggered)
+            EpollSockets(setListenReady);
+        else
+#endif
+            SelectSockets(setListenReady);
 
         //
         // Accept new connections
         //
         BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && setListenReady.count(hListenSocket.socket)) {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -919,35 +1093,17 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            bool fReceive = pnode->fRecvReady;
+            if (fReceive && fEdgeTriggered) {
+                // readiness persists across iterations here, so apply the
+                // send-before-receive rule from SelectSockets() at this point
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                fReceive = lockSend && pnode->vSendMsg.empty();
+            }
+            if (fReceive) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                if (lockRecv)
+                    SocketRecvData(pnode, fEdgeTriggered);
             }
 
             //
@@ -955,10 +1111,10 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (pnode->fSendReady) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    SocketSendData(pnode);
+                if (lockSend && !SocketSendData(pnode))
+                    pnode->fSendReady = false;
             }
 
             //
@@ -1356,7 +1512,15 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+// The peer that gets its inventory without trickling delay. There is only one
+// at a time across all message handler threads: a new one is picked once the
+// owning thread has sent to it, or when it goes away. Guarded by cs_vNodes.
+static NodeId nTrickleNode = -1;
+
+// Each message handler thread owns the peers whose id maps to it, so a peer's
+// messages are always processed in order by the same thread while different
+// peers are processed concurrently.
+void ThreadMessageHandler(int nThread, int nThreads)
 {
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
@@ -1364,18 +1528,24 @@ void ThreadMessageHandler()
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true) {
         vector<CNode*> vNodesCopy;
+        NodeId nTrickle;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+            bool fTrickleNodeFound = false;
+            BOOST_FOREACH (CNode* pnode, vNodes) {
+                if (pnode->GetId() == nTrickleNode && !pnode->fDisconnect)
+                    fTrickleNodeFound = true;
+                if (pnode->GetId() % nThreads != nThread)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
+            if (!fTrickleNodeFound)
+                nTrickleNode = vNodes.empty() ? -1 : vNodes[GetRand(vNodes.size())]->GetId();
+            nTrickle = nTrickleNode;
         }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
         bool fSleep = true;
 
@@ -1400,10 +1570,18 @@ void ThreadMessageHandler()
             boost::this_thread::interruption_point();
 
             // Send messages
+            bool fTrickled = false;
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                if (lockSend) {
+                    fTrickled = pnode->GetId() == nTrickle;
+                    g_signals.SendMessages(pnode, fTrickled || pnode->fWhitelisted);
+                }
+            }
+            if (fTrickled) {
+                LOCK(cs_vNodes);
+                if (nTrickleNode == nTrickle)
+                    nTrickleNode = -1;
             }
             boost::this_thread::interruption_point();
         }
@@ -1615,7 +1793,9 @@ void StartNode(boost::thread_group& threadGroup)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandthreads", DEFAULT_MESSAGE_HANDLER_THREADS), MAX_MESSAGE_HANDLER_THREADS));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i, nMessageHandlerThreads))));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
@@ -1656,6 +1836,10 @@ public:
             if (hListenSocket.socket != INVALID_SOCKET)
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpoll != -1)
+            close(hEpoll);
+#endif
 
         // clean up some globals (to help leak detection)
         BOOST_FOREACH (CNode* pnode, vNodes)
@@ -1704,8 +1888,10 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Save original serialized message so newer versions are preserved. It is framed
+        // once here and the same buffer is queued for every peer that asks for it.
+        if (!mapRelay.count(inv))
+            mapRelay.insert(std::make_pair(inv, MakeNetMessage(inv.GetCommand(), ss)));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -1924,6 +2110,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fRecvReady = false;
+    fSendReady = false;
+    fPolled = false;
     hashContinue = 0;
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2039,13 +2228,53 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    CSerializeData* pdata = new CSerializeData();
+    ssSend.GetAndClear(*pdata);
+    vSendMsg.push_back(CSerializedNetMsg(pdata));
+    nSendSize += pdata->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
+
+void CNode::PushSerializedMessage(const CSerializedNetMsg& msg)
+{
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: shared message (%d bytes) peer=%d\n", msg->size() - CMessageHeader::HEADER_SIZE, id);
+
+    vSendMsg.push_back(msg);
+    nSendSize += msg->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
+static CSerializedNetMsg MakeNetMessage(const char* pszCommand, const char* pchPayload, size_t nPayloadSize)
+{
+    CMessageHeader hdr(pszCommand, nPayloadSize);
+    uint256 hash = Hash(pchPayload, pchPayload + nPayloadSize);
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdr;
+
+    CSerializeData* pdata = new CSerializeData();
+    pdata->reserve(ssHeader.size() + nPayloadSize);
+    pdata->insert(pdata->end(), ssHeader.begin(), ssHeader.end());
+    pdata->insert(pdata->end(), pchPayload, pchPayload + nPayloadSize);
+    return CSerializedNetMsg(pdata);
+}
+
+CSerializedNetMsg MakeNetMessage(const char* pszCommand, const CDataStream& ssPayload)
+{
+    return MakeNetMessage(pszCommand, ssPayload.empty() ? NULL : &ssPayload[0], ssPayload.size());
+}
+
+CSerializedNetMsg MakeNetMessage(const char* pszCommand, const CSerializeData& vchPayload)
+{
+    return MakeNetMessage(pszCommand, vchPayload.empty() ? NULL : &vchPayload[0], vchPayload.size());
+}
@@ -29,12 +29,16 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
 class CBlockIndex;
 class CNode;
 
+/** A fully framed network message (header and payload), shareable between the send queues of several peers */
+typedef boost::shared_ptr<const CSerializeData> CSerializedNetMsg;
+
 namespace boost
 {
 class thread_group;
@@ -58,6 +62,10 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
+/** Default number of message handler threads */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 
@@ -77,7 +85,9 @@ unsigned short GetListenPort();
 bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhitelisted = false);
 void StartNode(boost::thread_group& threadGroup);
 bool StopNode();
-void SocketSendData(CNode* pnode);
+bool SocketSendData(CNode* pnode);
+CSerializedNetMsg MakeNetMessage(const char* pszCommand, const CDataStream& ssPayload);
+CSerializedNetMsg MakeNetMessage(const char* pszCommand, const CSerializeData& vchPayload);
 
 typedef int NodeId;
 
@@ -130,7 +140,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSerializedNetMsg> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -223,8 +233,12 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializedNetMsg> vSendMsg;
     CCriticalSection cs_vSend;
+    // socket readiness as last reported by select()/epoll, only touched by the socket handler thread
+    bool fRecvReady;
+    bool fSendReady;
+    bool fPolled; // registered with the socket handler's epoll instance
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -416,6 +430,9 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    // Queue a message built by MakeNetMessage() without copying it
+    void PushSerializedMessage(const CSerializedNetMsg& msg);
+
     void PushVersion();
 
 
@@ -7,6 +7,8 @@
 #include "init.h"
 #include "instanttx.h"
 #include "main.h"
+#include "masternode-budget.h"
+#include "masternode-payments.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "script/sign.h"
@@ -2306,6 +2308,9 @@ void ThreadCheckObfuScationPool()
             // start right after sync is considered to be done
             if (c % MASTERNODE_PING_SECONDS == 1) activeMasternode.ManageStatus();
 
+            // verify payment votes that didn't fill a batch
+            masternodePayments.ProcessPendingWinners();
+
             if (c % 60 == 0) {
                 mnodeman.CheckAndRemove();
                 mnodeman.ProcessMasternodeConnections();
@@ -2313,7 +2318,12 @@ void ThreadCheckObfuScationPool()
                 CleanTransactionLocksList();
             }
 
-            //if(c % MASTERNODES_DUMP_SECONDS == 0) DumpMasternodes();
+            // only records that changed since the last dump are written
+            if (c % MASTERNODES_DUMP_SECONDS == 0) {
+                DumpMasternodes();
+                DumpBudgets();
+                DumpMasternodePayments();
+            }
 
             obfuScationPool.CheckTimeout();
             obfuScationPool.CheckForCompleteQueue();
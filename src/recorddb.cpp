@@ -0,0 +1,290 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recorddb.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/filesystem.hpp>
+
+uint256 CRecordHeader::ComputeHash(const char* pbegin, const char* pend) const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << nRecordType;
+    ss << nFlags;
+    ss << key;
+    ss.write(pbegin, pend - pbegin);
+    return ss.GetHash();
+}
+
+CRecordDB::CRecordDB(const std::string& strFilenameIn, const std::string& strMagicMessageIn)
+{
+    strFilename = strFilenameIn;
+    strMagicMessage = strMagicMessageIn;
+    nDeadRecords = 0;
+    fRewrite = true;
+}
+
+boost::filesystem::path CRecordDB::GetPath() const
+{
+    return GetDataDir() / strFilename;
+}
+
+CRecordDB::ReadResult CRecordDB::ReadRecords(RecordReader readRecord)
+{
+    LOCK(cs);
+
+    int64_t nStart = GetTimeMillis();
+    mapHashes.clear();
+    nDeadRecords = 0;
+    fRewrite = true;
+
+    boost::filesystem::path pathDB = GetPath();
+    FILE* file = fopen(pathDB.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        error("%s : Failed to open file %s", __func__, pathDB.string());
+        return FileError;
+    }
+
+    // read the whole file at once, records are indexed in place
+    CDataStream ssFile(SER_DISK, CLIENT_VERSION);
+    try {
+        ssFile.resize(boost::filesystem::file_size(pathDB));
+        if (!ssFile.empty())
+            filein.read(&ssFile[0], ssFile.size());
+    } catch (std::exception& e) {
+        error("%s : I/O error - %s", __func__, e.what());
+        return FileError;
+    }
+    filein.fclose();
+
+    unsigned char pchMsgTmp[4];
+    std::string strMagicMessageTmp;
+    int nVersionTmp;
+    try {
+        // de-serialize file header (file specific magic message) and ..
+        ssFile >> strMagicMessageTmp;
+
+        // ... verify the message matches predefined one
+        if (strMagicMessage != strMagicMessageTmp) {
+            error("%s : Invalid %s magic message", __func__, strFilename);
+            return IncorrectMagicMessage;
+        }
+
+        // de-serialize file header (network specific magic number) and ..
+        ssFile >> FLATDATA(pchMsgTmp);
+
+        // ... verify the network matches ours
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
+            error("%s : Invalid network magic number", __func__);
+            return IncorrectMagicNumber;
+        }
+
+        ssFile >> nVersionTmp;
+    } catch (std::exception& e) {
+        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        return IncorrectFormat;
+    }
+
+    if (nVersionTmp != RECORDDB_VERSION) {
+        error("%s : Unsupported %s version %d", __func__, strFilename, nVersionTmp);
+        return IncorrectFormat;
+    }
+
+    // index the records, later versions of a key supersede earlier ones
+    struct CRecordPos {
+        size_t nValuePos;
+        CRecordHeader header;
+        uint256 hash;
+    };
+    std::map<RecordKey, CRecordPos> mapIndex;
+    const char* pch = ssFile.empty() ? NULL : &ssFile[0];
+    size_t nAvail = ssFile.size();
+    size_t nPos = 0;
+    unsigned int nCorrupt = 0;
+    bool fTruncated = false;
+
+    while (nPos < nAvail) {
+        if (nAvail - nPos < CRecordHeader::SIZE) {
+            fTruncated = true;
+            break;
+        }
+
+        CRecordHeader header;
+        CDataStream ssHeader(pch + nPos, pch + nPos + CRecordHeader::SIZE, SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+        nPos += CRecordHeader::SIZE;
+
+        if (header.nSize > nAvail - nPos) {
+            fTruncated = true;
+            break;
+        }
+
+        size_t nValuePos = nPos;
+        nPos += header.nSize;
+
+        uint256 hash = header.ComputeHash(pch + nValuePos, pch + nPos);
+        if (hash.Get32() != header.nChecksum) {
+            LogPrintf("%s : Checksum mismatch in %s at offset %u, skipping record\n", __func__, strFilename, nValuePos);
+            nCorrupt++;
+            continue;
+        }
+
+        RecordKey key(header.nRecordType, header.key);
+        std::map<RecordKey, CRecordPos>::iterator it = mapIndex.find(key);
+        if (it != mapIndex.end()) {
+            nDeadRecords++;
+            mapIndex.erase(it);
+        }
+
+        if (header.IsErase())
+            nDeadRecords++;
+        else {
+            CRecordPos pos = {nValuePos, header, hash};
+            mapIndex.insert(std::make_pair(key, pos));
+        }
+    }
+
+    if (fTruncated)
+        LogPrintf("%s : %s ends with a partial record, ignoring it\n", __func__, strFilename);
+
+    // only now deserialize the records that are still live
+    for (std::map<RecordKey, CRecordPos>::iterator it = mapIndex.begin(); it != mapIndex.end(); ++it) {
+        const CRecordHeader& header = it->second.header;
+        const char* pbegin = pch + it->second.nValuePos;
+        CDataStream ssValue(pbegin, pbegin + header.nSize, SER_DISK, CLIENT_VERSION);
+        try {
+            readRecord(header.nRecordType, header.key, ssValue);
+            mapHashes.insert(std::make_pair(it->first, it->second.hash));
+        } catch (std::exception& e) {
+            LogPrintf("%s : Deserialize error in %s record %s - %s\n", __func__, strFilename, header.key.ToString(), e.what());
+            nCorrupt++;
+        }
+    }
+
+    // a damaged file is rewritten on the next dump instead of appended to
+    fRewrite = fTruncated || nCorrupt > 0;
+
+    LogPrintf("Loaded %u records from %s (%u superseded, %u damaged)  %dms\n",
+        mapHashes.size(), strFilename, nDeadRecords, nCorrupt, GetTimeMillis() - nStart);
+
+    return Ok;
+}
+
+bool CRecordDB::WriteRecords(const CRecordBatch& batch)
+{
+    LOCK(cs);
+
+    int64_t nStart = GetTimeMillis();
+
+    // find the records that differ from what's on disk
+    std::map<RecordKey, uint256> mapNewHashes;
+    CDataStream ssChanged(SER_DISK, CLIENT_VERSION);
+    unsigned int nChanged = 0;
+    unsigned int nDead = 0;
+    size_t nPos = 0;
+
+    for (size_t i = 0; i < batch.vHeaders.size(); i++) {
+        const CRecordHeader& header = batch.vHeaders[i];
+        RecordKey key(header.nRecordType, header.key);
+        size_t nRecordSize = CRecordHeader::SIZE + header.nSize;
+
+        std::map<RecordKey, uint256>::const_iterator it = mapHashes.find(key);
+        if (it == mapHashes.end() || it->second != batch.vHashes[i]) {
+            ssChanged.write(&batch.ssRecords[0] + nPos, nRecordSize);
+            nChanged++;
+            if (it != mapHashes.end())
+                nDead++;
+        }
+
+        mapNewHashes[key] = batch.vHashes[i];
+        nPos += nRecordSize;
+    }
+
+    // erase the records that are gone
+    unsigned int nErased = 0;
+    for (std::map<RecordKey, uint256>::const_iterator it = mapHashes.begin(); it != mapHashes.end(); ++it) {
+        if (mapNewHashes.count(it->first))
+            continue;
+
+        CRecordHeader header(it->first.first, CRecordHeader::FLAG_ERASE, it->first.second);
+        header.nChecksum = header.ComputeChecksum(NULL, NULL);
+        ssChanged << header;
+        nErased++;
+        nDead += 2;
+    }
+
+    bool fCompact = fRewrite || nDeadRecords + nDead > std::max<size_t>(mapNewHashes.size(), RECORDDB_MIN_COMPACT_RECORDS);
+    if (fCompact) {
+        if (!Rewrite(batch))
+            return false;
+        nDeadRecords = 0;
+    } else {
+        if (!ssChanged.empty() && !Append(ssChanged))
+            return false;
+        nDeadRecords += nDead;
+    }
+
+    mapHashes.swap(mapNewHashes);
+    fRewrite = false;
+
+    LogPrint("masternode", "%s %s: %u records, %u changed, %u erased  %dms\n", fCompact ? "Rewrote" : "Appended to",
+        strFilename, mapHashes.size(), nChanged, nErased, GetTimeMillis() - nStart);
+
+    return true;
+}
+
+bool CRecordDB::Rewrite(const CRecordBatch& batch)
+{
+    boost::filesystem::path pathDB = GetPath();
+    boost::filesystem::path pathTmp = pathDB;
+    pathTmp += ".new";
+
+    // open output file, and associate with CAutoFile
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+    // Write and commit header, data
+    try {
+        fileout << strMagicMessage;                   // file specific magic message
+        fileout << FLATDATA(Params().MessageStart()); // network specific magic number
+        fileout << RECORDDB_VERSION;
+        fileout << batch.ssRecords;
+    } catch (std::exception& e) {
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathDB))
+        return error("%s : Rename-into-place failed for %s", __func__, pathDB.string());
+
+    return true;
+}
+
+bool CRecordDB::Append(const CDataStream& ssChanged)
+{
+    boost::filesystem::path pathDB = GetPath();
+
+    FILE* file = fopen(pathDB.string().c_str(), "ab");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathDB.string());
+
+    try {
+        fileout << ssChanged;
+    } catch (std::exception& e) {
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    return true;
+}
@@ -0,0 +1,198 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef OXID_RECORDDB_H
+#define OXID_RECORDDB_H
+
+#include "clientversion.h"
+#include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+
+/** Version of the record file layout, stored in the file header */
+static const int RECORDDB_VERSION = 1;
+/** Don't bother compacting files with fewer superseded records than this */
+static const unsigned int RECORDDB_MIN_COMPACT_RECORDS = 1000;
+
+/** Fixed size header in front of every record payload */
+class CRecordHeader
+{
+public:
+    static const unsigned char FLAG_ERASE = 0x01;
+    static const unsigned int SIZE = 1 + 1 + 4 + 4 + 32;
+
+    unsigned char nRecordType;
+    unsigned char nFlags;
+    uint32_t nSize;
+    uint32_t nChecksum;
+    uint256 key;
+
+    CRecordHeader()
+    {
+        nRecordType = 0;
+        nFlags = 0;
+        nSize = 0;
+        nChecksum = 0;
+        key = 0;
+    }
+
+    CRecordHeader(unsigned char nRecordTypeIn, unsigned char nFlagsIn, const uint256& keyIn)
+    {
+        nRecordType = nRecordTypeIn;
+        nFlags = nFlagsIn;
+        nSize = 0;
+        nChecksum = 0;
+        key = keyIn;
+    }
+
+    bool IsErase() const { return (nFlags & FLAG_ERASE) != 0; }
+
+    /** Hash covering the record identity and its payload */
+    uint256 ComputeHash(const char* pbegin, const char* pend) const;
+    /** Checksum stored in the header, the low 32 bits of the hash */
+    uint32_t ComputeChecksum(const char* pbegin, const char* pend) const { return ComputeHash(pbegin, pend).Get32(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nRecordType);
+        READWRITE(nFlags);
+        READWRITE(nSize);
+        READWRITE(nChecksum);
+        READWRITE(key);
+    }
+};
+
+/** Records collected for one dump of a CRecordDB */
+class CRecordBatch
+{
+    friend class CRecordDB;
+
+private:
+    // record headers and payloads, back to back as they are laid out on disk
+    CDataStream ssRecords;
+    std::vector<CRecordHeader> vHeaders;
+    std::vector<uint256> vHashes;
+
+public:
+    CRecordBatch() : ssRecords(SER_DISK, CLIENT_VERSION) {}
+
+    template <typename T>
+    void Write(unsigned char nRecordType, const uint256& key, const T& obj)
+    {
+        unsigned int nPos = ssRecords.size();
+        CRecordHeader header(nRecordType, 0, key);
+        ssRecords << header;
+        ssRecords << obj;
+
+        // now that the payload is known, fill in size and checksum
+        const char* pbegin = &ssRecords[0] + nPos + CRecordHeader::SIZE;
+        header.nSize = ssRecords.size() - nPos - CRecordHeader::SIZE;
+        uint256 hash = header.ComputeHash(pbegin, pbegin + header.nSize);
+        header.nChecksum = hash.Get32();
+
+        CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+        ssHeader << header;
+        std::copy(ssHeader.begin(), ssHeader.end(), ssRecords.begin() + nPos);
+        vHeaders.push_back(header);
+        vHashes.push_back(hash);
+    }
+
+    template <typename T>
+    void WriteMap(unsigned char nRecordType, const std::map<uint256, T>& mapRecords)
+    {
+        for (typename std::map<uint256, T>::const_iterator it = mapRecords.begin(); it != mapRecords.end(); ++it)
+            Write(nRecordType, it->first, it->second);
+    }
+
+    size_t size() const { return vHeaders.size(); }
+};
+
+/** Append-only file of keyed records, used for the masternode caches
+ *  (mncache.dat, mnpayments.dat and budget.dat).
+ *
+ *  The file starts with a header (magic message, network magic, layout version)
+ *  followed by records. Every record carries its own checksum, so a damaged
+ *  record only costs that entry instead of the whole cache. A dump appends only
+ *  the records that changed since the file was last read or written, plus erase
+ *  markers for records that went away; the file is rewritten once it holds more
+ *  superseded records than live ones.
+ */
+class CRecordDB
+{
+public:
+    enum ReadResult {
+        Ok,
+        FileError,
+        IncorrectMagicMessage,
+        IncorrectMagicNumber,
+        IncorrectFormat
+    };
+
+    typedef boost::function<void(unsigned char nRecordType, const uint256& key, CDataStream& ssValue)> RecordReader;
+
+private:
+    typedef std::pair<unsigned char, uint256> RecordKey;
+
+    // protects the record index and serializes access to the file
+    mutable CCriticalSection cs;
+
+    std::string strFilename;
+    std::string strMagicMessage;
+
+    // hashes of the live records in the file, the full hash so that a
+    // changed record is never mistaken for the one on disk
+    std::map<RecordKey, uint256> mapHashes;
+    // superseded records and erase markers in the file
+    unsigned int nDeadRecords;
+    // the file is missing, damaged or in another format and must be rewritten
+    bool fRewrite;
+
+    boost::filesystem::path GetPath() const;
+    bool Rewrite(const CRecordBatch& batch);
+    bool Append(const CDataStream& ssChanged);
+
+protected:
+    CRecordDB(const std::string& strFilenameIn, const std::string& strMagicMessageIn);
+
+    /** Read the file and pass the latest version of every live record to readRecord.
+     *  Superseded and erased records are skipped without being deserialized. */
+    ReadResult ReadRecords(RecordReader readRecord);
+
+    /** Deserialize a record into obj, which keeps its value if the record is damaged */
+    template <typename T>
+    static void ReadRecord(CDataStream& ssValue, T& obj)
+    {
+        T objRead;
+        ssValue >> objRead;
+        std::swap(obj, objRead);
+    }
+
+    /** Deserialize a record into the map under key, nothing is added if the record is damaged */
+    template <typename K, typename T>
+    static void ReadMapRecord(CDataStream& ssValue, std::map<K, T>& mapRecords, const K& key)
+    {
+        T objRead;
+        ssValue >> objRead;
+        mapRecords.erase(key);
+        mapRecords.insert(std::make_pair(key, objRead));
+    }
+
+    /** Store the batch as the new content of the file. Only records that changed since
+     *  the last read or write are appended, records missing from the batch are erased. */
+    bool WriteRecords(const CRecordBatch& batch);
+};
+
+#endif // OXID_RECORDDB_H
@@ -4,11 +4,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "jsonwriter.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "rpcserver.h"
 #include "streams.h"
+#include "txmempool.h"
 #include "sync.h"
 #include "utilstrencodings.h"
 #include "version.h"
@@ -42,8 +44,32 @@ public:
     string message;
 };
 
+//! Most headers returned by one /rest/headers/ request
+static const size_t MAX_REST_HEADERS_RESULTS = 2000;
+//! Most outpoints looked up by one /rest/getutxos request
+static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+
+/** An unspent output as returned by /rest/getutxos */
+struct CCoin {
+    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
+    uint32_t nHeight;
+    CTxOut out;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTxVer);
+        READWRITE(nHeight);
+        READWRITE(out);
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry);
-extern Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, CJSONWriter& writer, bool txDetails = false);
+extern void blockHeaderToJSON(const CBlockIndex* blockindex, const CChainTipSnapshot& tip, CJSONWriter& writer);
+extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, CJSONWriter& writer, bool fIncludeHex);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -92,6 +118,7 @@ static bool ParseHashStr(const string& strReq, uint256& v)
 
 static bool rest_block(AcceptedConnection* conn,
     string& strReq,
+    const string& strRequest,
     map<string, string>& mapHeaders,
     bool fRun,
     bool showTxDetails)
@@ -108,14 +135,16 @@ static bool rest_block(AcceptedConnection* conn,
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
-
-        pblockindex = mapBlockIndex[hash];
-        if (!ReadBlockFromDisk(block, pblockindex))
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        pblockindex = mi->second;
     }
 
+    // Like getblock, the disk read doesn't need cs_main once the block data is known to be stored
+    if (!ReadBlockFromDisk(block, pblockindex))
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
     ssBlock << block;
 
@@ -133,8 +162,13 @@ static bool rest_block(AcceptedConnection* conn,
     }
 
     case RF_JSON: {
-        Object objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = write_string(Value(objBlock), false) + "\n";
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        {
+            LOCK(cs_main);
+            blockToJSON(block, pblockindex, writer, showTxDetails);
+        }
+        strJSON += "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
         return true;
     }
@@ -150,22 +184,25 @@ static bool rest_block(AcceptedConnection* conn,
 
 static bool rest_block_extended(AcceptedConnection* conn,
     string& strReq,
+    const string& strRequest,
     map<string, string>& mapHeaders,
     bool fRun)
 {
-    return rest_block(conn, strReq, mapHeaders, fRun, true);
+    return rest_block(conn, strReq, strRequest, mapHeaders, fRun, true);
 }
 
 static bool rest_block_notxdetails(AcceptedConnection* conn,
     string& strReq,
+    const string& strRequest,
     map<string, string>& mapHeaders,
     bool fRun)
 {
-    return rest_block(conn, strReq, mapHeaders, fRun, false);
+    return rest_block(conn, strReq, strRequest, mapHeaders, fRun, false);
 }
 
 static bool rest_tx(AcceptedConnection* conn,
     string& strReq,
+    const string& strRequest,
     map<string, string>& mapHeaders,
     bool fRun)
 {
@@ -215,20 +252,352 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_headers(AcceptedConnection* conn,
+    string& strReq,
+    const string& strRequest,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        throw RESTERR(HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+
+    int32_t count;
+    if (!ParseInt32(path[0], &count) || count < 1 || (size_t)count > MAX_REST_HEADERS_RESULTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Header count out of range: %s", path[0]));
+
+    string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    // Headers of the active chain starting at the given block, taken from a snapshot of the tip without cs_main
+    CChainTipSnapshot tip = GetChainTipSnapshot();
+    vector<const CBlockIndex*> vHeaders;
+    const CBlockIndex* pindex = LookupBlockIndex(hash);
+    if (tip.Contains(pindex)) {
+        // walk back from the last requested block, which is cheaper than a skip list lookup per height
+        const CBlockIndex* pindexLast = tip[std::min(pindex->nHeight + count - 1, tip.nHeight)];
+        vHeaders.resize(pindexLast->nHeight - pindex->nHeight + 1);
+        for (size_t i = vHeaders.size(); i > 0; i--) {
+            vHeaders[i - 1] = pindexLast;
+            pindexLast = pindexLast->pprev;
+        }
+    }
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    string strJSON;
+    CJSONWriter writer(strJSON);
+    if (rf == RF_JSON)
+        writer.BeginArray();
+    BOOST_FOREACH (const CBlockIndex* pindexHeader, vHeaders) {
+        if (rf == RF_JSON)
+            blockHeaderToJSON(pindexHeader, tip, writer);
+        else
+            ssHeader << pindexHeader->GetBlockHeader();
+    }
+    if (rf == RF_JSON)
+        writer.EndArray();
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryHeader = ssHeader.str();
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryHeader.size(), "application/octet-stream") << binaryHeader << std::flush;
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        return true;
+    }
+
+    case RF_JSON: {
+        strJSON += "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_chaininfo(AcceptedConnection* conn,
+    string& strReq,
+    const string& strRequest,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        {
+            LOCK(cs_main);
+            getblockchaininfo(Array(), false, writer);
+        }
+        strJSON += "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_mempool_contents(AcceptedConnection* conn,
+    string& strReq,
+    const string& strRequest,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        // Same layout as a serialized vector<CTransaction>, written without copying the transactions
+        CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION);
+        {
+            LOCK(mempool.cs);
+            WriteCompactSize(ssTxs, mempool.mapTx.size());
+            BOOST_FOREACH (const CTxMemPoolEntry& e, mempool.mapTx)
+                ssTxs << e.GetTx();
+        }
+
+        if (rf == RF_HEX) {
+            string strHex = HexStr(ssTxs.begin(), ssTxs.end()) + "\n";
+            conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        } else {
+            string binaryTxs = ssTxs.str();
+            conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryTxs.size(), "application/octet-stream") << binaryTxs << std::flush;
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        Array verbose;
+        verbose.push_back(true);
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        getrawmempool(verbose, false, writer);
+        strJSON += "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_getutxos(AcceptedConnection* conn,
+    string& strReq,
+    const string& strRequest,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    vector<string> uriParts;
+    if (params[0].length() > 1) {
+        string strUriParams = params[0].substr(1);
+        boost::split(uriParts, strUriParams, boost::is_any_of("/"));
+    }
+
+    if (strRequest.empty() && uriParts.empty())
+        throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+
+    bool fInputParsed = false;
+    bool fCheckMemPool = false;
+    vector<COutPoint> vOutPoints;
+
+    // Outpoints in the URI: /rest/getutxos/checkmempool/<txid>-<n>/<txid>-<n>/...
+    if (!uriParts.empty()) {
+        if (uriParts[0] == "checkmempool")
+            fCheckMemPool = true;
+
+        for (size_t i = fCheckMemPool ? 1 : 0; i < uriParts.size(); i++) {
+            size_t nDash = uriParts[i].find("-");
+            uint256 txid;
+            int32_t nOutput;
+            if (nDash == string::npos || !ParseHashStr(uriParts[i].substr(0, nDash), txid) ||
+                !ParseInt32(uriParts[i].substr(nDash + 1), &nOutput) || nOutput < 0)
+                throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+            vOutPoints.push_back(COutPoint(txid, (uint32_t)nOutput));
+        }
+
+        if (vOutPoints.empty())
+            throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+        fInputParsed = true;
+    }
+
+    // Binary and hex requests may instead POST a serialized (checkmempool, vector<COutPoint>)
+    switch (rf) {
+    case RF_HEX:
+    case RF_BINARY: {
+        if (strRequest.empty())
+            break;
+        if (fInputParsed)
+            throw RESTERR(HTTP_BAD_REQUEST, "Combination of URI scheme inputs and raw post data is not allowed");
+
+        CDataStream ssRequest(SER_NETWORK, PROTOCOL_VERSION);
+        if (rf == RF_HEX) {
+            vector<unsigned char> vchRequest = ParseHex(strRequest);
+            ssRequest.write((const char*)begin_ptr(vchRequest), vchRequest.size());
+        } else
+            ssRequest.write(strRequest.data(), strRequest.size());
+        try {
+            ssRequest >> fCheckMemPool;
+            ssRequest >> vOutPoints;
+        } catch (const std::ios_base::failure& e) {
+            throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+        }
+        break;
+    }
+
+    case RF_JSON: {
+        if (!fInputParsed)
+            throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+        break;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    if (vOutPoints.size() > MAX_GETUTXOS_OUTPOINTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, vOutPoints.size()));
+
+    vector<unsigned char> bitmap((vOutPoints.size() + 7) / 8, 0);
+    string bitmapStringRepresentation;
+    vector<CCoin> outs;
+    int nChainHeight;
+    uint256 hashChainTip;
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+        CCoinsView& view = fCheckMemPool ? (CCoinsView&)viewMempool : (CCoinsView&)*pcoinsTip;
+
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            CCoins coins;
+            const uint256& hash = vOutPoints[i].hash;
+            bool fHit = false;
+            if (view.GetCoins(hash, coins)) {
+                mempool.pruneSpent(hash, coins);
+                if (coins.IsAvailable(vOutPoints[i].n)) {
+                    fHit = true;
+                    CCoin coin;
+                    coin.nTxVer = coins.nVersion;
+                    coin.nHeight = coins.nHeight;
+                    coin.out = coins.vout.at(vOutPoints[i].n);
+                    outs.push_back(coin);
+                }
+            }
+            if (fHit)
+                bitmap[i / 8] |= (1 << (i % 8));
+            bitmapStringRepresentation.append(fHit ? "1" : "0"); // form a binary string representation (human-readable for json output)
+        }
+
+        nChainHeight = chainActive.Height();
+        hashChainTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        // serialize data
+        // use exact same output as mentioned in Bip64
+        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
+
+        if (rf == RF_HEX) {
+            string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
+            conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        } else {
+            string ssGetUTXOResponseString = ssGetUTXOResponse.str();
+            conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, ssGetUTXOResponseString.size(), "application/octet-stream") << ssGetUTXOResponseString << std::flush;
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        writer.BeginObject();
+        writer.Key("chainHeight").Int(nChainHeight);
+        writer.Key("chaintipHash").String(hashChainTip.GetHex());
+        writer.Key("bitmap").String(bitmapStringRepresentation);
+        writer.Key("utxos").BeginArray();
+        BOOST_FOREACH (const CCoin& coin, outs) {
+            writer.BeginObject();
+            writer.Key("txvers").Int(coin.nTxVer);
+            writer.Key("height").Int(coin.nHeight);
+            writer.Key("value").Amount(coin.out.nValue);
+            writer.Key("scriptPubKey");
+            ScriptPubKeyToJSON(coin.out.scriptPubKey, writer, true);
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+        strJSON += "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
         string& strURI,
+        const string& strRequest,
         map<string, string>& mapHeaders,
         bool fRun);
 } uri_prefixes[] = {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/chaininfo", rest_chaininfo},
+    {"/rest/mempool/contents", rest_mempool_contents},
+    {"/rest/headers/", rest_headers},
+    {"/rest/getutxos", rest_getutxos},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
     string& strURI,
+    const string& strRequest,
     map<string, string>& mapHeaders,
     bool fRun)
 {
@@ -241,7 +610,8 @@ bool HTTPReq_REST(AcceptedConnection* conn,
             unsigned int plen = strlen(uri_prefixes[i].prefix);
             if (strURI.substr(0, plen) == uri_prefixes[i].prefix) {
                 string strReq = strURI.substr(plen);
-                return uri_prefixes[i].handler(conn, strReq, mapHeaders, fRun);
+                CRPCLatencyTimer timer(uri_prefixes[i].prefix);
+                return uri_prefixes[i].handler(conn, strReq, strRequest, mapHeaders, fRun);
             }
         }
     } catch (RestErr& re) {
@@ -6,9 +6,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "rpcserver.h"
 #include "sync.h"
+#include "txdb.h"
 #include "util.h"
 
 #include <stdint.h>
@@ -86,56 +88,85 @@ double GetPoSKernelPS()
     return result;
 }
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, CJSONWriter& writer, bool txDetails = false)
 {
-    Object result;
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    writer.BeginObject();
+    writer.Key("hash").String(block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.push_back(Pair("acc_checkpoint", block.nAccumulatorCheckpoint.GetHex()));
-    Array txs;
+    writer.Key("confirmations").Int(confirmations);
+    writer.Key("size").Int(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    writer.Key("height").Int(blockindex->nHeight);
+    writer.Key("version").Int(block.nVersion);
+    writer.Key("merkleroot").String(block.hashMerkleRoot.GetHex());
+    writer.Key("acc_checkpoint").String(block.nAccumulatorCheckpoint.GetHex());
+    writer.Key("tx").BeginArray();
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
         if (txDetails) {
+            // only one transaction is held as a tree at a time
             Object objTx;
             TxToJSON(tx, uint256(0), objTx);
-            txs.push_back(objTx);
+            writer.Raw(write_string(Value(objTx), false));
         } else
-            txs.push_back(tx.GetHash().GetHex());
+            writer.String(tx.GetHash().GetHex());
     }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    writer.EndArray();
+    writer.Key("time").Int(block.GetBlockTime());
+    writer.Key("nonce").Int(block.nNonce);
+    writer.Key("bits").String(strprintf("%08x", block.nBits));
+    writer.Key("difficulty").Real(GetDifficulty(blockindex));
+    writer.Key("chainwork").String(blockindex->nChainWork.GetHex());
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        writer.Key("previousblockhash").String(blockindex->pprev->GetBlockHash().GetHex());
     CBlockIndex* pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        writer.Key("nextblockhash").String(pnext->GetBlockHash().GetHex());
 
-    result.push_back(Pair("moneysupply",ValueFromAmount(blockindex->nMoneySupply)));
+    writer.Key("moneysupply").Amount(blockindex->nMoneySupply);
 
-    Object zoxidObj;
+    writer.Key("zOXIDsupply").BeginObject();
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zoxidObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        writer.Key(to_string(denom)).Amount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN));
     }
-    zoxidObj.emplace_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
-    result.emplace_back(Pair("zOXIDsupply", zoxidObj));
+    writer.Key("total").Amount(blockindex->GetZerocoinSupply());
+    writer.EndObject();
 
-    return result;
+    writer.EndObject();
 }
 
 
-Object blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex)
+/** Only reads header fields of blockindex, so callers don't need cs_main */
+void blockHeaderToJSON(const CBlockIndex* blockindex, const CChainTipSnapshot& tip, CJSONWriter& writer)
+{
+    writer.BeginObject();
+    writer.Key("hash").String(blockindex->GetBlockHash().GetHex());
+    int confirmations = -1;
+    // Only report confirmations if the block is on the main chain
+    if (tip.Contains(blockindex))
+        confirmations = tip.nHeight - blockindex->nHeight + 1;
+    writer.Key("confirmations").Int(confirmations);
+    writer.Key("height").Int(blockindex->nHeight);
+    writer.Key("version").Int(blockindex->nVersion);
+    writer.Key("merkleroot").String(blockindex->hashMerkleRoot.GetHex());
+    writer.Key("acc_checkpoint").String(blockindex->nAccumulatorCheckpoint.GetHex());
+    writer.Key("time").Int(blockindex->GetBlockTime());
+    writer.Key("nonce").Int(blockindex->nNonce);
+    writer.Key("bits").String(strprintf("%08x", blockindex->nBits));
+    writer.Key("difficulty").Real(GetDifficulty(blockindex));
+    writer.Key("chainwork").String(blockindex->nChainWork.GetHex());
+
+    if (blockindex->pprev)
+        writer.Key("previousblockhash").String(blockindex->pprev->GetBlockHash().GetHex());
+    const CBlockIndex* pnext = tip.Next(blockindex);
+    if (pnext)
+        writer.Key("nextblockhash").String(pnext->GetBlockHash().GetHex());
+    writer.EndObject();
+}
+
+Object blockHeaderToJSON(const CBlockHeader& block, const CBlockIndex* blockindex)
 {
     Object result;
     result.push_back(Pair("version", block.nVersion));
@@ -160,7 +191,7 @@ Value getblockcount(const Array& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    return chainActive.Height();
+    return GetChainTipSnapshot().nHeight;
 }
 
 Value getbestblockhash(const Array& params, bool fHelp)
@@ -174,7 +205,7 @@ Value getbestblockhash(const Array& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainTipSnapshot().hashBlock.GetHex();
 }
 
 Value getdifficulty(const Array& params, bool fHelp)
@@ -188,11 +219,11 @@ Value getdifficulty(const Array& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getdifficulty", "") + HelpExampleRpc("getdifficulty", ""));
 
-    return GetDifficulty();
+    return GetDifficulty(GetChainTipSnapshot().pindex);
 }
 
 
-Value getrawmempool(const Array& params, bool fHelp)
+void getrawmempool(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 1)
         throw runtime_error(
@@ -214,6 +245,12 @@ Value getrawmempool(const Array& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) fees of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) fees of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -228,40 +265,51 @@ Value getrawmempool(const Array& params, bool fHelp)
 
     if (fVerbose) {
         LOCK(mempool.cs);
-        Object o;
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            Object info;
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+        writer.BeginObject();
+        BOOST_FOREACH (const CTxMemPoolEntry& e, mempool.mapTx) {
+            const uint256& hash = e.GetTx().GetHash();
+            writer.Key(hash.ToString()).BeginObject();
+            writer.Key("size").Int(e.GetTxSize());
+            writer.Key("fee").Amount(e.GetFee());
+            writer.Key("time").Int(e.GetTime());
+            writer.Key("height").Int(e.GetHeight());
+            writer.Key("startingpriority").Real(e.GetPriority(e.GetHeight()));
+            writer.Key("currentpriority").Real(e.GetPriority(chainActive.Height()));
+            writer.Key("descendantcount").Int(e.GetCountWithDescendants());
+            writer.Key("descendantsize").Int(e.GetSizeWithDescendants());
+            writer.Key("descendantfees").Amount(e.GetFeesWithDescendants());
+            writer.Key("ancestorcount").Int(e.GetCountWithAncestors());
+            writer.Key("ancestorsize").Int(e.GetSizeWithAncestors());
+            writer.Key("ancestorfees").Amount(e.GetFeesWithAncestors());
             const CTransaction& tx = e.GetTx();
             set<string> setDepends;
             BOOST_FOREACH (const CTxIn& txin, tx.vin) {
                 if (mempool.exists(txin.prevout.hash))
                     setDepends.insert(txin.prevout.hash.ToString());
             }
-            Array depends(setDepends.begin(), setDepends.end());
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+            writer.Key("depends").BeginArray();
+            BOOST_FOREACH (const string& dep, setDepends)
+                writer.String(dep);
+            writer.EndArray();
+            writer.EndObject();
         }
-        return o;
+        writer.EndObject();
     } else {
         vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
 
-        Array a;
+        writer.BeginArray();
         BOOST_FOREACH (const uint256& hash, vtxid)
-            a.push_back(hash.ToString());
-
-        return a;
+            writer.String(hash.ToString());
+        writer.EndArray();
     }
 }
 
+Value getrawmempool(const Array& params, bool fHelp)
+{
+    return ValueFromJSONStream(&getrawmempool, params, fHelp);
+}
+
 Value getblockhash(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -275,15 +323,16 @@ Value getblockhash(const Array& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
+    CChainTipSnapshot tip = GetChainTipSnapshot();
+
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > tip.nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
-    return pblockindex->GetBlockHash().GetHex();
+    return tip[nHeight]->GetBlockHash().GetHex();
 }
 
-Value getblock(const Array& params, bool fHelp)
+void getblock(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
@@ -325,23 +374,34 @@ Value getblock(const Array& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+    }
 
+    // The disk read doesn't need cs_main, the index entry is never freed
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        writer.String(HexStr(ssBlock.begin(), ssBlock.end()));
+        return;
     }
 
-    return blockToJSON(block, pblockindex);
+    LOCK(cs_main);
+    blockToJSON(block, pblockindex, writer);
+}
+
+Value getblock(const Array& params, bool fHelp)
+{
+    return ValueFromJSONStream(&getblock, params, fHelp);
 }
 
 Value getblockheader(const Array& params, bool fHelp)
@@ -375,58 +435,106 @@ Value getblockheader(const Array& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    // The header is rebuilt from the block index, neither cs_main nor a disk read is needed
+    const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockHeader header = pblockindex->GetBlockHeader();
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block.GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockHeaderToJSON(block, pblockindex);
+    return blockHeaderToJSON(header, pblockindex);
 }
 
 Value gettxoutsetinfo(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are kept up to date for every connected block, so the default hash_type\n"
+            "answers at once. The first call on an existing chain scans the UTXO set once to seed them.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=commitment) \"commitment\" for the running commitment,\n"
+            "                    \"hash_serialized\" to also hash the serialized UTXO set, which scans the whole set\n"
+            "2. hash_or_height   (string or numeric, optional) The block hash or height of a block in the active chain,\n"
+            "                    only for \"commitment\"; default is the current tip\n"
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
+            "  \"height\":n,     (numeric) The block height (index)\n"
+            "  \"bestblock\": \"hex\",   (string) the block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_outputs\": n,     (numeric) The serialized size of the outputs and their outpoints\n"
+            "  \"hash_commitment\": \"hash\",   (string) The sum of the output hashes, independent of their order\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (hash_serialized only)\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (hash_serialized only)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"commitment\" 1000") +
+            HelpExampleCli("gettxoutsetinfo", "\"hash_serialized\"") + HelpExampleRpc("gettxoutsetinfo", ""));
 
-    Object ret;
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "commitment";
+    if (strHashType != "commitment" && strHashType != "hash_serialized")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+    bool fScan = strHashType == "hash_serialized";
+    if (fScan && params.size() > 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized is only available for the current tip");
+
+    LOCK(cs_main);
+
+    CBlockIndex* pindex = chainActive.Tip();
+    if (params.size() > 1) {
+        const Value& target = params[1];
+        // the command line passes heights as strings, block hashes are always 64 hex digits
+        int32_t nHeight = 0;
+        if (target.type() == int_type || (target.type() == str_type && target.get_str().size() < 64 && ParseInt32(target.get_str(), &nHeight))) {
+            if (target.type() == int_type)
+                nHeight = target.get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            pindex = chainActive[nHeight];
+        } else {
+            BlockMap::iterator mi = mapBlockIndex.find(ParseHashV(target, "hash_or_height"));
+            if (mi == mapBlockIndex.end())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            pindex = mi->second;
+            if (!chainActive.Contains(pindex))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block is not in the active chain");
+        }
+    }
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    if (fScan || !pblocktree->ReadUTXOStats(pindex->GetBlockHash(), stats)) {
+        if (pindex != chainActive.Tip())
+            throw JSONRPCError(RPC_MISC_ERROR, "No UTXO set statistics for this block, they are kept from the first gettxoutsetinfo call on");
+        stats = CCoinsStats();
+        FlushStateToDisk();
+        if (!pcoinsTip->GetStats(stats))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        // seed the running statistics, ConnectBlock carries them forward from here
+        if (!pblocktree->WriteUTXOStats(stats))
+            LogPrintf("%s: failed to write UTXO set statistics for %s\n", __func__, stats.hashBlock.ToString());
+    }
+
+    Object ret;
+    ret.push_back(Pair("height", (int64_t)stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("bytes_outputs", (int64_t)stats.nOutputBytes));
+    ret.push_back(Pair("hash_commitment", stats.hashCommitment.GetHex()));
+    if (fScan) {
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     return ret;
 }
 
@@ -474,6 +582,7 @@ Value gettxout(const Array& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
+    LOCK(cs_main);
     CCoins coins;
     if (fMempool) {
         LOCK(mempool.cs);
@@ -526,7 +635,7 @@ Value verifychain(const Array& params, bool fHelp)
     return CVerifyDB().VerifyDB(pcoinsTip, nCheckLevel, nCheckDepth);
 }
 
-Value getblockchaininfo(const Array& params, bool fHelp)
+void getblockchaininfo(const Array& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() != 0)
         throw runtime_error(
@@ -545,15 +654,20 @@ Value getblockchaininfo(const Array& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
 
-    Object obj;
-    obj.push_back(Pair("chain", Params().NetworkIDString()));
-    obj.push_back(Pair("blocks", (int)chainActive.Height()));
-    obj.push_back(Pair("headers", pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash", chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty", (double)GetDifficulty()));
-    obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
-    obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
-    return obj;
+    writer.BeginObject();
+    writer.Key("chain").String(Params().NetworkIDString());
+    writer.Key("blocks").Int(chainActive.Height());
+    writer.Key("headers").Int(pindexBestHeader ? pindexBestHeader->nHeight : -1);
+    writer.Key("bestblockhash").String(chainActive.Tip()->GetBlockHash().GetHex());
+    writer.Key("difficulty").Real(GetDifficulty());
+    writer.Key("verificationprogress").Real(Checkpoints::GuessVerificationProgress(chainActive.Tip()));
+    writer.Key("chainwork").String(chainActive.Tip()->nChainWork.GetHex());
+    writer.EndObject();
+}
+
+Value getblockchaininfo(const Array& params, bool fHelp)
+{
+    return ValueFromJSONStream(&getblockchaininfo, params, fHelp);
 }
 
 /** Comparison function for sorting the getchaintips heads.  */
@@ -664,6 +778,9 @@ Value getmempoolinfo(const Array& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"usage\": xxxxx               (numeric) Estimated memory usage of the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee per kB for a transaction to be accepted\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", ""));
@@ -671,6 +788,41 @@ Value getmempoolinfo(const Array& params, bool fHelp)
     Object ret;
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
+
+    return ret;
+}
+
+Value getmempoolhistogram(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmempoolhistogram\n"
+            "\nReturns the transactions in the memory pool grouped by fee rate, lowest fee rate first.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"feerate\": x.xxxx,       (numeric) Lowest fee rate per kB in this range\n"
+            "    \"count\": xxxxx,          (numeric) Number of transactions\n"
+            "    \"size\": xxxxx,           (numeric) Sum of their sizes in bytes\n"
+            "    \"fees\": x.xxxx           (numeric) Sum of their fees\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmempoolhistogram", "") + HelpExampleRpc("getmempoolhistogram", ""));
+
+    Array ret;
+    BOOST_FOREACH (const CFeeRateBucket& bucket, mempool.GetFeeHistogram()) {
+        Object obj;
+        obj.push_back(Pair("feerate", ValueFromAmount(bucket.nMinFeeRate)));
+        obj.push_back(Pair("count", bucket.nCount));
+        obj.push_back(Pair("size", bucket.nSize));
+        obj.push_back(Pair("fees", ValueFromAmount(bucket.nFees)));
+        ret.push_back(obj);
+    }
 
     return ret;
 }
@@ -872,3 +1024,98 @@ Value getinvalid (const Array& params, bool fHelp)
     ret.emplace_back(obj);
     return ret;
 }
+
+static void ZerocoinIndexRangeToJSON(unsigned char type, const Array& params, CJSONWriter& writer)
+{
+    if (!fZerocoinIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "The zerocoin index is not built yet");
+
+    int nStart = params[0].get_int();
+    int nEnd = params[1].get_int();
+    if (nStart < 0 || nEnd < nStart)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+
+    int nDenomination = 0;
+    if (params.size() > 2) {
+        nDenomination = params[2].get_int();
+        if (libzerocoin::IntToZerocoinDenomination(nDenomination) == libzerocoin::ZQ_ERROR)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid denomination");
+    }
+
+    std::vector<std::pair<CZerocoinHeightKey, CBigNum> > vEntries;
+    if (!zerocoinDB->ReadZerocoinIndexRange(type, nStart, nEnd, nDenomination, vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the zerocoin index");
+
+    writer.BeginArray();
+    for (std::vector<std::pair<CZerocoinHeightKey, CBigNum> >::const_iterator it = vEntries.begin(); it != vEntries.end(); ++it) {
+        writer.BeginObject();
+        writer.Key("height").Int(it->first.nHeight);
+        writer.Key("txid").String(it->first.txid.GetHex());
+        writer.Key("denomination").Int(it->first.nDenomination);
+        writer.Key(type == ZEROCOIN_INDEX_MINT ? "pubcoin" : "serial").String(it->second.GetHex());
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+void getzerocoinmints(const Array& params, bool fHelp, CJSONWriter& writer)
+{
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw runtime_error(
+            "getzerocoinmints start end ( denomination )\n"
+            "\nReturns the zerocoin mints confirmed between two block heights, in chain order.\n"
+            "\nArguments:\n"
+            "1. start           (numeric, required) The first block height\n"
+            "2. end             (numeric, required) The last block height\n"
+            "3. denomination    (numeric, optional) Only return mints of this denomination\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\" : n,          (numeric) The height of the block containing the mint\n"
+            "    \"txid\" : \"hash\",       (string) The mint transaction id\n"
+            "    \"denomination\" : n,    (numeric) The denomination of the mint\n"
+            "    \"pubcoin\" : \"hex\"      (string) The public coin value\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getzerocoinmints", "1000 2000 10") + HelpExampleRpc("getzerocoinmints", "1000, 2000"));
+
+    ZerocoinIndexRangeToJSON(ZEROCOIN_INDEX_MINT, params, writer);
+}
+
+Value getzerocoinmints(const Array& params, bool fHelp)
+{
+    return ValueFromJSONStream(&getzerocoinmints, params, fHelp);
+}
+
+void getzerocoinspends(const Array& params, bool fHelp, CJSONWriter& writer)
+{
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw runtime_error(
+            "getzerocoinspends start end ( denomination )\n"
+            "\nReturns the zerocoin spends confirmed between two block heights, in chain order.\n"
+            "\nArguments:\n"
+            "1. start           (numeric, required) The first block height\n"
+            "2. end             (numeric, required) The last block height\n"
+            "3. denomination    (numeric, optional) Only return spends of this denomination\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\" : n,          (numeric) The height of the block containing the spend\n"
+            "    \"txid\" : \"hash\",       (string) The spend transaction id\n"
+            "    \"denomination\" : n,    (numeric) The denomination of the spent coin\n"
+            "    \"serial\" : \"hex\"       (string) The serial of the spent coin\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getzerocoinspends", "1000 2000 10") + HelpExampleRpc("getzerocoinspends", "1000, 2000"));
+
+    ZerocoinIndexRangeToJSON(ZEROCOIN_INDEX_SPEND, params, writer);
+}
+
+Value getzerocoinspends(const Array& params, bool fHelp)
+{
+    return ValueFromJSONStream(&getzerocoinspends, params, fHelp);
+}
@@ -7,6 +7,7 @@
 #include "activemasternode.h"
 #include "db.h"
 #include "init.h"
+#include "instanttx.h"
 #include "main.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
@@ -995,3 +996,48 @@ Value getmasternodescores (const Array& params, bool fHelp)
 
     return obj;
 }
+
+Value getinstanttxstats (const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getinstanttxstats\n"
+            "\nReturns the time transaction locks took from request to completion\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"requested\": n,      (numeric) Lock requests seen by this node\n"
+            "  \"completed\": n,      (numeric) Requested locks that reached the required votes\n"
+            "  \"expired\": n,        (numeric) Requested locks removed before completing\n"
+            "  \"averagems\": n,      (numeric) Average lock time of completed locks in milliseconds\n"
+            "  \"histogram\": [       (array) Completed locks by lock time\n"
+            "    {\n"
+            "      \"maxms\": n,      (numeric) Upper bound of the bucket in milliseconds, -1 if unbounded\n"
+            "      \"count\": n       (numeric) Locks in the bucket\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getinstanttxstats", "") + HelpExampleRpc("getinstanttxstats", ""));
+
+    CLockLatencyStats stats;
+    GetLockLatencyStats(stats);
+
+    Array histogram;
+    for (unsigned int i = 0; i < stats.vBuckets.size(); i++) {
+        Object bucket;
+        bucket.push_back(Pair("maxms", stats.vBuckets[i].first));
+        bucket.push_back(Pair("count", (uint64_t)stats.vBuckets[i].second));
+        histogram.push_back(bucket);
+    }
+
+    Object obj;
+    obj.push_back(Pair("requested", (uint64_t)stats.nRequested));
+    obj.push_back(Pair("completed", (uint64_t)stats.nCompleted));
+    obj.push_back(Pair("expired", (uint64_t)stats.nExpired));
+    obj.push_back(Pair("averagems", stats.nCompleted > 0 ? stats.nTotalMillis / (int64_t)stats.nCompleted : 0));
+    obj.push_back(Pair("histogram", histogram));
+
+    return obj;
+}
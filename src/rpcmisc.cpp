@@ -489,6 +489,240 @@ Value setmocktime(const Array& params, bool fHelp)
     return Value::null;
 }
 
+static bool GetIndexKeyFromAddress(const std::string& strAddress, uint160& hashBytes, int& nType)
+{
+    CTxDestination dest = CBitcoinAddress(strAddress).Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        nType = ADDRESS_TYPE_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        nType = ADDRESS_TYPE_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+static std::string GetAddressFromIndexKey(const uint160& hashBytes, int nType)
+{
+    if (nType == ADDRESS_TYPE_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+static void GetAddressesFromParams(const Array& params, std::vector<std::pair<uint160, int> >& vAddresses)
+{
+    std::vector<std::string> vStrAddresses;
+    if (params[0].type() == str_type) {
+        vStrAddresses.push_back(params[0].get_str());
+    } else if (params[0].type() == obj_type) {
+        Value addressValues = find_value(params[0].get_obj(), "addresses");
+        if (addressValues.type() != array_type)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Addresses is expected to be an array");
+        BOOST_FOREACH (const Value& address, addressValues.get_array())
+            vStrAddresses.push_back(address.get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vStrAddresses) {
+        uint160 hashBytes;
+        int nType = 0;
+        if (!GetIndexKeyFromAddress(strAddress, hashBytes, nType))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        vAddresses.push_back(std::make_pair(hashBytes, nType));
+    }
+}
+
+static bool HeightSortUnspent(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a,
+    const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    return a.second.blockHeight < b.second.blockHeight;
+}
+
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\":[\"address\",...]}\n"
+            "\nReturns the balance for one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string) The base58check encoded address, or\n"
+            "   {\"addresses\":[\"address\",...]}  (object) a list of addresses\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,   (numeric) The current balance in btc\n"
+            "  \"received\": n   (numeric) The total amount received in btc, including change\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "\"D5ZGUw7rEctqWVbazWgYE4Tz8ThUsXg8rg\"") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\":[\"D5ZGUw7rEctqWVbazWgYE4Tz8ThUsXg8rg\"]}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    GetAddressesFromParams(params, vAddresses);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); ++it) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator entry = addressIndex.begin(); entry != addressIndex.end(); ++entry) {
+            if (entry->second > 0)
+                nReceived += entry->second;
+            nBalance += entry->second;
+        }
+    }
+
+    Object result;
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return result;
+}
+
+Value getaddressutxos(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\":[\"address\",...]}\n"
+            "\nReturns all unspent outputs for one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string) The base58check encoded address, or\n"
+            "   {\"addresses\":[\"address\",...]}  (object) a list of addresses\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\": n,      (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The script hex\n"
+            "    \"amount\": n,           (numeric) The amount of the output in btc\n"
+            "    \"height\": n            (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "\"D5ZGUw7rEctqWVbazWgYE4Tz8ThUsXg8rg\"") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\":[\"D5ZGUw7rEctqWVbazWgYE4Tz8ThUsXg8rg\"]}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    GetAddressesFromParams(params, vAddresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); ++it) {
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    std::sort(unspentOutputs.begin(), unspentOutputs.end(), HeightSortUnspent);
+
+    Array result;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); ++it) {
+        Object output;
+        output.push_back(Pair("address", GetAddressFromIndexKey(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("amount", ValueFromAmount(it->second.satoshis)));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+Value getaddresstxids(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\":[\"address\",...],\"start\":n,\"end\":n}\n"
+            "\nReturns the txids for one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string) The base58check encoded address, or\n"
+            "   {\"addresses\":[\"address\",...]}  (object) a list of addresses, with an optional\n"
+            "                  \"start\" and \"end\" block height (inclusive), given together\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "\"D5ZGUw7rEctqWVbazWgYE4Tz8ThUsXg8rg\"") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\":[\"D5ZGUw7rEctqWVbazWgYE4Tz8ThUsXg8rg\"],\"start\":1000,\"end\":2000}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    GetAddressesFromParams(params, vAddresses);
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params[0].type() == obj_type) {
+        Value startValue = find_value(params[0].get_obj(), "start");
+        Value endValue = find_value(params[0].get_obj(), "end");
+        if (startValue.type() != null_type || endValue.type() != null_type) {
+            // a range needs both ends, one of them alone would be silently ignored
+            if (startValue.type() != int_type || endValue.type() != int_type)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Both start and end heights are needed for a range");
+            nStart = startValue.get_int();
+            nEnd = endValue.get_int();
+            if (nStart <= 0 || nEnd < nStart)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+        }
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); ++it) {
+        if (!GetAddressIndex(it->first, it->second, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    // entries of one address are already in chain order, several addresses have to be merged
+    std::set<std::pair<int, std::pair<unsigned int, uint256> > > setTxids;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); ++it)
+        setTxids.insert(std::make_pair(it->first.blockHeight, std::make_pair(it->first.txindex, it->first.txhash)));
+
+    Array result;
+    for (std::set<std::pair<int, std::pair<unsigned int, uint256> > >::const_iterator it = setTxids.begin(); it != setTxids.end(); ++it)
+        result.push_back(it->second.second.GetHex());
+    return result;
+}
+
+Value getspentinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || params[0].type() != obj_type)
+        throw runtime_error(
+            "getspentinfo {\"txid\":\"hash\",\"index\":n}\n"
+            "\nReturns the txid and input index where an output is spent (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\"txid\":\"hash\",\"index\":n}  (object) The transaction id and output index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",  (string) The id of the spending transaction\n"
+            "  \"index\": n,      (numeric) The index of the spending input\n"
+            "  \"height\": n      (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    Value txidValue = find_value(params[0].get_obj(), "txid");
+    Value indexValue = find_value(params[0].get_obj(), "index");
+    if (txidValue.type() != str_type || indexValue.type() != int_type)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txidValue, "txid"), indexValue.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    Object result;
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 Value getstakingstatus(const Array& params, bool fHelp)
 {
@@ -78,6 +78,8 @@ static const char* httpStatusDescription(int nStatus)
         return "Not Found";
     case HTTP_INTERNAL_SERVER_ERROR:
         return "Internal Server Error";
+    case HTTP_SERVICE_UNAVAILABLE:
+        return "Service Unavailable";
     default:
         return "";
     }
@@ -235,16 +237,21 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string, string>& mapHe
         strMessageRet = string(vch.begin(), vch.end());
     }
 
-    string sConHdr = mapHeadersRet["connection"];
+    SetHTTPConnectionDefault(mapHeadersRet, nProto);
+
+    return HTTP_OK;
+}
+
+void SetHTTPConnectionDefault(map<string, string>& mapHeaders, int nProto)
+{
+    string sConHdr = mapHeaders["connection"];
 
     if ((sConHdr != "close") && (sConHdr != "keep-alive")) {
         if (nProto >= 1)
-            mapHeadersRet["connection"] = "keep-alive";
+            mapHeaders["connection"] = "keep-alive";
         else
-            mapHeadersRet["connection"] = "close";
+            mapHeaders["connection"] = "close";
     }
-
-    return HTTP_OK;
 }
 
 /**
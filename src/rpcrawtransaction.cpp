@@ -8,6 +8,7 @@
 #include "base58.h"
 #include "core_io.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
@@ -57,6 +58,33 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey, Object& out, bool fIncludeH
     out.push_back(Pair("addresses", a));
 }
 
+void ScriptPubKeyToJSON(const CScript& scriptPubKey, CJSONWriter& writer, bool fIncludeHex)
+{
+    txnouttype type;
+    vector<CTxDestination> addresses;
+    int nRequired;
+
+    writer.BeginObject();
+    writer.Key("asm").String(scriptPubKey.ToString());
+    if (fIncludeHex)
+        writer.Key("hex").String(HexStr(scriptPubKey.begin(), scriptPubKey.end()));
+
+    if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired)) {
+        writer.Key("type").String(GetTxnOutputType(type));
+        writer.EndObject();
+        return;
+    }
+
+    writer.Key("reqSigs").Int(nRequired);
+    writer.Key("type").String(GetTxnOutputType(type));
+
+    writer.Key("addresses").BeginArray();
+    BOOST_FOREACH (const CTxDestination& addr, addresses)
+        writer.String(CBitcoinAddress(addr).ToString());
+    writer.EndArray();
+    writer.EndObject();
+}
+
 void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
 {
     entry.push_back(Pair("txid", tx.GetHash().GetHex()));
@@ -188,7 +216,10 @@ Value getrawtransaction(const Array& params, bool fHelp)
 
     Object result;
     result.push_back(Pair("hex", strHex));
-    TxToJSON(tx, hashBlock, result);
+    {
+        LOCK(cs_main);
+        TxToJSON(tx, hashBlock, result);
+    }
     return result;
 }
 
@@ -9,7 +9,9 @@
 
 #include "base58.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "main.h"
+#include "rpcworkqueue.h"
 #include "ui_interface.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
@@ -35,6 +37,19 @@ using namespace std;
 
 static std::string strRPCUserColonPass;
 
+/** Call count and latency of one RPC method or REST resource */
+struct CRPCEndpointStats {
+    uint64_t nCalls;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+
+    CRPCEndpointStats() : nCalls(0), nTotalMicros(0), nMaxMicros(0) {}
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCEndpointStats> mapRPCStats;
+static uint64_t nRPCRejected = 0; //!< requests refused because the work queue was full
+
 static bool fRPCRunning = false;
 static bool fRPCInWarmup = true;
 static std::string rpcWarmupStatus("RPC server started");
@@ -48,6 +63,12 @@ static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work* rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+static CRPCWorkQueue* rpc_work_queue = NULL;
+static boost::thread_group* rpc_work_queue_group = NULL;
+static int rpc_work_queue_threads = 0;
+static CRPCWorkQueue* rpc_batch_queue = NULL; //!< helpers for batch members, kept apart so a batch can't fill rpc_work_queue
+static boost::thread_group* rpc_batch_queue_group = NULL;
+static int rpc_batch_queue_threads = 0;
 
 void RPCTypeCheck(const Array& params,
     const list<Value_type>& typesExpected,
@@ -244,6 +265,70 @@ Value stop(const Array& params, bool fHelp)
 }
 
 
+CRPCLatencyTimer::CRPCLatencyTimer(const std::string& strEndpointIn) : strEndpoint(strEndpointIn), nStart(GetTimeMicros())
+{
+}
+
+CRPCLatencyTimer::~CRPCLatencyTimer()
+{
+    int64_t nMicros = GetTimeMicros() - nStart;
+    LOCK(cs_rpcStats);
+    CRPCEndpointStats& stats = mapRPCStats[strEndpoint];
+    stats.nCalls++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+}
+
+Value getrpcstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcstats\n"
+            "\nReturns the state of the RPC work queue and the call count and latency of every RPC method and REST resource used so far.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workqueue\": {\n"
+            "    \"threads\": n,          (numeric) Number of threads servicing requests\n"
+            "    \"depth\": n,            (numeric) Requests waiting for a thread\n"
+            "    \"maxdepth\": n,         (numeric) Size of the work queue (-rpcworkqueue)\n"
+            "    \"rejected\": n          (numeric) Requests refused with 503 because the queue was full\n"
+            "  },\n"
+            "  \"endpoints\": {\n"
+            "    \"name\": {              (string) RPC method or REST resource\n"
+            "      \"calls\": n,          (numeric) Number of calls\n"
+            "      \"avg_ms\": x.xxx,     (numeric) Average latency in milliseconds\n"
+            "      \"max_ms\": x.xxx      (numeric) Highest latency in milliseconds\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcstats", "") + HelpExampleRpc("getrpcstats", ""));
+
+    Object queue;
+    queue.push_back(Pair("threads", rpc_work_queue_threads));
+    queue.push_back(Pair("depth", (uint64_t)(rpc_work_queue ? rpc_work_queue->Depth() : 0)));
+    queue.push_back(Pair("maxdepth", (uint64_t)(rpc_work_queue ? rpc_work_queue->MaxDepth() : 0)));
+
+    Object endpoints;
+    {
+        LOCK(cs_rpcStats);
+        queue.push_back(Pair("rejected", nRPCRejected));
+        BOOST_FOREACH (const PAIRTYPE(std::string, CRPCEndpointStats) & item, mapRPCStats) {
+            Object entry;
+            entry.push_back(Pair("calls", item.second.nCalls));
+            entry.push_back(Pair("avg_ms", item.second.nTotalMicros / 1000.0 / item.second.nCalls));
+            entry.push_back(Pair("max_ms", item.second.nMaxMicros / 1000.0));
+            endpoints.push_back(Pair(item.first, entry));
+        }
+    }
+
+    Object ret;
+    ret.push_back(Pair("workqueue", queue));
+    ret.push_back(Pair("endpoints", endpoints));
+    return ret;
+}
+
+
 /**
  * Call Table
  */
@@ -255,6 +340,7 @@ static const CRPCCommand vRPCCommands[] =
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
+        {"control", "getrpcstats", &getrpcstats, true, true, false},
 
         /* P2P networking */
         {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
@@ -266,18 +352,22 @@ static const CRPCCommand vRPCCommands[] =
         {"network", "ping", &ping, true, false, false},
 
         /* Block chain and UTXO */
-        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
-        {"blockchain", "getblockheader", &getblockheader, false, false, false},
+        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false, &getblockchaininfo},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, true, false},
+        {"blockchain", "getblockcount", &getblockcount, true, true, false},
+        {"blockchain", "getblock", &getblock, true, true, false, &getblock},
+        {"blockchain", "getblockhash", &getblockhash, true, true, false},
+        {"blockchain", "getblockheader", &getblockheader, false, true, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
-        {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
+        {"blockchain", "getdifficulty", &getdifficulty, true, true, false},
+        {"blockchain", "getmempoolhistogram", &getmempoolhistogram, true, true, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
-        {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
-        {"blockchain", "gettxout", &gettxout, true, false, false},
-        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
+        {"blockchain", "getrawmempool", &getrawmempool, true, false, false, &getrawmempool},
+        {"blockchain", "getspentinfo", &getspentinfo, true, true, false},
+        {"blockchain", "gettxout", &gettxout, true, true, false},
+        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, true, false},
+        {"blockchain", "getzerocoinmints", &getzerocoinmints, true, true, false, &getzerocoinmints},
+        {"blockchain", "getzerocoinspends", &getzerocoinspends, true, true, false, &getzerocoinspends},
         {"blockchain", "verifychain", &verifychain, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -303,7 +393,7 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
         {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
         {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, true, false},
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
@@ -314,6 +404,11 @@ static const CRPCCommand vRPCCommands[] =
         {"util", "estimatefee", &estimatefee, true, true, false},
         {"util", "estimatepriority", &estimatepriority, true, true, false},
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, true, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, true, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, true, false},
+
         /* Not shown in help */
         {"hidden", "invalidateblock", &invalidateblock, true, true, false},
         {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -334,6 +429,7 @@ static const CRPCCommand vRPCCommands[] =
         {"oxid", "getmasternodestatus", &getmasternodestatus, true, true, false},
         {"oxid", "getmasternodewinners", &getmasternodewinners, true, true, false},
         {"oxid", "getmasternodescores", &getmasternodescores, true, true, false},
+        {"oxid", "getinstanttxstats", &getinstanttxstats, true, true, false},
         {"oxid", "mnsync", &mnsync, true, true, false},
         {"oxid", "spork", &spork, true, true, false},
 #ifdef ENABLE_WALLET
@@ -459,6 +555,46 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
+//! Largest request line and headers accepted by the asynchronous reader
+static const size_t MAX_HTTP_HEADERS_SIZE = 8192;
+
+/**
+ * Match condition for async_read_until: the end of the headers, or giving up
+ * once more than MAX_HTTP_HEADERS_SIZE bytes arrived without it. The streambuf
+ * only bounds the whole request, so the header limit is enforced here.
+ */
+class CHTTPHeadersEnd
+{
+public:
+    explicit CHTTPHeadersEnd(const asio::streambuf& bufIn) : buf(bufIn) {}
+
+    template <typename Iterator>
+    std::pair<Iterator, bool> operator()(Iterator begin, Iterator end) const
+    {
+        static const char pszEnd[] = "\r\n\r\n";
+        Iterator it = std::search(begin, end, pszEnd, pszEnd + 4);
+        if (it != end)
+            return std::make_pair(it + 4, true);
+        if (buf.size() > MAX_HTTP_HEADERS_SIZE)
+            return std::make_pair(end, true);
+        // the end may straddle the next read, search its last bytes again
+        return std::make_pair(end - begin > 3 ? end - 3 : begin, false);
+    }
+
+private:
+    const asio::streambuf& buf;
+};
+
+namespace boost
+{
+namespace asio
+{
+template <>
+struct is_match_condition<CHTTPHeadersEnd> : public boost::true_type {
+};
+} // namespace asio
+} // namespace boost
+
 template <typename Protocol>
 class AcceptedConnectionImpl : public AcceptedConnection
 {
@@ -467,6 +603,7 @@ public:
         asio::io_service& io_service,
         ssl::context& context,
         bool fUseSSL) : sslStream(io_service, context),
+                        requestBuf(MAX_SIZE + MAX_HTTP_HEADERS_SIZE),
                         _d(sslStream, fUseSSL),
                         _stream(_d)
     {
@@ -489,6 +626,8 @@ public:
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
+    //! Bytes read from the socket but not parsed yet, may hold pipelined requests
+    asio::streambuf requestBuf;
 
 private:
     SSLIOStreamDevice<Protocol> _d;
@@ -496,6 +635,119 @@ private:
 };
 
 void ServiceConnection(AcceptedConnection* conn);
+static bool HTTPReq(AcceptedConnection* conn, string& strURI, string& strRequest, map<string, string>& mapHeaders, bool fRun);
+
+typedef AcceptedConnectionImpl<ip::tcp> RPCConnection;
+
+/** A request read by the I/O thread, waiting in the work queue */
+struct RPCRequest {
+    int nProto;
+    string strMethod;
+    string strURI;
+    string strBody;
+    map<string, string> mapHeaders;
+
+    RPCRequest() : nProto(0) {}
+};
+
+static void RPCReadRequest(boost::shared_ptr<RPCConnection> conn);
+
+static void RPCCloseAfterReply(boost::shared_ptr<RPCConnection> conn, boost::shared_ptr<std::string> strReply, const boost::system::error_code& error)
+{
+    conn->close();
+}
+
+/** I/O thread: send an error reply and close the connection without blocking on the client */
+static void RPCReplyAndClose(boost::shared_ptr<RPCConnection> conn, const std::string& strReply)
+{
+    // the buffer has to outlive the write, the handler keeps it
+    boost::shared_ptr<std::string> reply(new std::string(strReply));
+    asio::async_write(conn->sslStream.next_layer(), asio::buffer(*reply),
+        boost::bind(&RPCCloseAfterReply, conn, reply, _1));
+}
+
+/**
+ * Worker thread: answer a request, then go back to waiting for the next one
+ * on the connection unless it is to be closed.
+ */
+static void RPCServiceRequest(boost::shared_ptr<RPCConnection> conn, boost::shared_ptr<RPCRequest> req)
+{
+    // HTTP Keep-Alive is false; close connection after this reply
+    bool fRun = (req->mapHeaders["connection"] != "close") && GetBoolArg("-rpckeepalive", true);
+
+    if (HTTPReq(conn.get(), req->strURI, req->strBody, req->mapHeaders, fRun) && fRun && !ShutdownRequested())
+        RPCReadRequest(conn);
+    else
+        conn->close();
+}
+
+/** I/O thread: the request is complete, hand it to the workers */
+static void RPCReadBody(boost::shared_ptr<RPCConnection> conn,
+    boost::shared_ptr<RPCRequest> req,
+    size_t nLen,
+    const boost::system::error_code& error)
+{
+    if (error) {
+        conn->close();
+        return;
+    }
+
+    if (nLen > 0) {
+        std::istream stream(&conn->requestBuf);
+        req->strBody.resize(nLen);
+        stream.read(&req->strBody[0], nLen);
+    }
+
+    if (!rpc_work_queue->Enqueue(boost::bind(&RPCServiceRequest, conn, req))) {
+        LogPrint("rpc", "RPC work queue full, refusing request from %s\n", conn->peer_address_to_string());
+        {
+            LOCK(cs_rpcStats);
+            nRPCRejected++;
+        }
+        RPCReplyAndClose(conn, HTTPError(HTTP_SERVICE_UNAVAILABLE, false));
+    }
+}
+
+/** I/O thread: parse the request line and headers, then wait for the body */
+static void RPCReadHeaders(boost::shared_ptr<RPCConnection> conn, const boost::system::error_code& error, size_t nHeadersSize)
+{
+    // Client went away, or sent more header data than we accept
+    if (error || nHeadersSize > MAX_HTTP_HEADERS_SIZE) {
+        conn->close();
+        return;
+    }
+
+    boost::shared_ptr<RPCRequest> req(new RPCRequest());
+    std::istream stream(&conn->requestBuf);
+    if (!ReadHTTPRequestLine(stream, req->nProto, req->strMethod, req->strURI)) {
+        conn->close();
+        return;
+    }
+    int nLen = ReadHTTPHeaders(stream, req->mapHeaders);
+    if (nLen < 0 || (size_t)nLen > MAX_SIZE) {
+        RPCReplyAndClose(conn, HTTPError(HTTP_BAD_REQUEST, false));
+        return;
+    }
+    SetHTTPConnectionDefault(req->mapHeaders, req->nProto);
+
+    // Pipelined clients may already have sent the body, or even the next requests
+    if (conn->requestBuf.size() < (size_t)nLen)
+        asio::async_read(conn->sslStream.next_layer(), conn->requestBuf,
+            asio::transfer_exactly(nLen - conn->requestBuf.size()),
+            boost::bind(&RPCReadBody, conn, req, (size_t)nLen, _1));
+    else
+        RPCReadBody(conn, req, nLen, boost::system::error_code());
+}
+
+/**
+ * Wait for the next request on a connection without tying up a thread, so
+ * idle keep-alive connections cost nothing but a socket.
+ */
+static void RPCReadRequest(boost::shared_ptr<RPCConnection> conn)
+{
+    asio::async_read_until(conn->sslStream.next_layer(), conn->requestBuf, CHTTPHeadersEnd(conn->requestBuf),
+        boost::bind(&RPCReadHeaders, conn, _1, _2));
+}
 
 //! Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
@@ -556,7 +808,10 @@ static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, S
         if (!fUseSSL)
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
         conn->close();
+    } else if (rpc_work_queue && tcp_conn) {
+        RPCReadRequest(boost::static_pointer_cast<RPCConnection>(conn));
     } else {
+        // SSL connections are served synchronously on the I/O threads
         ServiceConnection(conn.get());
         conn->close();
     }
@@ -718,9 +973,28 @@ void StartRPCThreads()
         return;
     }
 
+    // Plain HTTP connections are read asynchronously by a single I/O thread and
+    // the requests are answered by a pool of workers; SSL connections keep
+    // the thread-per-connection model, so they need all threads on the I/O service.
+    int nThreads = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
+    for (int i = 0; i < (fUseSSL ? nThreads : 1); i++)
         rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    if (!fUseSSL) {
+        rpc_work_queue = new CRPCWorkQueue(std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1));
+        rpc_work_queue_group = new boost::thread_group();
+        for (int i = 0; i < nThreads; i++)
+            rpc_work_queue_group->create_thread(boost::bind(&CRPCWorkQueue::Run, rpc_work_queue));
+    }
+    rpc_work_queue_threads = nThreads;
+    if (nThreads > 1) {
+        rpc_batch_queue = new CRPCWorkQueue(nThreads - 1);
+        rpc_batch_queue_group = new boost::thread_group();
+        for (int i = 0; i < nThreads - 1; i++)
+            rpc_batch_queue_group->create_thread(boost::bind(&CRPCWorkQueue::Run, rpc_batch_queue));
+        rpc_batch_queue_threads = nThreads - 1;
+    }
+    LogPrintf("RPC server started with %d threads%s\n", nThreads, fUseSSL ? "" : strprintf(" and a work queue of %d", rpc_work_queue->MaxDepth()));
     fRPCRunning = true;
 }
 
@@ -761,9 +1035,28 @@ void StopRPCThreads()
     deadlineTimers.clear();
 
     rpc_io_service->stop();
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
+    if (rpc_batch_queue != NULL)
+        rpc_batch_queue->Interrupt();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+    if (rpc_work_queue_group != NULL)
+        rpc_work_queue_group->join_all();
+    delete rpc_work_queue_group;
+    rpc_work_queue_group = NULL;
+    // Drops the connections of requests still queued
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
+    rpc_work_queue_threads = 0;
+    if (rpc_batch_queue_group != NULL)
+        rpc_batch_queue_group->join_all();
+    delete rpc_batch_queue_group;
+    rpc_batch_queue_group = NULL;
+    delete rpc_batch_queue;
+    rpc_batch_queue = NULL;
+    rpc_batch_queue_threads = 0;
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
@@ -880,11 +1173,110 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
+/**
+ * Read-only lookups that take their own locks. Only these run concurrently
+ * within a batch, anything that changes state keeps the order of the request.
+ */
+static const char* const vParallelBatchCommands[] = {
+    "getbestblockhash", "getblockcount", "getblock", "getblockhash", "getblockheader",
+    "getdifficulty", "getmempoolinfo", "getrawtransaction", "gettxout", "getspentinfo",
+    "getaddressbalance", "getaddressutxos", "getaddresstxids", "getzerocoinmints", "getzerocoinspends",
+};
+
+/** Whether a batch member may run concurrently with its neighbours */
+static bool IsParallelBatchMember(const Value& req)
+{
+    if (req.type() != obj_type)
+        return false;
+    const Value& valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+        return false;
+    const std::string& strMethod = valMethod.get_str();
+    for (unsigned int i = 0; i < sizeof(vParallelBatchCommands) / sizeof(vParallelBatchCommands[0]); i++) {
+        if (strMethod == vParallelBatchCommands[i]) {
+            // Commands that rely on the RPC server to hold cs_main would only serialize on it
+            const CRPCCommand* pcmd = tableRPC[strMethod];
+            return pcmd && pcmd->threadSafe && !pcmd->reqWallet;
+        }
+    }
+    return false;
+}
+
+/** Batch members that are being executed by several RPC threads at once */
+struct CRPCBatchJob {
+    std::vector<Value> vReq;
+    std::vector<Object> vResult;
+    boost::mutex cs;
+    boost::condition_variable cond;
+    size_t nNext; //!< next member to be picked up by a thread
+    size_t nDone;
+
+    explicit CRPCBatchJob(const std::vector<Value>& vReqIn) : vReq(vReqIn), vResult(vReqIn.size()), nNext(0), nDone(0) {}
+};
+
+static void RPCBatchWork(boost::shared_ptr<CRPCBatchJob> job)
+{
+    while (true) {
+        size_t i;
+        {
+            boost::unique_lock<boost::mutex> lock(job->cs);
+            if (job->nNext == job->vReq.size())
+                return;
+            i = job->nNext++;
+        }
+
+        Object result = JSONRPCExecOne(job->vReq[i]);
+
+        boost::unique_lock<boost::mutex> lock(job->cs);
+        job->vResult[i] = result;
+        if (++job->nDone == job->vReq.size())
+            job->cond.notify_all();
+    }
+}
+
+/**
+ * Execute batch members on the calling thread and on as many batch helpers as
+ * are free. The caller keeps picking up members itself, so the batch
+ * completes even when every helper is busy with another batch.
+ */
+static void JSONRPCExecParallel(const std::vector<Value>& vReq, Array& ret)
+{
+    boost::shared_ptr<CRPCBatchJob> job(new CRPCBatchJob(vReq));
+
+    int nHelpers = std::min((int)vReq.size() - 1, rpc_batch_queue_threads);
+    for (int i = 0; i < nHelpers; i++)
+        if (!rpc_batch_queue->Enqueue(boost::bind(&RPCBatchWork, job)))
+            break;
+    RPCBatchWork(job);
+
+    {
+        boost::unique_lock<boost::mutex> lock(job->cs);
+        while (job->nDone < job->vReq.size())
+            job->cond.wait(lock);
+    }
+    ret.insert(ret.end(), job->vResult.begin(), job->vResult.end());
+}
+
 static string JSONRPCExecBatch(const Array& vReq)
 {
     Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        // Runs of members that take their own locks are executed concurrently,
+        // everything else one at a time, and the replies keep the request order
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsParallelBatchMember(vReq[nEnd]))
+            nEnd++;
+
+        if (nEnd - reqIdx > 1 && rpc_batch_queue) {
+            JSONRPCExecParallel(std::vector<Value>(vReq.begin() + reqIdx, vReq.begin() + nEnd), ret);
+            reqIdx = nEnd;
+        } else {
+            nEnd = std::max(nEnd, reqIdx + 1);
+            for (; reqIdx < nEnd; reqIdx++)
+                ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+        }
+    }
 
     return write_string(Value(ret), false) + "\n";
 }
@@ -931,10 +1323,13 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
         if (valRequest.type() == obj_type) {
             jreq.parse(valRequest);
 
-            Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+            // Commands with a streaming implementation write their result straight into the reply
+            if (!tableRPC.executeStreaming(jreq.strMethod, jreq.params, jreq.id, strReply)) {
+                Value result = tableRPC.execute(jreq.strMethod, jreq.params);
 
-            // Send reply
-            strReply = JSONRPCReply(result, Value::null, jreq.id);
+                // Send reply
+                strReply = JSONRPCReply(result, Value::null, jreq.id);
+            }
 
             // array of requests
         } else if (valRequest.type() == array_type)
@@ -953,6 +1348,21 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     return true;
 }
 
+/** Answer one HTTP request; returns false if the connection must be closed */
+static bool HTTPReq(AcceptedConnection* conn, string& strURI, string& strRequest, map<string, string>& mapHeaders, bool fRun)
+{
+    // Process via JSON-RPC API
+    if (strURI == "/")
+        return HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun);
+
+    // Process via HTTP REST API
+    if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false))
+        return HTTPReq_REST(conn, strURI, strRequest, mapHeaders, fRun);
+
+    conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+    return false;
+}
+
 void ServiceConnection(AcceptedConnection* conn)
 {
     bool fRun = true;
@@ -972,24 +1382,13 @@ void ServiceConnection(AcceptedConnection* conn)
         if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
             fRun = false;
 
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
-
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
-
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        if (!HTTPReq(conn, strURI, strRequest, mapHeaders, fRun))
             break;
-        }
     }
 }
 
-json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_spirit::Array& params) const
+/** Find a command and check that it may run now */
+static const CRPCCommand* PrepareCommand(const std::string& strMethod)
 {
     // Find method
     const CRPCCommand* pcmd = tableRPC[strMethod];
@@ -1006,48 +1405,77 @@ json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    return pcmd;
+}
+
+/** Run a command implementation with the locks the command doesn't take itself */
+static void RunCommand(const CRPCCommand* pcmd, boost::function<void()> run)
+{
     try {
         // Execute
-        Value result;
-        {
-            if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
+        if (pcmd->threadSafe)
+            run();
 #ifdef ENABLE_WALLET
-            else if (!pwalletMain) {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            } else {
-                while (true) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if (!lockMain) {
-                        MilliSleep(50);
-                        continue;
-                    }
-                    while (true) {
-                        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
-                            MilliSleep(50);
-                            continue;
-                        }
-                        result = pcmd->actor(params, false);
-                        break;
-                    }
-                    break;
-                }
-            }
+        else if (!pwalletMain) {
+            LOCK(cs_main);
+            run();
+        } else {
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            run();
+        }
 #else  // ENABLE_WALLET
-            else {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            }
-#endif // !ENABLE_WALLET
+        else {
+            LOCK(cs_main);
+            run();
         }
-        return result;
+#endif // !ENABLE_WALLET
     } catch (std::exception& e) {
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
 }
 
+json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_spirit::Array& params) const
+{
+    const CRPCCommand* pcmd = PrepareCommand(strMethod);
+    CRPCLatencyTimer timer(strMethod);
+
+    Value result;
+    RunCommand(pcmd, [&]() { result = pcmd->actor(params, false); });
+    return result;
+}
+
+bool CRPCTable::executeStreaming(const std::string& strMethod, const json_spirit::Array& params, const json_spirit::Value& id, std::string& strReply) const
+{
+    const CRPCCommand* pcmd = PrepareCommand(strMethod);
+    if (!pcmd->streamActor)
+        return false;
+    CRPCLatencyTimer timer(strMethod);
+
+    // Same layout as JSONRPCReplyObj(), with the result written in place
+    strReply.clear();
+    CJSONWriter writer(strReply);
+    writer.BeginObject();
+    writer.Key("result");
+    RunCommand(pcmd, [&]() { pcmd->streamActor(params, false, writer); });
+    writer.Key("error").Null();
+    writer.Key("id").Raw(write_string(id, false));
+    writer.EndObject();
+    strReply += "\n";
+    return true;
+}
+
+json_spirit::Value ValueFromJSONStream(rpcstreamfn_type fn, const json_spirit::Array& params, bool fHelp)
+{
+    std::string strJSON;
+    CJSONWriter writer(strJSON);
+    fn(params, fHelp, writer);
+
+    Value result;
+    if (!writer.IsComplete() || !read_string(strJSON, result))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Invalid JSON produced by command");
+    return result;
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
@@ -22,8 +22,14 @@
 #include "json/json_spirit_writer_template.h"
 
 class CBlockIndex;
+class CJSONWriter;
 class CNetAddr;
 
+//! Number of threads servicing RPC and REST requests
+static const int DEFAULT_RPC_THREADS = 4;
+//! Requests that may wait for a free RPC thread before new ones are refused with 503
+static const int DEFAULT_RPC_WORKQUEUE = 16;
+
 class AcceptedConnection
 {
 public:
@@ -80,20 +86,42 @@ void RPCTypeCheck(const json_spirit::Object& o,
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
+/**
+ * Adds the time until it goes out of scope to the call count and latency
+ * counters of an RPC method or REST resource (see getrpcstats).
+ */
+class CRPCLatencyTimer
+{
+public:
+    explicit CRPCLatencyTimer(const std::string& strEndpointIn);
+    ~CRPCLatencyTimer();
+
+private:
+    std::string strEndpoint;
+    int64_t nStart;
+};
+
 //! Convert boost::asio address to CNetAddr
 extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
 
 typedef json_spirit::Value (*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
+typedef void (*rpcstreamfn_type)(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 
 class CRPCCommand
 {
 public:
+    CRPCCommand(const std::string& categoryIn, const std::string& nameIn, rpcfn_type actorIn, bool okSafeModeIn,
+        bool threadSafeIn, bool reqWalletIn, rpcstreamfn_type streamActorIn = NULL)
+        : category(categoryIn), name(nameIn), actor(actorIn), okSafeMode(okSafeModeIn),
+          threadSafe(threadSafeIn), reqWallet(reqWalletIn), streamActor(streamActorIn) {}
+
     std::string category;
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    rpcstreamfn_type streamActor; //! optional, writes the result straight into the reply
 };
 
 /**
@@ -118,6 +146,17 @@ public:
      */
     json_spirit::Value execute(const std::string& method, const json_spirit::Array& params) const;
 
+    /**
+     * Execute a method that has a streaming implementation.
+     * @param method   Method to execute
+     * @param params   Array of arguments (JSON objects)
+     * @param id       Request id to put in the reply
+     * @param strReply Receives the complete JSON-RPC reply
+     * @returns false if the method has no streaming implementation.
+     * @throws an exception (json_spirit::Value) when an error happens.
+     */
+    bool executeStreaming(const std::string& method, const json_spirit::Array& params, const json_spirit::Value& id, std::string& strReply) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -132,6 +171,8 @@ extern const CRPCTable tableRPC;
  * (throws error if not hex).
  */
 extern uint256 ParseHashV(const json_spirit::Value& v, std::string strName);
+/** Run a streaming command implementation and parse its output, for callers that need a json_spirit::Value */
+extern json_spirit::Value ValueFromJSONStream(rpcstreamfn_type fn, const json_spirit::Array& params, bool fHelp);
 extern uint256 ParseHashO(const json_spirit::Object& o, std::string strKey);
 extern std::vector<unsigned char> ParseHexV(const json_spirit::Value& v, std::string strName);
 extern std::vector<unsigned char> ParseHexO(const json_spirit::Object& o, std::string strKey);
@@ -212,6 +253,7 @@ extern json_spirit::Value walletlock(const json_spirit::Array& params, bool fHel
 extern json_spirit::Value encryptwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getwalletinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockchaininfo(const json_spirit::Array& params, bool fHelp);
+extern void getblockchaininfo(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value getnetworkinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value reservebalance(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value setstakesplitthreshold(const json_spirit::Array& params, bool fHelp);
@@ -246,10 +288,13 @@ extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool f
 extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getmempoolhistogram(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern void getrawmempool(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
+extern void getblock(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 extern json_spirit::Value getblockheader(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxoutsetinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
@@ -258,6 +303,10 @@ extern json_spirit::Value getchaintips(const json_spirit::Array& params, bool fH
 extern json_spirit::Value invalidateblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value reconsiderblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getinvalid(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getzerocoinmints(const json_spirit::Array& params, bool fHelp);
+extern void getzerocoinmints(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
+extern json_spirit::Value getzerocoinspends(const json_spirit::Array& params, bool fHelp);
+extern void getzerocoinspends(const json_spirit::Array& params, bool fHelp, CJSONWriter& writer);
 
 extern json_spirit::Value obfuscation(const json_spirit::Array& params, bool fHelp); // in rpcmasternode.cpp
 extern json_spirit::Value masternode(const json_spirit::Array& params, bool fHelp);
@@ -274,6 +323,7 @@ extern json_spirit::Value listmasternodeconf(const json_spirit::Array& params, b
 extern json_spirit::Value getmasternodestatus(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmasternodewinners(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmasternodescores(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getinstanttxstats(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value mnbudget(const json_spirit::Array& params, bool fHelp); // in rpcmasternode-budget.cpp
 extern json_spirit::Value preparebudget(const json_spirit::Array& params, bool fHelp);
@@ -295,10 +345,15 @@ extern json_spirit::Value createmultisig(const json_spirit::Array& params, bool
 extern json_spirit::Value verifymessage(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value setmocktime(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getstakingstatus(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressbalance(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressutxos(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddresstxids(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getspentinfo(const json_spirit::Array& params, bool fHelp);
 
 // in rest.cpp
 extern bool HTTPReq_REST(AcceptedConnection* conn,
     std::string& strURI,
+    const std::string& strRequest,
     std::map<std::string, std::string>& mapHeaders,
     bool fRun);
 
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCWORKQUEUE_H
+#define BITCOIN_RPCWORKQUEUE_H
+
+#include "util.h"
+
+#include <deque>
+#include <exception>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Requests read by the RPC I/O thread wait here for one of the -rpcthreads
+ * workers. The queue holds at most -rpcworkqueue requests, further ones are
+ * refused so a burst of clients can't pile up unbounded work.
+ */
+class CRPCWorkQueue
+{
+public:
+    explicit CRPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true) {}
+
+    /** Queue a request; returns false if the queue is full or shutting down */
+    bool Enqueue(const boost::function<void()>& func)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(func);
+        cond.notify_one();
+        return true;
+    }
+
+    /** Worker thread: run queued requests until interrupted */
+    void Run()
+    {
+        while (true) {
+            boost::function<void()> func;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    break;
+                func = queue.front();
+                queue.pop_front();
+            }
+            try {
+                func();
+            } catch (std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+        }
+    }
+
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        cond.notify_all();
+    }
+
+    size_t Depth()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return queue.size();
+    }
+
+    size_t MaxDepth() const { return nMaxDepth; }
+
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<boost::function<void()> > queue;
+    const size_t nMaxDepth;
+    bool fRunning;
+};
+
+#endif // BITCOIN_RPCWORKQUEUE_H
@@ -23,6 +23,7 @@ class CSporkManager;
 
 CSporkManager sporkManager;
 
+CCriticalSection cs_sporks;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
@@ -42,8 +43,11 @@ void LoadSporksFromDB()
         }
 
         // add spork to memory
-        mapSporks[spork.GetHash()] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs_sporks);
+            mapSporks[spork.GetHash()] = spork;
+            mapSporksActive[spork.nSporkID] = spork;
+        }
         std::time_t result = spork.nValue;
         // If SPORK Value is greater than 1,000,000 assume it's actually a Date and then convert to a more readable format
         if (spork.nValue > 1000000) {
@@ -74,12 +78,16 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         if (strSpork == "Unknown") return;
 
         uint256 hash = spork.GetHash();
-        if (mapSporksActive.count(spork.nSporkID)) {
-            if (mapSporksActive[spork.nSporkID].nTimeSigned >= spork.nTimeSigned) {
-                if (fDebug) LogPrintf("spork - seen %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
-                return;
-            } else {
-                if (fDebug) LogPrintf("spork - got updated spork %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
+        {
+            LOCK(cs_sporks);
+            std::map<int, CSporkMessage>::iterator it = mapSporksActive.find(spork.nSporkID);
+            if (it != mapSporksActive.end()) {
+                if (it->second.nTimeSigned >= spork.nTimeSigned) {
+                    if (fDebug) LogPrintf("spork - seen %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
+                    return;
+                } else {
+                    if (fDebug) LogPrintf("spork - got updated spork %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
+                }
             }
         }
 
@@ -91,20 +99,30 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
             return;
         }
 
-        mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs_sporks);
+            mapSporks[hash] = spork;
+            mapSporksActive[spork.nSporkID] = spork;
+        }
         sporkManager.Relay(spork);
 
         // Oxid: add to spork database.
         pSporkDB->WriteSpork(spork.nSporkID, spork);
     }
     if (strCommand == "getsporks") {
-        std::map<int, CSporkMessage>::iterator it = mapSporksActive.begin();
-
-        while (it != mapSporksActive.end()) {
-            pfrom->PushMessage("spork", it->second);
-            it++;
+        std::vector<CSporkMessage> vSporks;
+        {
+            LOCK(cs_sporks);
+            std::map<int, CSporkMessage>::iterator it = mapSporksActive.begin();
+
+            while (it != mapSporksActive.end()) {
+                vSporks.push_back(it->second);
+                it++;
+            }
         }
+
+        BOOST_FOREACH (const CSporkMessage& spork, vSporks)
+            pfrom->PushMessage("spork", spork);
     }
 }
 
@@ -113,10 +131,18 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 int64_t GetSporkValue(int nSporkID)
 {
     int64_t r = -1;
+    bool fActive = false;
 
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
+    {
+        LOCK(cs_sporks);
+        std::map<int, CSporkMessage>::const_iterator it = mapSporksActive.find(nSporkID);
+        if (it != mapSporksActive.end()) {
+            r = it->second.nValue;
+            fActive = true;
+        }
+    }
+
+    if (!fActive) {
         if (nSporkID == SPORK_2_INSTANTTX) r = SPORK_2_INSTANTTX_DEFAULT;
         if (nSporkID == SPORK_3_INSTANTTX_BLOCK_FILTERING) r = SPORK_3_INSTANTTX_BLOCK_FILTERING_DEFAULT;
         if (nSporkID == SPORK_4_MAX_VALUE) r = SPORK_4_MAX_VALUE_DEFAULT;
@@ -220,6 +246,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
 
     if (Sign(msg)) {
         Relay(msg);
+        LOCK(cs_sporks);
         mapSporks[msg.GetHash()] = msg;
         mapSporksActive[nSporkID] = msg;
         return true;
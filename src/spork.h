@@ -50,6 +50,8 @@ using namespace boost;
 class CSporkMessage;
 class CSporkManager;
 
+// protects mapSporks and mapSporksActive, which are read from every message handler thread
+extern CCriticalSection cs_sporks;
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 extern CSporkManager sporkManager;
@@ -0,0 +1,150 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "undo.h"
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+static CMutableTransaction MakeTx(const COutPoint& prevout, const CKeyID& keyTo, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = GetScriptForDestination(keyTo);
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+/** Connect a transaction of a block to the view and collect its index entries, like ConnectBlock */
+static void ConnectTx(CCoinsViewCache& view, const CTransaction& tx, unsigned int nTx, int nHeight, CTxUndo& txundo, CAddressIndexUpdates& updates)
+{
+    CValidationState state;
+    AddConnectedTxIndexUpdates(tx, nTx, nHeight, view, updates);
+    UpdateCoins(tx, state, view, txundo, nHeight);
+}
+
+/** Remove a transaction from the view, restore its inputs and collect the index entries, like DisconnectBlock */
+static void DisconnectTx(CCoinsViewCache& view, const CTransaction& tx, unsigned int nTx, int nHeight, const CTxUndo& txundo, CAddressIndexUpdates& updates)
+{
+    view.ModifyCoins(tx.GetHash())->Clear();
+    for (unsigned int j = tx.vin.size(); j-- > 0;) {
+        const COutPoint& out = tx.vin[j].prevout;
+        const CTxInUndo& undo = txundo.vprevout[j];
+        CCoinsModifier coins = view.ModifyCoins(out.hash);
+        if (undo.nHeight != 0) {
+            coins->Clear();
+            coins->fCoinBase = undo.fCoinBase;
+            coins->nHeight = undo.nHeight;
+            coins->nVersion = undo.nVersion;
+        }
+        if (coins->vout.size() < out.n + 1)
+            coins->vout.resize(out.n + 1);
+        coins->vout[out.n] = undo.txout;
+    }
+    AddDisconnectedTxIndexUpdates(tx, nTx, nHeight, view, updates);
+}
+
+/** Everything the indexes hold for the addresses and outputs of the test */
+static std::string DumpIndexes(const std::vector<CKeyID>& vKeys, const std::vector<COutPoint>& vOutputs)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    BOOST_FOREACH (const CKeyID& key, vKeys) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentIndex;
+        BOOST_CHECK(pblocktree->ReadAddressIndex(key, ADDRESS_TYPE_PUBKEYHASH, addressIndex));
+        BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(key, ADDRESS_TYPE_PUBKEYHASH, unspentIndex));
+        ss << addressIndex << unspentIndex;
+    }
+    BOOST_FOREACH (const COutPoint& out, vOutputs) {
+        CSpentIndexValue value;
+        bool fSpent = pblocktree->ReadSpentIndex(CSpentIndexKey(out.hash, out.n), value);
+        ss << fSpent << value;
+    }
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect_same_block_spend)
+{
+    bool fAddressIndexOld = fAddressIndex;
+    bool fSpentIndexOld = fSpentIndex;
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    CKeyID keyX(uint160(1)), keyY(uint160(2)), keyZ(uint160(3));
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    // an earlier block pays X
+    CMutableTransaction txFund = MakeTx(COutPoint(), keyX, 10 * COIN);
+    CTxUndo undoFund;
+    CAddressIndexUpdates updatesFund;
+    ConnectTx(view, txFund, 0, 5, undoFund, updatesFund);
+    BOOST_CHECK(WriteAddressIndexUpdates(updatesFund, false));
+
+    // the block spends X to Y, and the new output of Y to Z
+    CMutableTransaction txA = MakeTx(COutPoint(txFund.GetHash(), 0), keyY, 9 * COIN);
+    CMutableTransaction txB = MakeTx(COutPoint(txA.GetHash(), 0), keyZ, 8 * COIN);
+
+    std::vector<CKeyID> vKeys;
+    vKeys.push_back(keyX);
+    vKeys.push_back(keyY);
+    vKeys.push_back(keyZ);
+    std::vector<COutPoint> vOutputs;
+    vOutputs.push_back(COutPoint(txFund.GetHash(), 0));
+    vOutputs.push_back(COutPoint(txA.GetHash(), 0));
+    vOutputs.push_back(COutPoint(txB.GetHash(), 0));
+    std::string strBefore = DumpIndexes(vKeys, vOutputs);
+
+    CTxUndo undoA, undoB;
+    CAddressIndexUpdates updatesConnect;
+    ConnectTx(view, txA, 1, 10, undoA, updatesConnect);
+    ConnectTx(view, txB, 2, 10, undoB, updatesConnect);
+    BOOST_CHECK(WriteAddressIndexUpdates(updatesConnect, false));
+
+    // the output created and spent in the block is in the history but not unspent
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentIndex;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(keyY, ADDRESS_TYPE_PUBKEYHASH, addressIndex));
+    BOOST_CHECK_EQUAL(addressIndex.size(), 2U);
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(keyY, ADDRESS_TYPE_PUBKEYHASH, unspentIndex));
+    BOOST_CHECK(unspentIndex.empty());
+    unspentIndex.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(keyX, ADDRESS_TYPE_PUBKEYHASH, unspentIndex));
+    BOOST_CHECK(unspentIndex.empty());
+    unspentIndex.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(keyZ, ADDRESS_TYPE_PUBKEYHASH, unspentIndex));
+    BOOST_REQUIRE_EQUAL(unspentIndex.size(), 1U);
+    BOOST_CHECK(unspentIndex[0].first.txhash == txB.GetHash());
+    BOOST_CHECK_EQUAL(unspentIndex[0].second.blockHeight, 10);
+    CSpentIndexValue spent;
+    BOOST_CHECK(pblocktree->ReadSpentIndex(CSpentIndexKey(txA.GetHash(), 0), spent));
+    BOOST_CHECK(spent.txid == txB.GetHash());
+    BOOST_CHECK(spent.addressHash == keyY);
+
+    // disconnecting it, last transaction first, leaves the indexes as they were
+    CAddressIndexUpdates updatesDisconnect;
+    DisconnectTx(view, txB, 2, 10, undoB, updatesDisconnect);
+    DisconnectTx(view, txA, 1, 10, undoA, updatesDisconnect);
+    BOOST_CHECK(WriteAddressIndexUpdates(updatesDisconnect, true));
+    BOOST_CHECK(DumpIndexes(vKeys, vOutputs) == strBefore);
+
+    // with the unspent output of X back at the height of its block
+    unspentIndex.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(keyX, ADDRESS_TYPE_PUBKEYHASH, unspentIndex));
+    BOOST_REQUIRE_EQUAL(unspentIndex.size(), 1U);
+    BOOST_CHECK_EQUAL(unspentIndex[0].second.blockHeight, 5);
+
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
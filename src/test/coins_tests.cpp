@@ -175,4 +175,46 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// The running UTXO statistics must not depend on the order outputs are added and removed in.
+BOOST_AUTO_TEST_CASE(coins_stats_commitment_test)
+{
+    std::vector<std::pair<COutPoint, CTxOut> > outputs;
+    for (unsigned int i = 0; i < 20; i++) {
+        CTxOut out;
+        out.nValue = insecure_rand() % 1000000;
+        out.scriptPubKey.assign(insecure_rand() & 0x3F, 0);
+        outputs.push_back(std::make_pair(COutPoint(GetRandHash(), i), out));
+    }
+
+    CCoinsStats forward, backward;
+    for (unsigned int i = 0; i < outputs.size(); i++)
+        forward.UpdateOutput(outputs[i].first, outputs[i].second, true);
+    for (unsigned int i = outputs.size(); i > 0; i--)
+        backward.UpdateOutput(outputs[i - 1].first, outputs[i - 1].second, true);
+    BOOST_CHECK(forward.hashCommitment == backward.hashCommitment);
+    BOOST_CHECK(forward.hashCommitment != 0);
+    BOOST_CHECK_EQUAL(forward.nTransactionOutputs, outputs.size());
+    BOOST_CHECK_EQUAL(forward.nTotalAmount, backward.nTotalAmount);
+    BOOST_CHECK_EQUAL(forward.nOutputBytes, backward.nOutputBytes);
+
+    // removing every other output equals only adding the rest
+    CCoinsStats partial;
+    for (unsigned int i = 0; i < outputs.size(); i++) {
+        if (i % 2)
+            forward.UpdateOutput(outputs[i].first, outputs[i].second, false);
+        else
+            partial.UpdateOutput(outputs[i].first, outputs[i].second, true);
+    }
+    BOOST_CHECK(forward.hashCommitment == partial.hashCommitment);
+    BOOST_CHECK_EQUAL(forward.nTransactionOutputs, partial.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(forward.nTotalAmount, partial.nTotalAmount);
+    BOOST_CHECK_EQUAL(forward.nOutputBytes, partial.nOutputBytes);
+
+    for (unsigned int i = 0; i < outputs.size(); i += 2)
+        forward.UpdateOutput(outputs[i].first, outputs[i].second, false);
+    BOOST_CHECK(forward.hashCommitment == 0);
+    BOOST_CHECK_EQUAL(forward.nTransactionOutputs, 0U);
+    BOOST_CHECK_EQUAL(forward.nOutputBytes, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
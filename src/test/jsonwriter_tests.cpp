@@ -0,0 +1,92 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+#include "rpcserver.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace json_spirit;
+
+BOOST_AUTO_TEST_SUITE(jsonwriter_tests)
+
+BOOST_AUTO_TEST_CASE(jsonwriter_matches_json_spirit)
+{
+    Object obj;
+    obj.push_back(Pair("hash", "00ff"));
+    obj.push_back(Pair("height", 12345));
+    obj.push_back(Pair("negative", -7));
+    obj.push_back(Pair("difficulty", 1.5));
+    obj.push_back(Pair("fee", ValueFromAmount(1234567)));
+    obj.push_back(Pair("loss", ValueFromAmount(-50000000)));
+    obj.push_back(Pair("flag", true));
+    obj.push_back(Pair("nothing", Value::null));
+    Array arr;
+    arr.push_back("a");
+    arr.push_back("b");
+    obj.push_back(Pair("tx", arr));
+    obj.push_back(Pair("empty", Array()));
+    obj.push_back(Pair("inner", Object()));
+
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginObject();
+    writer.Key("hash").String("00ff");
+    writer.Key("height").Int(12345);
+    writer.Key("negative").Int(-7);
+    writer.Key("difficulty").Real(1.5);
+    writer.Key("fee").Amount(1234567);
+    writer.Key("loss").Amount(-50000000);
+    writer.Key("flag").Bool(true);
+    writer.Key("nothing").Null();
+    writer.Key("tx").BeginArray();
+    writer.String("a");
+    writer.String("b");
+    writer.EndArray();
+    writer.Key("empty").BeginArray();
+    writer.EndArray();
+    writer.Key("inner").BeginObject();
+    writer.EndObject();
+    BOOST_CHECK(!writer.IsComplete());
+    writer.EndObject();
+    BOOST_CHECK(writer.IsComplete());
+
+    BOOST_CHECK_EQUAL(str, write_string(Value(obj), false));
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_escaping)
+{
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginArray();
+    writer.String("quote\" backslash\\ newline\n tab\t");
+    writer.String(std::string("nul\0", 4));
+    writer.Raw("{\"raw\":1}");
+    writer.EndArray();
+
+    BOOST_CHECK_EQUAL(str, "[\"quote\\\" backslash\\\\ newline\\n tab\\t\",\"nul\\u0000\",{\"raw\":1}]");
+
+    Value val;
+    BOOST_CHECK(read_string(str, val));
+    BOOST_CHECK_EQUAL(val.get_array()[0].get_str(), "quote\" backslash\\ newline\n tab\t");
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_escapes_like_json_spirit)
+{
+    // json_spirit leaves '/' alone and writes other unprintable characters as escaped code points
+    std::string strEscapes("slash/ cr\r bs\b ff\f us\x1f del\x7f high\xc3\xa9");
+
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginArray();
+    writer.String(strEscapes);
+    writer.EndArray();
+
+    Array arr;
+    arr.push_back(strEscapes);
+    BOOST_CHECK_EQUAL(str, write_string(Value(arr), false));
+    BOOST_CHECK(str.find("slash/") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
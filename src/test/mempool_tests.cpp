@@ -99,4 +99,194 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static CMutableTransaction MakeSpend(const uint256& hashPrev, uint32_t n, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout.hash = hashPrev;
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    // three unrelated transactions paying different fees
+    CMutableTransaction tx1 = MakeSpend(uint256(1), 0, 10 * COIN);
+    CMutableTransaction tx2 = MakeSpend(uint256(2), 0, 10 * COIN);
+    CMutableTransaction tx3 = MakeSpend(uint256(3), 0, 10 * COIN);
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000, 0, 0.0, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 5000, 0, 0.0, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000, 0, 0.0, 1));
+
+    // a cheap parent with a child paying for both
+    CMutableTransaction txParent = MakeSpend(uint256(4), 0, 10 * COIN);
+    CMutableTransaction txChild = MakeSpend(txParent.GetHash(), 0, 10 * COIN);
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 50000, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& parent = *pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(parent.GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(parent.GetFeesWithDescendants(), 50000);
+    BOOST_CHECK_EQUAL(parent.GetSizeWithDescendants(), parent.GetTxSize() + pool.mapTx.find(txChild.GetHash())->GetTxSize());
+
+    // nothing to do while the pool fits
+    BOOST_CHECK(pool.GetMinFee(pool.DynamicMemoryUsage()) == CFeeRate(0));
+    pool.TrimToSize(pool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(pool.size(), 5U);
+
+    // the cheapest package goes first, the parent is kept by its child
+    CTxMemPoolEntry entry2 = *pool.mapTx.find(tx2.GetHash());
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(txParent.GetHash()));
+
+    // and the minimum fee is raised above what was evicted
+    CFeeRate evicted(entry2.GetFee(), entry2.GetTxSize());
+    BOOST_CHECK(pool.GetMinFee(1) == CFeeRate(evicted.GetFeePerK() + 1000));
+
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    BOOST_CHECK(pool.exists(txParent.GetHash()));
+    BOOST_CHECK(pool.exists(txChild.GetHash()));
+
+    // evicting a parent takes its descendants along
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolExpireTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    CMutableTransaction txOld = MakeSpend(uint256(1), 0, 10 * COIN);
+    CMutableTransaction txOldChild = MakeSpend(txOld.GetHash(), 0, 10 * COIN);
+    CMutableTransaction txNew = MakeSpend(uint256(2), 0, 10 * COIN);
+    pool.addUnchecked(txOld.GetHash(), CTxMemPoolEntry(txOld, 1000, 100, 0.0, 1));
+    pool.addUnchecked(txOldChild.GetHash(), CTxMemPoolEntry(txOldChild, 1000, 300, 0.0, 1));
+    pool.addUnchecked(txNew.GetHash(), CTxMemPoolEntry(txNew, 1000, 300, 0.0, 1));
+
+    BOOST_CHECK_EQUAL(pool.Expire(100), 0);
+
+    // the child goes with its expired parent, even though it's newer
+    BOOST_CHECK_EQUAL(pool.Expire(200), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK(pool.exists(txNew.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    // a chain of three, then a reorg brings back the first link
+    CMutableTransaction tx1 = MakeSpend(uint256(1), 0, 10 * COIN);
+    CMutableTransaction tx2 = MakeSpend(tx1.GetHash(), 0, 10 * COIN);
+    CMutableTransaction tx3 = MakeSpend(tx2.GetHash(), 0, 10 * COIN);
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 2000, 0, 0.0, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 3000, 0, 0.0, 1));
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 1000, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& entry1 = *pool.mapTx.find(tx1.GetHash());
+    const CTxMemPoolEntry& entry3 = *pool.mapTx.find(tx3.GetHash());
+    BOOST_CHECK_EQUAL(entry1.GetCountWithDescendants(), 3U);
+    BOOST_CHECK_EQUAL(entry1.GetFeesWithDescendants(), 6000);
+    BOOST_CHECK_EQUAL(entry3.GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(entry3.GetFeesWithAncestors(), 6000);
+
+    // a fourth link breaks a limit of three ancestors
+    CMutableTransaction tx4 = MakeSpend(tx3.GetHash(), 0, 10 * COIN);
+    CTxMemPoolEntry entry4(tx4, 4000, 0, 0.0, 1);
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry4, setAncestors, 3, 100000, 25, 100000, errString));
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entry4, setAncestors, 4, 100000, 25, 100000, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3U);
+
+    // mining the head leaves the rest of the chain consistent
+    std::list<CTransaction> removed;
+    pool.remove(tx1, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1U);
+    BOOST_CHECK_EQUAL(entry3.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(entry3.GetFeesWithAncestors(), 5000);
+
+    // removing recursively takes the descendants
+    removed.clear();
+    pool.remove(tx2, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2U);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolFeeHistogramTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    CMutableTransaction txLow = MakeSpend(uint256(1), 0, 10 * COIN);
+    CMutableTransaction txHigh = MakeSpend(uint256(2), 0, 10 * COIN);
+    CTxMemPoolEntry entryLow(txLow, 0, 0, 0.0, 1);
+    CTxMemPoolEntry entryHigh(txHigh, 100000, 0, 0.0, 1);
+    pool.addUnchecked(txLow.GetHash(), entryLow);
+    pool.addUnchecked(txHigh.GetHash(), entryHigh);
+
+    // free transactions land in the first range, the rest by their fee rate
+    CAmount nHighRate = CFeeRate(100000, entryHigh.GetTxSize()).GetFeePerK();
+    std::vector<CFeeRateBucket> vHistogram = pool.GetFeeHistogram();
+    BOOST_CHECK_EQUAL(vHistogram[0].nCount, 1U);
+    BOOST_CHECK_EQUAL(vHistogram[0].nSize, entryLow.GetTxSize());
+    uint64_t nCount = 0;
+    BOOST_FOREACH (const CFeeRateBucket& bucket, vHistogram) {
+        nCount += bucket.nCount;
+        if (bucket.nCount && bucket.nMinFeeRate > 0) {
+            BOOST_CHECK(bucket.nMinFeeRate <= nHighRate);
+            BOOST_CHECK_EQUAL(bucket.nFees, 100000);
+        }
+    }
+    BOOST_CHECK_EQUAL(nCount, 2U);
+
+    // removal takes the transaction out of its range again
+    std::list<CTransaction> removed;
+    pool.remove(txHigh, removed);
+    nCount = 0;
+    BOOST_FOREACH (const CFeeRateBucket& bucket, pool.GetFeeHistogram())
+        nCount += bucket.nCount;
+    BOOST_CHECK_EQUAL(nCount, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPriorityIndexTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    // an old coin with no priority yet and a newer, larger one entering with some
+    CMutableTransaction txOld = MakeSpend(uint256(1), 0, 10 * COIN);
+    CMutableTransaction txNew = MakeSpend(uint256(2), 0, 20 * COIN);
+    pool.addUnchecked(txOld.GetHash(), CTxMemPoolEntry(txOld, 0, 0, 0.0, 1));
+    pool.addUnchecked(txNew.GetHash(), CTxMemPoolEntry(txNew, 0, 0, 1000.0, 100));
+
+    // the old one had more priority at height 0, the new one gains it faster
+    CTxMemPool::indexed_transaction_set::index<priority_base>::type& baseIndex = pool.mapTx.get<priority_base>();
+    CTxMemPool::indexed_transaction_set::index<priority_growth>::type& growthIndex = pool.mapTx.get<priority_growth>();
+    BOOST_CHECK(baseIndex.begin()->GetTx().GetHash() == txOld.GetHash());
+    BOOST_CHECK(growthIndex.begin()->GetTx().GetHash() == txNew.GetHash());
+
+    // the two parts add up to the priority at any height, no block re-ranks them
+    BOOST_FOREACH (const CTxMemPoolEntry& entry, pool.mapTx) {
+        BOOST_CHECK_CLOSE(entry.GetModifiedPriority(entry.GetHeight()), entry.GetPriority(entry.GetHeight()), 1e-6);
+        BOOST_CHECK_CLOSE(entry.GetModifiedPriority(201), entry.GetPriority(201), 1e-6);
+    }
+
+    // a priority delta moves the entry in the index and outdates selected blocks
+    unsigned int nTransactionsUpdated = pool.GetTransactionsUpdated();
+    pool.PrioritiseTransaction(txNew.GetHash(), txNew.GetHash().ToString(), 1e17, 0);
+    BOOST_CHECK(baseIndex.begin()->GetTx().GetHash() == txNew.GetHash());
+    BOOST_CHECK_CLOSE(baseIndex.begin()->GetModifiedPriority(201), baseIndex.begin()->GetPriority(201) + 1e17, 1e-6);
+    BOOST_CHECK(pool.GetTransactionsUpdated() != nTransactionsUpdated);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,127 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recorddb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+class CTestRecordDB : public CRecordDB
+{
+public:
+    CTestRecordDB() : CRecordDB("recorddb_test.dat", "RecordDBTest") {}
+
+    boost::filesystem::path Path() const { return GetDataDir() / "recorddb_test.dat"; }
+
+    bool Write(const std::map<uint256, std::string>& mapData)
+    {
+        CRecordBatch batch;
+        batch.WriteMap(1, mapData);
+        return WriteRecords(batch);
+    }
+
+    /** A record that passes its checksum but can't be read back as a string */
+    bool WriteUndecodable(const std::map<uint256, std::string>& mapData, const uint256& key)
+    {
+        CRecordBatch batch;
+        batch.WriteMap(1, mapData);
+        batch.Write(1, key, (unsigned char)200);
+        return WriteRecords(batch);
+    }
+
+    ReadResult Read(std::map<uint256, std::string>& mapData)
+    {
+        mapData.clear();
+        return ReadRecords([&mapData](unsigned char nRecordType, const uint256& key, CDataStream& ssValue) {
+            BOOST_CHECK_EQUAL(nRecordType, 1);
+            ReadMapRecord(ssValue, mapData, key);
+        });
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(recorddb_tests)
+
+BOOST_AUTO_TEST_CASE(recorddb_roundtrip)
+{
+    CTestRecordDB db;
+    boost::filesystem::remove(db.Path());
+
+    std::map<uint256, std::string> mapData, mapRead;
+    BOOST_CHECK(db.Read(mapRead) == CRecordDB::FileError);
+
+    for (int i = 1; i <= 10; i++)
+        mapData[uint256(i)] = strprintf("record %d", i);
+    BOOST_CHECK(db.Write(mapData));
+    uintmax_t nSizeFull = boost::filesystem::file_size(db.Path());
+
+    BOOST_CHECK(db.Read(mapRead) == CRecordDB::Ok);
+    BOOST_CHECK(mapRead == mapData);
+
+    // unchanged data doesn't touch the file
+    BOOST_CHECK(db.Write(mapData));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(db.Path()), nSizeFull);
+
+    // changes are appended, superseded and erased records are not read back
+    mapData[uint256(3)] = "changed";
+    mapData.erase(uint256(7));
+    BOOST_CHECK(db.Write(mapData));
+    BOOST_CHECK(boost::filesystem::file_size(db.Path()) > nSizeFull);
+    BOOST_CHECK(db.Read(mapRead) == CRecordDB::Ok);
+    BOOST_CHECK(mapRead == mapData);
+
+    boost::filesystem::remove(db.Path());
+}
+
+BOOST_AUTO_TEST_CASE(recorddb_damaged_record)
+{
+    CTestRecordDB db;
+    boost::filesystem::remove(db.Path());
+
+    std::map<uint256, std::string> mapData, mapRead;
+    mapData[uint256(1)] = "first";
+    mapData[uint256(2)] = "second";
+    BOOST_CHECK(db.Write(mapData));
+
+    // flip the last byte of the file, which belongs to the second payload
+    uintmax_t nSize = boost::filesystem::file_size(db.Path());
+    FILE* file = fopen(db.Path().string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, nSize - 1, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, nSize - 1, SEEK_SET);
+    fputc(ch ^ 0xff, file);
+    fclose(file);
+
+    // only the damaged record is lost
+    BOOST_CHECK(db.Read(mapRead) == CRecordDB::Ok);
+    BOOST_CHECK_EQUAL(mapRead.size(), 1U);
+    BOOST_CHECK_EQUAL(mapRead[uint256(1)], "first");
+
+    // and the file is rewritten in full on the next write
+    BOOST_CHECK(db.Write(mapData));
+    BOOST_CHECK(db.Read(mapRead) == CRecordDB::Ok);
+    BOOST_CHECK(mapRead == mapData);
+
+    boost::filesystem::remove(db.Path());
+}
+
+BOOST_AUTO_TEST_CASE(recorddb_undecodable_record)
+{
+    CTestRecordDB db;
+    boost::filesystem::remove(db.Path());
+
+    std::map<uint256, std::string> mapData, mapRead;
+    mapData[uint256(1)] = "first";
+    BOOST_CHECK(db.WriteUndecodable(mapData, uint256(2)));
+
+    // the record that fails to deserialize leaves no default entry behind
+    BOOST_CHECK(db.Read(mapRead) == CRecordDB::Ok);
+    BOOST_CHECK(mapRead == mapData);
+    BOOST_CHECK(!mapRead.count(uint256(2)));
+
+    boost::filesystem::remove(db.Path());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,15 @@
 
 #include "rpcserver.h"
 #include "rpcclient.h"
+#include "rpcworkqueue.h"
 
 #include "base58.h"
 #include "netbase.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace json_spirit;
@@ -172,4 +175,67 @@ BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
     BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::ffff:127.0.0.1")).ToString(), "127.0.0.1");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_latency_stats)
+{
+    {
+        CRPCLatencyTimer timer("rpc_tests_endpoint");
+    }
+    {
+        CRPCLatencyTimer timer("rpc_tests_endpoint");
+    }
+
+    Value r = CallRPC("getrpcstats");
+    const Object& endpoints = find_value(r.get_obj(), "endpoints").get_obj();
+    const Object& stats = find_value(endpoints, "rpc_tests_endpoint").get_obj();
+    BOOST_CHECK_EQUAL(find_value(stats, "calls").get_int(), 2);
+    BOOST_CHECK(find_value(stats, "max_ms").get_real() >= find_value(stats, "avg_ms").get_real());
+    BOOST_CHECK_EQUAL(find_value(find_value(r.get_obj(), "workqueue").get_obj(), "rejected").get_int(), 0);
+    BOOST_CHECK_THROW(CallRPC("getrpcstats extra"), runtime_error);
+}
+
+static void IncrementCount(int* pnCount)
+{
+    (*pnCount)++;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_work_queue_depth)
+{
+    // with no worker running the queue fills up to its depth and refuses the rest
+    CRPCWorkQueue queue(2);
+    int nCount = 0;
+    BOOST_CHECK(queue.Enqueue(boost::bind(&IncrementCount, &nCount)));
+    BOOST_CHECK(queue.Enqueue(boost::bind(&IncrementCount, &nCount)));
+    BOOST_CHECK_EQUAL(queue.Depth(), 2U);
+    BOOST_CHECK(!queue.Enqueue(boost::bind(&IncrementCount, &nCount)));
+    BOOST_CHECK_EQUAL(queue.Depth(), queue.MaxDepth());
+
+    // a worker drains it and makes room again
+    boost::thread worker(boost::bind(&CRPCWorkQueue::Run, &queue));
+    for (int i = 0; i < 1000 && queue.Depth() > 0; i++)
+        MilliSleep(10);
+    BOOST_CHECK_EQUAL(queue.Depth(), 0U);
+    BOOST_CHECK(queue.Enqueue(boost::bind(&IncrementCount, &nCount)));
+    for (int i = 0; i < 1000 && queue.Depth() > 0; i++)
+        MilliSleep(10);
+
+    queue.Interrupt();
+    BOOST_CHECK(worker.timed_join(boost::posix_time::seconds(10)));
+    BOOST_CHECK_EQUAL(nCount, 3);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_work_queue_interrupt)
+{
+    // an idle worker wakes up and returns
+    CRPCWorkQueue queue(2);
+    boost::thread worker(boost::bind(&CRPCWorkQueue::Run, &queue));
+    queue.Interrupt();
+    BOOST_CHECK(worker.timed_join(boost::posix_time::seconds(10)));
+
+    // and nothing is queued once shutting down
+    int nCount = 0;
+    BOOST_CHECK(!queue.Enqueue(boost::bind(&IncrementCount, &nCount)));
+    BOOST_CHECK_EQUAL(queue.Depth(), 0U);
+    BOOST_CHECK_EQUAL(nCount, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
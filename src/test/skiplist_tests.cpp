@@ -99,4 +99,44 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chaintipsnapshot_test)
+{
+    // A main chain and a fork off it at height 500, both 1000 blocks long.
+    std::vector<CBlockIndex> vBlocksMain(1000);
+    std::vector<CBlockIndex> vBlocksSide(500);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].BuildSkip();
+    }
+    for (unsigned int i=0; i<vBlocksSide.size(); i++) {
+        vBlocksSide[i].nHeight = i + 500;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[499];
+        vBlocksSide[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+    CChainTipSnapshot tip;
+    tip.pindex = &vBlocksMain.back();
+    tip.nHeight = tip.pindex->nHeight;
+
+    for (int i=0; i < 1000; i++) {
+        int nHeight = insecure_rand() % vBlocksMain.size();
+        BOOST_CHECK(tip[nHeight] == chain[nHeight]);
+        BOOST_CHECK(tip.Next(&vBlocksMain[nHeight]) == chain.Next(&vBlocksMain[nHeight]));
+        BOOST_CHECK(tip.Contains(&vBlocksMain[nHeight]));
+    }
+    BOOST_CHECK(tip[-1] == NULL);
+    BOOST_CHECK(tip[vBlocksMain.size()] == NULL);
+    BOOST_CHECK(!tip.Contains(&vBlocksSide[0]));
+    BOOST_CHECK(!tip.Contains(NULL));
+    BOOST_CHECK(tip.Next(&vBlocksSide[0]) == NULL);
+
+    // An empty chain contains nothing
+    CChainTipSnapshot empty;
+    BOOST_CHECK(empty[0] == NULL);
+    BOOST_CHECK(!empty.Contains(&vBlocksMain[0]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,54 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "masternode-sync.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(syncdigest_tests)
+
+BOOST_AUTO_TEST_CASE(syncdigest_differing_buckets)
+{
+    CSyncDigest digestA, digestB;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 1000; i++)
+        vHashes.push_back(Hash(BEGIN(i), END(i)));
+
+    // same set in a different order gives the same digest
+    for (unsigned int i = 0; i < vHashes.size(); i++) {
+        digestA.Add(vHashes[i]);
+        digestB.Add(vHashes[vHashes.size() - 1 - i]);
+    }
+    std::vector<bool> vDiffer = digestA.GetDifferingBuckets(digestB);
+    BOOST_CHECK(std::find(vDiffer.begin(), vDiffer.end(), true) == vDiffer.end());
+
+    // one extra item only flags its own bucket
+    uint256 hashExtra = Hash(BEGIN(vHashes[0]), END(vHashes[0]));
+    digestA.Add(hashExtra);
+    vDiffer = digestA.GetDifferingBuckets(digestB);
+    BOOST_CHECK_EQUAL(std::count(vDiffer.begin(), vDiffer.end(), true), 1);
+    BOOST_CHECK(vDiffer[CSyncDigest::GetBucket(hashExtra)]);
+
+    // and survives the round trip through the network
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << digestA;
+    CSyncDigest digestC;
+    ss >> digestC;
+    vDiffer = digestA.GetDifferingBuckets(digestC);
+    BOOST_CHECK(std::find(vDiffer.begin(), vDiffer.end(), true) == vDiffer.end());
+}
+
+BOOST_AUTO_TEST_CASE(syncdigest_malformed)
+{
+    CSyncDigest digest, digestBad;
+    digestBad.vBuckets.resize(3);
+
+    // a digest we can't compare against makes us send everything
+    std::vector<bool> vDiffer = digest.GetDifferingBuckets(digestBad);
+    BOOST_CHECK_EQUAL(vDiffer.size(), CSyncDigest::BUCKETS);
+    BOOST_CHECK(std::find(vDiffer.begin(), vDiffer.end(), false) == vDiffer.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
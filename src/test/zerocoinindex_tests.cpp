@@ -0,0 +1,113 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txdb.h"
+#include "zerocoinindex.h"
+
+#include <boost/test/unit_test.hpp>
+
+typedef std::vector<std::pair<CBigNum, CZerocoinIndexValue> > ZerocoinIndexEntries;
+typedef std::vector<std::pair<CZerocoinHeightKey, CBigNum> > ZerocoinIndexRange;
+
+BOOST_AUTO_TEST_SUITE(zerocoinindex_tests)
+
+static void MakeEntries(ZerocoinIndexEntries& vMints, ZerocoinIndexEntries& vSpends)
+{
+    vMints.push_back(std::make_pair(CBigNum(1001), CZerocoinIndexValue(uint256(1), 10, 1)));
+    vMints.push_back(std::make_pair(CBigNum(1002), CZerocoinIndexValue(uint256(2), 20, 5)));
+    vMints.push_back(std::make_pair(CBigNum(1003), CZerocoinIndexValue(uint256(3), 30, 1)));
+    vSpends.push_back(std::make_pair(CBigNum(2001), CZerocoinIndexValue(uint256(4), 20, 1)));
+}
+
+static size_t RangeSize(CZerocoinDB& db, unsigned char type, int nStart, int nEnd, int nDenomination)
+{
+    ZerocoinIndexRange vRange;
+    BOOST_CHECK(db.ReadZerocoinIndexRange(type, nStart, nEnd, nDenomination, vRange));
+    return vRange.size();
+}
+
+BOOST_AUTO_TEST_CASE(zerocoinindex_write_erase)
+{
+    CZerocoinDB db(1 << 20, true);
+    ZerocoinIndexEntries vMints, vSpends;
+    MakeEntries(vMints, vSpends);
+
+    BOOST_CHECK(db.WriteZerocoinIndex(vMints, vSpends));
+    CZerocoinIndexValue value;
+    BOOST_CHECK(db.ReadMintIndex(CBigNum(1002), value));
+    BOOST_CHECK(value.txid == uint256(2));
+    BOOST_CHECK_EQUAL(value.nHeight, 20);
+    BOOST_CHECK_EQUAL(value.nDenomination, 5);
+    BOOST_CHECK(db.ReadSpendIndex(CBigNum(2001), value));
+    BOOST_CHECK(value.txid == uint256(4));
+    BOOST_CHECK(!db.ReadSpendIndex(CBigNum(1002), value));
+
+    // erasing what was written leaves neither the lookups nor the height records
+    BOOST_CHECK(db.EraseZerocoinIndex(vMints, vSpends));
+    BOOST_CHECK(!db.ReadMintIndex(CBigNum(1001), value));
+    BOOST_CHECK(!db.ReadMintIndex(CBigNum(1002), value));
+    BOOST_CHECK(!db.ReadMintIndex(CBigNum(1003), value));
+    BOOST_CHECK(!db.ReadSpendIndex(CBigNum(2001), value));
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 100, 0), 0U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_SPEND, 0, 100, 0), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoinindex_range)
+{
+    CZerocoinDB db(1 << 20, true);
+    ZerocoinIndexEntries vMints, vSpends;
+    MakeEntries(vMints, vSpends);
+    BOOST_CHECK(db.WriteZerocoinIndex(vMints, vSpends));
+
+    // both ends of the range are included
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 100, 0), 3U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 10, 20, 0), 2U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 20, 20, 0), 1U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 11, 29, 0), 1U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 31, 100, 0), 0U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 9, 0), 0U);
+
+    // the denomination filter, and mints and spends kept apart
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 100, 1), 2U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 100, 5), 1U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 100, 10), 0U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_SPEND, 0, 100, 0), 1U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_SPEND, 0, 100, 5), 0U);
+
+    // records come back in height order with the coin they index
+    ZerocoinIndexRange vRange;
+    BOOST_CHECK(db.ReadZerocoinIndexRange(ZEROCOIN_INDEX_MINT, 0, 100, 0, vRange));
+    BOOST_REQUIRE_EQUAL(vRange.size(), 3U);
+    BOOST_CHECK_EQUAL(vRange[0].first.nHeight, 10);
+    BOOST_CHECK_EQUAL(vRange[1].first.nHeight, 20);
+    BOOST_CHECK_EQUAL(vRange[2].first.nHeight, 30);
+    BOOST_CHECK(vRange[1].second == CBigNum(1002));
+    BOOST_CHECK(vRange[1].first.txid == uint256(2));
+}
+
+BOOST_AUTO_TEST_CASE(zerocoinindex_wipe)
+{
+    CZerocoinDB db(1 << 20, true);
+    ZerocoinIndexEntries vMints, vSpends;
+    MakeEntries(vMints, vSpends);
+    BOOST_CHECK(db.WriteZerocoinIndex(vMints, vSpends));
+    BOOST_CHECK(db.WriteFlag("zerocoinindex", true));
+    BOOST_CHECK(db.WriteCoinSpend(CBigNum(2001), uint256(4)));
+
+    BOOST_CHECK(db.WipeZerocoinIndex());
+    CZerocoinIndexValue value;
+    BOOST_CHECK(!db.ReadMintIndex(CBigNum(1001), value));
+    BOOST_CHECK(!db.ReadSpendIndex(CBigNum(2001), value));
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_MINT, 0, 100, 0), 0U);
+    BOOST_CHECK_EQUAL(RangeSize(db, ZEROCOIN_INDEX_SPEND, 0, 100, 0), 0U);
+    bool fValue;
+    BOOST_CHECK(!db.ReadFlag("zerocoinindex", fValue));
+
+    // the serials the node tracks anyway are not part of the index
+    uint256 txHash;
+    BOOST_CHECK(db.ReadCoinSpend(CBigNum(2001), txHash));
+    BOOST_CHECK(txHash == uint256(4));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -129,7 +129,6 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -152,10 +151,9 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                 for (unsigned int i = 0; i < coins.vout.size(); i++) {
                     const CTxOut& out = coins.vout[i];
                     if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
                         ss << VARINT(i + 1);
                         ss << out;
-                        nTotalAmount += out.nValue;
+                        stats.UpdateOutput(COutPoint(txhash, i), out, true);
                     }
                 }
                 stats.nSerializedSize += 32 + slValue.size();
@@ -168,10 +166,19 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     }
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
+bool CBlockTreeDB::ReadUTXOStats(const uint256& hashBlock, CCoinsStats& stats)
+{
+    return Read(make_pair('U', hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteUTXOStats(const CCoinsStats& stats)
+{
+    return Write(make_pair('U', stats.hashBlock), stats);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
 {
     return Read(make_pair('t', txid), pos);
@@ -185,6 +192,128 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', key), value);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey indexKey;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(indexKey, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair('a', it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Erase(make_pair('a', it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int start, int end)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (start > 0 && end > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash, start));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey indexKey;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+            if (end > 0 && indexKey.blockHeight > end)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -366,3 +495,146 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('a', nChecksum));
 }
+
+static uint256 GetZerocoinHash(const CBigNum& bn)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bn;
+    return Hash(ss.begin(), ss.end());
+}
+
+static void BatchZerocoinIndex(CLevelDBBatch& batch, unsigned char type, const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vect, bool fErase)
+{
+    const char chInfo = type == ZEROCOIN_INDEX_MINT ? 'M' : 'S';
+    for (std::vector<std::pair<CBigNum, CZerocoinIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        uint256 hashCoin = GetZerocoinHash(it->first);
+        CZerocoinHeightKey key(type, it->second.nHeight, it->second.nDenomination, it->second.txid, hashCoin);
+        if (fErase) {
+            batch.Erase(make_pair(chInfo, hashCoin));
+            batch.Erase(make_pair('H', key));
+        } else {
+            batch.Write(make_pair(chInfo, hashCoin), it->second);
+            batch.Write(make_pair('H', key), it->first);
+        }
+    }
+}
+
+bool CZerocoinDB::WriteZerocoinIndex(const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vMints, const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vSpends)
+{
+    CLevelDBBatch batch;
+    BatchZerocoinIndex(batch, ZEROCOIN_INDEX_MINT, vMints, false);
+    BatchZerocoinIndex(batch, ZEROCOIN_INDEX_SPEND, vSpends, false);
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::EraseZerocoinIndex(const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vMints, const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vSpends)
+{
+    CLevelDBBatch batch;
+    BatchZerocoinIndex(batch, ZEROCOIN_INDEX_MINT, vMints, true);
+    BatchZerocoinIndex(batch, ZEROCOIN_INDEX_SPEND, vSpends, true);
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::ReadMintIndex(const CBigNum& bnPubcoin, CZerocoinIndexValue& value)
+{
+    return Read(make_pair('M', GetZerocoinHash(bnPubcoin)), value);
+}
+
+bool CZerocoinDB::ReadSpendIndex(const CBigNum& bnSerial, CZerocoinIndexValue& value)
+{
+    return Read(make_pair('S', GetZerocoinHash(bnSerial)), value);
+}
+
+bool CZerocoinDB::ReadZerocoinIndexRange(unsigned char type, int nStart, int nEnd, int nDenomination, std::vector<std::pair<CZerocoinHeightKey, CBigNum> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('H', CZerocoinHeightIteratorKey(type, nStart));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CZerocoinHeightKey key;
+            ssKey >> chType;
+            if (chType != 'H')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.nHeight > nEnd)
+                break;
+
+            if (nDenomination == 0 || key.nDenomination == nDenomination) {
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CBigNum bnValue;
+                ssValue >> bnValue;
+                vect.push_back(make_pair(key, bnValue));
+            }
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+template <typename K>
+static bool EraseZerocoinIndexRecords(leveldb::Iterator* pcursor, char chRecord, CLevelDBBatch& batch)
+{
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << chRecord;
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            K key;
+            ssKey >> chType;
+            if (chType != chRecord)
+                break;
+            ssKey >> key;
+            batch.Erase(make_pair(chRecord, key));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CZerocoinDB::WipeZerocoinIndex()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CLevelDBBatch batch;
+    if (!EraseZerocoinIndexRecords<uint256>(pcursor.get(), 'M', batch) ||
+        !EraseZerocoinIndexRecords<uint256>(pcursor.get(), 'S', batch) ||
+        !EraseZerocoinIndexRecords<CZerocoinHeightKey>(pcursor.get(), 'H', batch))
+        return false;
+    batch.Erase(std::make_pair('F', std::string("zerocoinindex")));
+
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::WriteFlag(const std::string& name, bool fValue)
+{
+    return Write(std::make_pair('F', name), fValue ? '1' : '0');
+}
+
+bool CZerocoinDB::ReadFlag(const std::string& name, bool& fValue)
+{
+    char ch;
+    if (!Read(std::make_pair('F', name), ch))
+        return false;
+    fValue = ch == '1';
+    return true;
+}
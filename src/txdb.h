@@ -8,9 +8,12 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
 #include "primitives/zerocoin.h"
+#include "zerocoinindex.h"
 
 #include <map>
 #include <string>
@@ -61,8 +64,18 @@ public:
     bool WriteLastBlockFile(int nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
+    //! UTXO set statistics after connecting a block, kept up to date by ConnectBlock
+    bool ReadUTXOStats(const uint256& hashBlock, CCoinsStats& stats);
+    bool WriteUTXOStats(const CCoinsStats& stats);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int start = 0, int end = 0);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -89,6 +102,14 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    bool WriteZerocoinIndex(const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vMints, const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vSpends);
+    bool EraseZerocoinIndex(const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vMints, const std::vector<std::pair<CBigNum, CZerocoinIndexValue> >& vSpends);
+    bool ReadMintIndex(const CBigNum& bnPubcoin, CZerocoinIndexValue& value);
+    bool ReadSpendIndex(const CBigNum& bnSerial, CZerocoinIndexValue& value);
+    bool ReadZerocoinIndexRange(unsigned char type, int nStart, int nEnd, int nDenomination, std::vector<std::pair<CZerocoinHeightKey, CBigNum> >& vect);
+    bool WipeZerocoinIndex();
+    bool WriteFlag(const std::string& name, bool fValue);
+    bool ReadFlag(const std::string& name, bool& fValue);
 };
 
 #endif // BITCOIN_TXDB_H
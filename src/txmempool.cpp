@@ -15,9 +15,37 @@
 
 #include <boost/circular_buffer.hpp>
 
+#include <limits>
+
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+// rough size of a node in the std::map/std::set based indexes
+static const size_t MEMPOOL_NODE_OVERHEAD = 4 * sizeof(void*);
+// ... and of a mapTx node, with its hashed and three ordered indexes
+static const size_t MEMPOOL_ENTRY_OVERHEAD = 12 * sizeof(void*);
+// memory used by one parent or child link in mapLinks
+static const size_t MEMPOOL_LINK_USAGE = MEMPOOL_NODE_OVERHEAD + sizeof(CTxMemPool::txiter);
+
+// lower bounds of the fee histogram ranges, in satoshis per kB
+static const CAmount FEE_HISTOGRAM_BOUNDS[] = {0, 1000, 2000, 5000, 10000, 20000, 30000, 50000, 75000, 100000,
+                                               150000, 200000, 300000, 500000, 1000000, 2000000, 5000000, 10000000};
+
+/** Estimate of the heap memory an entry takes in mapTx, mapNextTx and mapLinks */
+static size_t EstimateEntryUsage(const CTransaction& tx)
+{
+    size_t nUsage = MEMPOOL_ENTRY_OVERHEAD + sizeof(CTxMemPoolEntry);
+    nUsage += MEMPOOL_NODE_OVERHEAD + sizeof(CTxMemPool::txiter) + 2 * sizeof(CTxMemPool::setEntries);
+    BOOST_FOREACH (const CTxIn& txin, tx.vin)
+        nUsage += sizeof(CTxIn) + txin.scriptSig.size() + MEMPOOL_NODE_OVERHEAD + sizeof(COutPoint) + sizeof(CInPoint);
+    BOOST_FOREACH (const CTxOut& txout, tx.vout)
+        nUsage += sizeof(CTxOut) + txout.scriptPubKey.size();
+    return nUsage;
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nUsageSize(0),
+                                     dPriorityGrowth(0.0), dPriorityBase(0.0), dPriorityDelta(0.0),
+                                     nCountWithDescendants(0), nSizeWithDescendants(0), nFeesWithDescendants(0),
+                                     nCountWithAncestors(0), nSizeWithAncestors(0), nFeesWithAncestors(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
@@ -27,6 +55,19 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+    nUsageSize = EstimateEntryUsage(tx);
+    CAmount nValueIn = tx.GetValueOut() + nFee;
+    dPriorityGrowth = nModSize ? (double)nValueIn / nModSize : 0.0;
+    dPriorityBase = dPriority - nHeight * dPriorityGrowth;
+    dPriorityDelta = 0.0;
+
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nFeesWithDescendants = nFee;
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nFeesWithAncestors = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -43,6 +84,44 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+double CTxMemPoolEntry::GetDescendantScore() const
+{
+    if (nTxSize == 0 || nSizeWithDescendants == 0)
+        return 0;
+
+    // a well paying child keeps its parents in the pool, a well paying parent
+    // doesn't protect its children since they are scored on their own
+    double dFeeRate = (double)nFee / nTxSize;
+    double dDescendantFeeRate = (double)nFeesWithDescendants / nSizeWithDescendants;
+    return std::max(dFeeRate, dDescendantFeeRate);
+}
+
+double CTxMemPoolEntry::GetAncestorScore() const
+{
+    if (nTxSize == 0 || nSizeWithAncestors == 0)
+        return 0;
+
+    // a transaction can't be mined without its ancestors, and a cheap
+    // transaction shouldn't ride along on a well paying parent
+    double dFeeRate = (double)nFee / nTxSize;
+    double dAncestorFeeRate = (double)nFeesWithAncestors / nSizeWithAncestors;
+    return std::min(dFeeRate, dAncestorFeeRate);
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount)
+{
+    nSizeWithDescendants += nModifySize;
+    nFeesWithDescendants += nModifyFee;
+    nCountWithDescendants += nModifyCount;
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount)
+{
+    nSizeWithAncestors += nModifySize;
+    nFeesWithAncestors += nModifyFee;
+    nCountWithAncestors += nModifyCount;
+}
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -356,7 +435,12 @@ public:
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       totalTxSize(0),
+                                                       cachedInnerUsage(0),
+                                                       lastRollingFeeUpdate(GetTime()),
+                                                       blockSinceLastRollingFeeBump(false),
+                                                       rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -369,6 +453,9 @@ CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
     // Confirmation times for very-low-fee transactions that take more
     // than an hour or three to confirm are highly variable.
     minerPolicyEstimator = new CMinerPolicyEstimator(25);
+
+    BOOST_FOREACH (CAmount nBound, FEE_HISTOGRAM_BOUNDS)
+        vFeeHistogram.push_back(CFeeRateBucket(nBound));
 }
 
 CTxMemPool::~CTxMemPool()
@@ -402,34 +489,309 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
+{
+    setEntries& parents = mapLinks[entry].parents;
+    if (add && parents.insert(parent).second)
+        cachedInnerUsage += MEMPOOL_LINK_USAGE;
+    else if (!add && parents.erase(parent))
+        cachedInnerUsage -= MEMPOOL_LINK_USAGE;
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+{
+    setEntries& children = mapLinks[entry].children;
+    if (add && children.insert(child).second)
+        cachedInnerUsage += MEMPOOL_LINK_USAGE;
+    else if (!add && children.erase(child))
+        cachedInnerUsage -= MEMPOOL_LINK_USAGE;
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolParents(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.parents;
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolChildren(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.children;
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents) const
+{
+    LOCK(cs);
+
+    setEntries parentHashes;
+    const CTransaction& tx = entry.GetTx();
+
+    if (fSearchForParents) {
+        // Get parents of this transaction that are in the mempool
+        if (!tx.IsZerocoinSpend()) {
+            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+                txiter piter = mapTx.find(txin.prevout.hash);
+                if (piter != mapTx.end()) {
+                    parentHashes.insert(piter);
+                    if (parentHashes.size() + 1 > limitAncestorCount) {
+                        errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
+                        return false;
+                    }
+                }
+            }
+        }
+    } else {
+        // the entry is in the pool, use its recorded parents
+        txiter it = mapTx.iterator_to(entry);
+        parentHashes = GetMemPoolParents(it);
+    }
+
+    size_t totalSizeWithAncestors = entry.GetTxSize();
+
+    while (!parentHashes.empty()) {
+        txiter stageit = *parentHashes.begin();
+
+        setAncestors.insert(stageit);
+        parentHashes.erase(stageit);
+        totalSizeWithAncestors += stageit->GetTxSize();
+
+        if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantSize);
+            return false;
+        } else if (stageit->GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantCount);
+            return false;
+        } else if (totalSizeWithAncestors > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        }
+
+        BOOST_FOREACH (const txiter& phash, GetMemPoolParents(stageit)) {
+            // If this is a new ancestor, add it.
+            if (setAncestors.count(phash) == 0)
+                parentHashes.insert(phash);
+        }
+        if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
+{
+    setEntries stage;
+    if (setDescendants.count(entryit) == 0)
+        stage.insert(entryit);
+
+    // Traverse down the children of entry, only adding children that are not
+    // accounted for in setDescendants already (because those children have either
+    // already been walked, or will be walked in this iteration).
+    while (!stage.empty()) {
+        txiter it = *stage.begin();
+        setDescendants.insert(it);
+        stage.erase(it);
+
+        BOOST_FOREACH (const txiter& childiter, GetMemPoolChildren(it)) {
+            if (!setDescendants.count(childiter))
+                stage.insert(childiter);
+        }
+    }
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
+{
+    LOCK(cs);
+    setEntries setAncestors;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+    return addUnchecked(hash, entry, setAncestors);
+}
+
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry, const setEntries& setAncestors)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
+        if (mapTx.count(hash))
+            return true;
+
+        // after a reorg the pool can already hold transactions spending this one,
+        // they become descendants of it and of its ancestors
+        setEntries setChildren;
+        std::map<COutPoint, CInPoint>::const_iterator itNext = mapNextTx.lower_bound(COutPoint(hash, 0));
+        for (; itNext != mapNextTx.end() && itNext->first.hash == hash; ++itNext)
+            setChildren.insert(mapTx.find(itNext->second.ptx->GetHash()));
+
+        setEntries setDescendants;
+        BOOST_FOREACH (const txiter& child, setChildren)
+            CalculateDescendants(child, setDescendants);
+
+        // ancestors the descendants have without going through the new entry
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        std::map<txiter, setEntries, CompareIteratorByHash> mapDescendantAncestors;
+        BOOST_FOREACH (const txiter& descendant, setDescendants)
+            CalculateMemPoolAncestors(*descendant, mapDescendantAncestors[descendant], nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        txiter newit = mapTx.insert(entry).first;
+        mapLinks.insert(make_pair(newit, TxLinks()));
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+        if (pos != mapDeltas.end())
+            mapTx.modify(newit, update_priority_delta(pos->second.first));
+
+        const CTransaction& tx = newit->GetTx();
         if(!tx.IsZerocoinSpend()) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+                txiter parent = mapTx.find(tx.vin[i].prevout.hash);
+                if (parent != mapTx.end()) {
+                    UpdateParent(newit, parent, true);
+                    UpdateChild(parent, newit, true);
+                }
+            }
+        }
+        BOOST_FOREACH (const txiter& child, setChildren) {
+            UpdateParent(child, newit, true);
+            UpdateChild(newit, child, true);
+        }
+
+        // totals of the new entry
+        int64_t nAncestorSize = 0;
+        CAmount nAncestorFees = 0;
+        BOOST_FOREACH (const txiter& ancestor, setAncestors) {
+            nAncestorSize += ancestor->GetTxSize();
+            nAncestorFees += ancestor->GetFee();
+        }
+        mapTx.modify(newit, update_ancestor_state(nAncestorSize, nAncestorFees, setAncestors.size()));
+
+        int64_t nDescendantSize = 0;
+        CAmount nDescendantFees = 0;
+        BOOST_FOREACH (const txiter& descendant, setDescendants) {
+            nDescendantSize += descendant->GetTxSize();
+            nDescendantFees += descendant->GetFee();
+        }
+        mapTx.modify(newit, update_descendant_state(nDescendantSize, nDescendantFees, setDescendants.size()));
+
+        // ancestors gain the new entry and the descendants they didn't have yet
+        BOOST_FOREACH (const txiter& ancestor, setAncestors) {
+            int64_t nModifySize = entry.GetTxSize();
+            CAmount nModifyFee = entry.GetFee();
+            int64_t nModifyCount = 1;
+            BOOST_FOREACH (const txiter& descendant, setDescendants) {
+                if (mapDescendantAncestors[descendant].count(ancestor))
+                    continue;
+                nModifySize += descendant->GetTxSize();
+                nModifyFee += descendant->GetFee();
+                nModifyCount++;
+            }
+            mapTx.modify(ancestor, update_descendant_state(nModifySize, nModifyFee, nModifyCount));
+        }
+
+        // ... and descendants gain the new entry and the ancestors they didn't have yet
+        BOOST_FOREACH (const txiter& descendant, setDescendants) {
+            int64_t nModifySize = entry.GetTxSize();
+            CAmount nModifyFee = entry.GetFee();
+            int64_t nModifyCount = 1;
+            BOOST_FOREACH (const txiter& ancestor, setAncestors) {
+                if (mapDescendantAncestors[descendant].count(ancestor))
+                    continue;
+                nModifySize += ancestor->GetTxSize();
+                nModifyFee += ancestor->GetFee();
+                nModifyCount++;
+            }
+            mapTx.modify(descendant, update_ancestor_state(nModifySize, nModifyFee, nModifyCount));
         }
+
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
+        cachedInnerUsage += entry.GetUsageSize();
+        UpdateFeeHistogram(entry, true);
     }
     return true;
 }
 
+void CTxMemPool::UpdateForRemoveFromMempool(const setEntries& entriesToRemove)
+{
+    AssertLockHeld(cs);
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+
+    // Take each removed entry out of the totals of the ancestors and descendants
+    // that stay. Links are only cut afterwards, so the walks see the full graph.
+    BOOST_FOREACH (const txiter& removeIt, entriesToRemove) {
+        int64_t nSize = removeIt->GetTxSize();
+        CAmount nFee = removeIt->GetFee();
+
+        setEntries setAncestors;
+        CalculateMemPoolAncestors(*removeIt, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        BOOST_FOREACH (const txiter& ancestor, setAncestors) {
+            if (!entriesToRemove.count(ancestor))
+                mapTx.modify(ancestor, update_descendant_state(-nSize, -nFee, -1));
+        }
+
+        // only mined transactions leave descendants behind
+        setEntries setDescendants;
+        CalculateDescendants(removeIt, setDescendants);
+        BOOST_FOREACH (const txiter& descendant, setDescendants) {
+            if (!entriesToRemove.count(descendant))
+                mapTx.modify(descendant, update_ancestor_state(-nSize, -nFee, -1));
+        }
+    }
+
+    BOOST_FOREACH (const txiter& removeIt, entriesToRemove) {
+        BOOST_FOREACH (const txiter& parent, GetMemPoolParents(removeIt))
+            UpdateChild(parent, removeIt, false);
+        BOOST_FOREACH (const txiter& child, GetMemPoolChildren(removeIt))
+            UpdateParent(child, removeIt, false);
+    }
+}
+
+void CTxMemPool::removeUnchecked(txiter it)
+{
+    const CTransaction& tx = it->GetTx();
+    BOOST_FOREACH (const CTxIn& txin, tx.vin)
+        mapNextTx.erase(txin.prevout);
+
+    // the entry's own link sets go with it
+    const TxLinks& links = mapLinks[it];
+    cachedInnerUsage -= (links.parents.size() + links.children.size()) * MEMPOOL_LINK_USAGE;
+
+    totalTxSize -= it->GetTxSize();
+    cachedInnerUsage -= it->GetUsageSize();
+    UpdateFeeHistogram(*it, false);
+    mapLinks.erase(it);
+    mapTx.erase(it);
+    nTransactionsUpdated++;
+}
+
+void CTxMemPool::RemoveStaged(const setEntries& stage)
+{
+    AssertLockHeld(cs);
+    UpdateForRemoveFromMempool(stage);
+    BOOST_FOREACH (const txiter& it, stage)
+        removeUnchecked(it);
+}
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
-        std::deque<uint256> txToRemove;
-        txToRemove.push_back(origTx.GetHash());
-        if (fRecursive && !mapTx.count(origTx.GetHash())) {
+        setEntries txToRemove;
+        txiter origit = mapTx.find(origTx.GetHash());
+        if (origit != mapTx.end()) {
+            txToRemove.insert(origit);
+        } else if (fRecursive) {
             // If recursively removing but origTx isn't in the mempool
             // be sure to remove any children that are in the pool. This can
             // happen during chain re-orgs if origTx isn't re-accepted into
@@ -438,31 +800,22 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
-                txToRemove.push_back(it->second.ptx->GetHash());
+                txiter nextit = mapTx.find(it->second.ptx->GetHash());
+                assert(nextit != mapTx.end());
+                txToRemove.insert(nextit);
             }
         }
-        while (!txToRemove.empty()) {
-            uint256 hash = txToRemove.front();
-            txToRemove.pop_front();
-            if (!mapTx.count(hash))
-                continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
-            if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
-                    txToRemove.push_back(it->second.ptx->GetHash());
-                }
-            }
-            BOOST_FOREACH (const CTxIn& txin, tx.vin)
-                mapNextTx.erase(txin.prevout);
 
-            removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
+        setEntries setAllRemoves;
+        if (fRecursive) {
+            BOOST_FOREACH (const txiter& it, txToRemove)
+                CalculateDescendants(it, setAllRemoves);
+        } else {
+            setAllRemoves.swap(txToRemove);
         }
+        BOOST_FOREACH (const txiter& it, setAllRemoves)
+            removed.push_back(it->GetTx());
+        RemoveStaged(setAllRemoves);
     }
 }
 
@@ -471,10 +824,10 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
     // Remove transactions spending a coinbase which are now immature
     LOCK(cs);
     list<CTransaction> transactionsToRemove;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->second.GetTx();
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        const CTransaction& tx = it->GetTx();
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
             const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
@@ -516,8 +869,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     std::vector<CTxMemPoolEntry> entries;
     BOOST_FOREACH (const CTransaction& tx, vtx) {
         uint256 hash = tx.GetHash();
-        if (mapTx.count(hash))
-            entries.push_back(mapTx[hash]);
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i != mapTx.end())
+            entries.push_back(*i);
     }
     minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
     BOOST_FOREACH (const CTransaction& tx, vtx) {
@@ -526,6 +880,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 
@@ -534,7 +890,14 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapLinks.clear();
     totalTxSize = 0;
+    cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
+    BOOST_FOREACH (CFeeRateBucket& bucket, vFeeHistogram)
+        bucket = CFeeRateBucket(bucket.nMinFeeRate);
     ++nTransactionsUpdated;
 }
 
@@ -546,23 +909,32 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     LogPrint("mempool", "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
+    uint64_t checkInnerUsage = 0;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
 
     LOCK(cs);
     list<const CTxMemPoolEntry*> waitingOnDependants;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
-        checkTotal += it->second.GetTxSize();
-        const CTransaction& tx = it->second.GetTx();
+        checkTotal += it->GetTxSize();
+        checkInnerUsage += it->GetUsageSize();
+        const CTransaction& tx = it->GetTx();
+        txlinksMap::const_iterator linksiter = mapLinks.find(it);
+        assert(linksiter != mapLinks.end());
+        const TxLinks& links = linksiter->second;
+        checkInnerUsage += (links.parents.size() + links.children.size()) * MEMPOOL_LINK_USAGE;
         bool fDependsWait = false;
+        setEntries setParentCheck;
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end()) {
-                const CTransaction& tx2 = it2->second.GetTx();
+                const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
+                setParentCheck.insert(it2);
             } else {
                 const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
                 assert(coins && coins->IsAvailable(txin.prevout.n));
@@ -574,8 +946,36 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+        assert(setParentCheck == links.parents);
+
+        // Check the cached ancestor and descendant totals against the graph
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        uint64_t nSizeCheck = it->GetTxSize();
+        CAmount nFeesCheck = it->GetFee();
+        BOOST_FOREACH (const txiter& ancestor, setAncestors) {
+            nSizeCheck += ancestor->GetTxSize();
+            nFeesCheck += ancestor->GetFee();
+        }
+        assert(it->GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->GetSizeWithAncestors() == nSizeCheck);
+        assert(it->GetFeesWithAncestors() == nFeesCheck);
+
+        setEntries setDescendants;
+        CalculateDescendants(it, setDescendants);
+        nSizeCheck = 0;
+        nFeesCheck = 0;
+        BOOST_FOREACH (const txiter& descendant, setDescendants) {
+            nSizeCheck += descendant->GetTxSize();
+            nFeesCheck += descendant->GetFee();
+        }
+        assert(it->GetCountWithDescendants() == setDescendants.size());
+        assert(it->GetSizeWithDescendants() == nSizeCheck);
+        assert(it->GetFeesWithDescendants() == nFeesCheck);
+
         if (fDependsWait)
-            waitingOnDependants.push_back(&it->second);
+            waitingOnDependants.push_back(&(*it));
         else {
             CValidationState state;
             CTxUndo undo;
@@ -601,15 +1001,26 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
     for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
-        map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(hash);
-        const CTransaction& tx = it2->second.GetTx();
+        indexed_transaction_set::const_iterator it2 = mapTx.find(hash);
         assert(it2 != mapTx.end());
+        const CTransaction& tx = it2->GetTx();
         assert(&tx == it->second.ptx);
         assert(tx.vin.size() > it->second.n);
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
 
     assert(totalTxSize == checkTotal);
+    assert(cachedInnerUsage == checkInnerUsage);
+    assert(mapLinks.size() == mapTx.size());
+
+    uint64_t nHistogramCount = 0;
+    uint64_t nHistogramSize = 0;
+    BOOST_FOREACH (const CFeeRateBucket& bucket, vFeeHistogram) {
+        nHistogramCount += bucket.nCount;
+        nHistogramSize += bucket.nSize;
+    }
+    assert(nHistogramCount == mapTx.size());
+    assert(nHistogramSize == totalTxSize);
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -618,16 +1029,16 @@ void CTxMemPool::queryHashes(vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back((*mi).first);
+    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+        vtxid.push_back(mi->GetTx().GetHash());
 }
 
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    map<uint256, CTxMemPoolEntry>::const_iterator i = mapTx.find(hash);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second.GetTx();
+    result = i->GetTx();
     return true;
 }
 
@@ -680,6 +1091,11 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end())
+            mapTx.modify(it, update_priority_delta(deltas.first));
+        // block templates selected before are out of date
+        nTransactionsUpdated++;
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -701,6 +1117,89 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
     mapDeltas.erase(hash);
 }
 
+int CTxMemPool::Expire(int64_t nTime)
+{
+    LOCK(cs);
+    indexed_transaction_set::index<entry_time>::type::iterator it = mapTx.get<entry_time>().begin();
+    setEntries toremove;
+    while (it != mapTx.get<entry_time>().end() && it->GetTime() < nTime) {
+        toremove.insert(mapTx.project<0>(it));
+        it++;
+    }
+
+    setEntries stage;
+    BOOST_FOREACH (const txiter& removeit, toremove)
+        CalculateDescendants(removeit, stage);
+    RemoveStaged(stage);
+    return stage.size();
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+
+        // to get back in, a package has to pay for its own relay on top of what was evicted
+        CFeeRate removed(it->GetFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed = CFeeRate(removed.GetFeePerK() + minRelayFee.GetFeePerK());
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        setEntries stage;
+        CalculateDescendants(mapTx.project<0>(it), stage);
+        nTxnRemoved += stage.size();
+        RemoveStaged(stage);
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate((CAmount)rollingMinimumFeeRate);
+
+    int64_t nTime = GetTime();
+    if (nTime > lastRollingFeeUpdate + 10) {
+        // decay faster while the pool has plenty of room
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (nTime - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = nTime;
+
+        if (rollingMinimumFeeRate < minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate((CAmount)rollingMinimumFeeRate), minRelayFee);
+}
+
+size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return cachedInnerUsage + mapDeltas.size() * (MEMPOOL_NODE_OVERHEAD + sizeof(uint256) + sizeof(std::pair<double, CAmount>));
+}
+
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) {}
 
@@ -721,3 +1220,29 @@ bool CCoinsViewMemPool::HaveCoins(const uint256& txid) const
 {
     return mempool.exists(txid) || base->HaveCoins(txid);
 }
+
+void CTxMemPool::UpdateFeeHistogram(const CTxMemPoolEntry& entry, bool add)
+{
+    CAmount nFeeRate = CFeeRate(entry.GetFee(), entry.GetTxSize()).GetFeePerK();
+
+    // the last range whose lower bound the fee rate reaches
+    std::vector<CFeeRateBucket>::iterator it = vFeeHistogram.begin();
+    while (it + 1 != vFeeHistogram.end() && (it + 1)->nMinFeeRate <= nFeeRate)
+        ++it;
+
+    if (add) {
+        it->nCount++;
+        it->nSize += entry.GetTxSize();
+        it->nFees += entry.GetFee();
+    } else {
+        it->nCount--;
+        it->nSize -= entry.GetTxSize();
+        it->nFees -= entry.GetFee();
+    }
+}
+
+std::vector<CFeeRateBucket> CTxMemPool::GetFeeHistogram() const
+{
+    LOCK(cs);
+    return vFeeHistogram;
+}
@@ -8,12 +8,18 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/identity.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -32,6 +38,9 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Seconds for the minimum fee raised by evictions to drop by half */
+static const int64_t ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
 /**
  * CTxMemPool stores these:
  */
@@ -45,6 +54,20 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    size_t nUsageSize;    //! Estimated memory used by the entry and its index entries
+    double dPriorityGrowth; //! Priority gained per block, the value of the inputs over the modified size
+    double dPriorityBase;   //! Priority the entry would have had at height 0
+    double dPriorityDelta;  //! Priority added by PrioritiseTransaction
+
+    // Totals for this transaction and all of its in-mempool descendants
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nFeesWithDescendants;
+
+    // ... and for this transaction and all of its in-mempool ancestors
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nFeesWithAncestors;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -57,6 +80,156 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    size_t GetUsageSize() const { return nUsageSize; }
+    double GetPriorityGrowth() const { return dPriorityGrowth; }
+    double GetModifiedPriorityBase() const { return dPriorityBase + dPriorityDelta; }
+    /** Priority with the delta at nHeightIn, the same as GetPriority() plus the delta up to rounding */
+    double GetModifiedPriority(unsigned int nHeightIn) const { return GetModifiedPriorityBase() + nHeightIn * dPriorityGrowth; }
+    void SetPriorityDelta(double dPriorityDeltaIn) { dPriorityDelta = dPriorityDeltaIn; }
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetFeesWithDescendants() const { return nFeesWithDescendants; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetFeesWithAncestors() const { return nFeesWithAncestors; }
+
+    /** Eviction score, the higher of the entry's own fee rate and that of its descendant package */
+    double GetDescendantScore() const;
+    /** Mining score, the lower of the entry's own fee rate and that of its ancestor package */
+    double GetAncestorScore() const;
+
+    void UpdateDescendantState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount);
+    void UpdateAncestorState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount);
+};
+
+// Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
+struct update_descendant_state {
+    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) : modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {
+    }
+
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct update_ancestor_state {
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) : modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {
+    }
+
+    void operator()(CTxMemPoolEntry& e) { e.UpdateAncestorState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct update_priority_delta {
+    update_priority_delta(double _delta) : delta(_delta) {}
+
+    void operator()(CTxMemPoolEntry& e) { e.SetPriorityDelta(delta); }
+
+private:
+    double delta;
+};
+
+// extracts a txid from a CTxMemPoolEntry, the key of the primary index
+struct mempoolentry_txid {
+    typedef uint256 result_type;
+    result_type operator()(const CTxMemPoolEntry& entry) const
+    {
+        return entry.GetTx().GetHash();
+    }
+};
+
+struct TxidHasher {
+    size_t operator()(const uint256& txid) const { return txid.GetLow64(); }
+};
+
+/** Lowest descendant score first, the order in which entries are evicted */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = a.GetDescendantScore();
+        double f2 = b.GetDescendantScore();
+        if (f1 != f2)
+            return f1 < f2;
+        // of equal entries, the most recent one goes first
+        if (a.GetTime() != b.GetTime())
+            return a.GetTime() > b.GetTime();
+        return a.GetTx().GetHash() < b.GetTx().GetHash();
+    }
+};
+
+/** Oldest entry first */
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        if (a.GetTime() != b.GetTime())
+            return a.GetTime() < b.GetTime();
+        return a.GetTx().GetHash() < b.GetTx().GetHash();
+    }
+};
+
+/** Highest ancestor score first, the order in which entries are worth mining */
+class CompareTxMemPoolEntryByAncestorScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = a.GetAncestorScore();
+        double f2 = b.GetAncestorScore();
+        if (f1 != f2)
+            return f1 > f2;
+        return a.GetTx().GetHash() < b.GetTx().GetHash();
+    }
+};
+
+/** Highest priority at height 0 first, with the priority delta */
+class CompareTxMemPoolEntryByPriorityBase
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        if (a.GetModifiedPriorityBase() != b.GetModifiedPriorityBase())
+            return a.GetModifiedPriorityBase() > b.GetModifiedPriorityBase();
+        return a.GetTx().GetHash() < b.GetTx().GetHash();
+    }
+};
+
+/** Fastest growing priority first */
+class CompareTxMemPoolEntryByPriorityGrowth
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        if (a.GetPriorityGrowth() != b.GetPriorityGrowth())
+            return a.GetPriorityGrowth() > b.GetPriorityGrowth();
+        return a.GetTx().GetHash() < b.GetTx().GetHash();
+    }
+};
+
+// Multi_index tag names
+struct descendant_score {
+};
+struct entry_time {
+};
+struct ancestor_score {
+};
+struct priority_base {
+};
+struct priority_growth {
 };
 
 class CMinerPolicyEstimator;
@@ -82,6 +255,27 @@ public:
     bool IsNull() const { return (ptx == NULL && n == (uint32_t)-1); }
 };
 
+/** Totals of the mempool transactions whose fee rate falls in one range of the fee histogram */
+struct CFeeRateBucket {
+    CAmount nMinFeeRate; //! lower bound of the range, per kB
+    uint64_t nCount;
+    uint64_t nSize;
+    CAmount nFees;
+
+    CFeeRateBucket(CAmount nMinFeeRateIn = 0) : nMinFeeRate(nMinFeeRateIn), nCount(0), nSize(0), nFees(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nMinFeeRate);
+        READWRITE(nCount);
+        READWRITE(nSize);
+        READWRITE(nFees);
+    }
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -91,6 +285,17 @@ public:
  * are added to the pool: if a new transaction double-spends
  * an input of a transaction in the pool, it is dropped,
  * as are non-standard transactions.
+ *
+ * mapTx is a boost::multi_index that indexes the entries by txid,
+ * by descendant score (for eviction), by entry time (for expiry), by
+ * ancestor score (for mining) and by the two parts of coin age priority
+ * (for the priority area of a block). The priority of an entry at height h
+ * is its priority at height 0 plus h times its growth per block; neither
+ * part changes as blocks come, so the pool is never re-ranked for a new
+ * height. Every entry caches the count, size and
+ * fees of itself together with its in-mempool ancestors and descendants,
+ * and mapLinks records the direct in-mempool parents and children of each
+ * entry so those totals can be kept up to date without walking mapNextTx.
  */
 class CTxMemPool
 {
@@ -101,13 +306,85 @@ private:
 
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
+    uint64_t cachedInnerUsage; //! sum of the estimated memory usage of all entries
+
+    // minimum fee per kB raised by evictions, decays back to zero
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate;
+
+    // fee histogram, kept up to date as entries come and go
+    std::vector<CFeeRateBucket> vFeeHistogram;
+
+    void trackPackageRemoved(const CFeeRate& rate);
+    void UpdateFeeHistogram(const CTxMemPoolEntry& entry, bool add);
 
 public:
+    typedef boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::hashed_unique<mempoolentry_txid, TxidHasher>,
+            // sorted by fee rate
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<descendant_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore>,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime>,
+            // sorted by fee rate with ancestors
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<ancestor_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorScore>,
+            // sorted by priority at height 0
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<priority_base>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByPriorityBase>,
+            // sorted by priority growth per block
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<priority_growth>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByPriorityGrowth> > >
+        indexed_transaction_set;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTxMemPoolEntry> mapTx;
+    indexed_transaction_set mapTx;
+    typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+
+    struct CompareIteratorByHash {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+private:
+    struct TxLinks {
+        setEntries parents;
+        setEntries children;
+    };
+
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    txlinksMap mapLinks;
+
+    void UpdateParent(txiter entry, txiter parent, bool add);
+    void UpdateChild(txiter entry, txiter child, bool add);
+
+    /** Take the removed entries out of the totals of the entries that stay, then unlink them */
+    void UpdateForRemoveFromMempool(const setEntries& entriesToRemove);
+    /** Remove an entry that has already been unlinked */
+    void removeUnchecked(txiter entry);
+
+public:
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -121,6 +398,8 @@ public:
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
+    /** Add an entry whose in-mempool ancestors were already found by CalculateMemPoolAncestors */
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry, const setEntries& setAncestors);
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
@@ -136,6 +415,42 @@ public:
     void ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /** Remove a set of transactions from the pool. Their descendants must be in the set as well,
+     *  unless the transactions were mined. */
+    void RemoveStaged(const setEntries& stage);
+
+    /** Collect the in-mempool ancestors of entry into setAncestors, and check that adding entry
+     *  keeps it and its ancestors within the given limits. errString explains a failed check.
+     *  With fSearchForParents the parents are looked up from the inputs of the transaction,
+     *  otherwise entry must be in the pool already and its recorded parents are used.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const;
+
+    /** Add entryit and all of its in-mempool descendants to setDescendants. Anything already
+     *  in setDescendants is assumed to come with its descendants. */
+    void CalculateDescendants(txiter entryit, setEntries& setDescendants) const;
+
+    const setEntries& GetMemPoolParents(txiter entry) const;
+    const setEntries& GetMemPoolChildren(txiter entry) const;
+
+    /** Remove transactions (with their descendants) that entered the pool before nTime.
+     *  Returns the number of transactions removed. */
+    int Expire(int64_t nTime);
+
+    /** Evict the transaction packages with the lowest fee rate until the pool uses no more
+     *  than sizelimit bytes, raising the minimum fee to the fee rate of what was evicted. */
+    void TrimToSize(size_t sizelimit);
+
+    /** The minimum fee rate to get into the pool, which rises when the pool has been full.
+     *  sizelimit is used to decay the fee faster while the pool is mostly empty. */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /** Estimated memory used by the pool */
+    size_t DynamicMemoryUsage() const;
+
+    /** Count, size and fees of the pool's transactions by fee rate, lowest range first */
+    std::vector<CFeeRateBucket> GetFeeHistogram() const;
+
     unsigned long size()
     {
         LOCK(cs);
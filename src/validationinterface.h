@@ -13,6 +13,8 @@
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class CMasternodeBroadcast;
+class CMasternodePaymentWinner;
 class CReserveScript;
 class CTransaction;
 class CValidationInterface;
@@ -35,6 +37,8 @@ protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
+    virtual void NotifyMasternodeBroadcast(const CMasternodeBroadcast &mnb) {}
+    virtual void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual bool UpdatedTransaction(const uint256 &hash) { return false;}
     virtual void Inventory(const uint256 &hash) {}
@@ -55,6 +59,10 @@ struct CMainSignals {
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
+    /** Notifies listeners of a masternode added to or updated in the masternode list. */
+    boost::signals2::signal<void (const CMasternodeBroadcast &)> NotifyMasternodeBroadcast;
+    /** Notifies listeners of a new masternode payment winner vote. */
+    boost::signals2::signal<void (const CMasternodePaymentWinner &)> NotifyMasternodeWinner;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<bool (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
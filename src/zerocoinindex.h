@@ -0,0 +1,127 @@
+// Copyright (c) 2018 Oxid developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ZEROCOININDEX_H
+#define BITCOIN_ZEROCOININDEX_H
+
+#include "crypto/common.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Kinds of records in the zerocoin height index */
+enum ZerocoinIndexType {
+    ZEROCOIN_INDEX_MINT = 'm',
+    ZEROCOIN_INDEX_SPEND = 's',
+};
+
+/** Where a mint or spend was confirmed: 'M' + pubcoin hash or 'S' + serial hash */
+struct CZerocoinIndexValue {
+    uint256 txid;
+    int nHeight;
+    int nDenomination;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nHeight);
+        READWRITE(nDenomination);
+    }
+
+    CZerocoinIndexValue() { SetNull(); }
+
+    CZerocoinIndexValue(const uint256& t, int h, int denom) : txid(t), nHeight(h), nDenomination(denom) {}
+
+    void SetNull()
+    {
+        txid = 0;
+        nHeight = 0;
+        nDenomination = 0;
+    }
+
+    bool IsNull() const { return txid == 0; }
+};
+
+/**
+ * Mints and spends in chain order: 'H' + type + height + denomination + txid + coin hash.
+ * The record holds the pubcoin or serial. Heights are big endian so a range is one seek.
+ */
+struct CZerocoinHeightKey {
+    unsigned char type;
+    int nHeight;
+    int nDenomination;
+    uint256 txid;
+    uint256 hashCoin;
+
+    CZerocoinHeightKey() { SetNull(); }
+
+    CZerocoinHeightKey(unsigned char typeIn, int nHeightIn, int nDenominationIn, const uint256& txidIn, const uint256& hashCoinIn)
+        : type(typeIn), nHeight(nHeightIn), nDenomination(nDenominationIn), txid(txidIn), hashCoin(hashCoinIn) {}
+
+    void SetNull()
+    {
+        type = 0;
+        nHeight = 0;
+        nDenomination = 0;
+        txid = 0;
+        hashCoin = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 73;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        ::Serialize(s, type, nType, nVersion);
+        WriteBE32(buf, nHeight);
+        s.write((char*)buf, sizeof(buf));
+        WriteBE32(buf, nDenomination);
+        s.write((char*)buf, sizeof(buf));
+        txid.Serialize(s, nType, nVersion);
+        hashCoin.Serialize(s, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[4];
+        ::Unserialize(s, type, nType, nVersion);
+        s.read((char*)buf, sizeof(buf));
+        nHeight = ReadBE32(buf);
+        s.read((char*)buf, sizeof(buf));
+        nDenomination = ReadBE32(buf);
+        txid.Unserialize(s, nType, nVersion);
+        hashCoin.Unserialize(s, nType, nVersion);
+    }
+};
+
+/** Prefix of CZerocoinHeightKey used to seek to the first record at or above a height */
+struct CZerocoinHeightIteratorKey {
+    unsigned char type;
+    int nHeight;
+
+    CZerocoinHeightIteratorKey(unsigned char typeIn, int nHeightIn) : type(typeIn), nHeight(nHeightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 5;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        ::Serialize(s, type, nType, nVersion);
+        WriteBE32(buf, nHeight);
+        s.write((char*)buf, sizeof(buf));
+    }
+};
+
+#endif // BITCOIN_ZEROCOININDEX_H
@@ -25,3 +25,13 @@ bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transacti
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyMasternodeBroadcast(const CMasternodeBroadcast &/*mnb*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeWinner(const CMasternodePaymentWinner &/*winner*/)
+{
+    return true;
+}
@@ -8,6 +8,8 @@
 #include "zmqconfig.h"
 
 class CBlockIndex;
+class CMasternodeBroadcast;
+class CMasternodePaymentWinner;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
@@ -35,6 +37,8 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    virtual bool NotifyMasternodeBroadcast(const CMasternodeBroadcast &mnb);
+    virtual bool NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
 
 protected:
     void *psocket;
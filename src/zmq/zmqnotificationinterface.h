@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
@@ -27,10 +28,15 @@ protected:
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void NotifyTransactionLock(const CTransaction &tx);
+    void NotifyMasternodeBroadcast(const CMasternodeBroadcast &mnb);
+    void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
 
 private:
     CZMQNotificationInterface();
 
+    // held while notifying, the signals fire from several threads and notifiers on one
+    // address share a ZMQ socket, which must only be used by one thread at a time
+    CCriticalSection cs;
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
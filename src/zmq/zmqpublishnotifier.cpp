@@ -5,6 +5,8 @@
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "masternode.h"
+#include "masternode-payments.h"
 #include "util.h"
 #include "crypto/common.h"
 
@@ -16,6 +18,12 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_RAWMASTERNODE = "rawmasternode";
+static const char *MSG_RAWMASTERNODEWINNER = "rawmasternodewinner";
+static const char *MSG_MEMPOOLHISTOGRAM = "mempoolhistogram";
+
+// publish the histogram at most this often while transactions stream in
+static const int64_t MEMPOOL_HISTOGRAM_INTERVAL = 1000;
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -177,22 +185,15 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-// XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    // the block is published as stored on disk, without cs_main and without a deserialize/serialize round trip
+    CSerializeData vchBlock;
+    if(!ReadRawBlockFromDisk(vchBlock, pindex))
     {
-        LOCK(cs_main);
-        CBlock block;
-// XX42        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        if(!ReadBlockFromDisk(block, pindex))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
+        zmqError("Can't read block from disk");
+        return false;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, &vchBlock[0], vchBlock.size());
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
@@ -212,3 +213,43 @@ bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransac
     ss << transaction;
     return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishRawMasternodeNotifier::NotifyMasternodeBroadcast(const CMasternodeBroadcast &mnb)
+{
+    LogPrint("zmq", "zmq: Publish rawmasternode %s\n", mnb.vin.prevout.ToStringShort());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnb;
+    return SendMessage(MSG_RAWMASTERNODE, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishRawMasternodeWinnerNotifier::NotifyMasternodeWinner(const CMasternodePaymentWinner &winner)
+{
+    LogPrint("zmq", "zmq: Publish rawmasternodewinner %s at height %d\n", winner.vinMasternode.prevout.ToStringShort(), winner.nBlockHeight);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << winner;
+    return SendMessage(MSG_RAWMASTERNODEWINNER, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishMempoolHistogramNotifier::Publish(bool fForce)
+{
+    int64_t nNow = GetTimeMillis();
+    if (!fForce && nNow - nLastPublished < MEMPOOL_HISTOGRAM_INTERVAL)
+        return true;
+    nLastPublished = nNow;
+
+    LogPrint("zmq", "zmq: Publish mempoolhistogram\n");
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mempool.GetFeeHistogram();
+    return SendMessage(MSG_MEMPOOLHISTOGRAM, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishMempoolHistogramNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    // a block empties part of the pool, always worth a message
+    return Publish(true);
+}
+
+bool CZMQPublishMempoolHistogramNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    return Publish(false);
+}
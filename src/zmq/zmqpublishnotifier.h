@@ -64,4 +64,30 @@ public:
     bool NotifyTransactionLock(const CTransaction &transaction);
 };
 
+class CZMQPublishRawMasternodeNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeBroadcast(const CMasternodeBroadcast &mnb);
+};
+
+class CZMQPublishRawMasternodeWinnerNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
+};
+
+class CZMQPublishMempoolHistogramNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    int64_t nLastPublished;
+
+    bool Publish(bool fForce);
+
+public:
+    CZMQPublishMempoolHistogramNotifier() : nLastPublished(0) {}
+
+    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyTransaction(const CTransaction &transaction);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H